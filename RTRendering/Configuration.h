@@ -14,6 +14,24 @@ namespace conf
 	const string SHADERS_FOLDER 	= RESOURCES_FOLDER + "shaders/";
 	const string FONTS_FOLDER 		= RESOURCES_FOLDER + "fonts/";
 	const string OBJECTS_FOLDER 	= RESOURCES_FOLDER + "objects/";
+
+	const bool QUANTIZE_POSITIONS	= true;		// Store vertex positions as 16-bit integers over each mesh's bounds (floats otherwise).
+	const int LIGHTS_COUNT			= 3;		// Default number of lights, 1 to 16 (the first command line argument overrides it).
+	const int FILL_LIGHTS_COUNT		= 16;		// Unshadowed point lights with clustered shading (key 'P' cycles 0, 16, 256, 1024).
+	const bool DEFERRED_SHADING		= false;	// Shade opaque geometry from a G-buffer (--deferred or --forward on the command line override it).
+	const int PCF_SAMPLES			= 12;		// Hardware-filtered PCSS filter taps, 1 to 31 (a shader permutation: PCF_SAMPLES).
+
+	struct ShadowQuality						// Shadow map budget.
+	{
+		int side;								// Width and height of every cascade's shadow map, in texels.
+		int depthBits;							// 16 or 24 (normalized integers), or 32 (float).
+	};
+	const ShadowQuality SHADOW_QUALITY_LOW		= { 1024, 16 };		// 2 MB per cascade of each light.
+	const ShadowQuality SHADOW_QUALITY_MEDIUM	= { 2048, 24 };		// 16 MB (24-bit depths take 32 bits).
+	const ShadowQuality SHADOW_QUALITY_HIGH		= { 4096, 32 };		// 64 MB.
+	const ShadowQuality SHADOW_QUALITY			= SHADOW_QUALITY_LOW;
+	const int SHADOW_CASCADES					= 3;		// Shadow maps per light over the camera's view, 1 to Light::MAX_CASCADES.
+	const double CASCADE_SPLIT_LAMBDA			= 0.75;		// Weight of the logarithmic split against the uniform one.
 }
 
 #endif //OPENGL_CONFIGURATION_H
@@ -0,0 +1,165 @@
+#include "DeferredShading.h"
+#include "ProgramReflection.h"
+#include "OpenGL.h"
+
+#include <algorithm>
+
+/**
+ * Compile the geometry and lighting programs and bind the lighting program's shadow map samplers.  Textures are
+ * allocated by resize().
+ * @param shadowMapsUnit Texture unit of the layered shadow maps.
+ * @param shadowCompareUnit Texture unit of the shadow maps with the depth-compare sampler.
+ * @param depthPyramidUnit Texture unit of the shadow maps' min/max depth pyramid.
+ * @param shadowMomentsUnit Texture unit of the EVSM moments of the shadow maps.
+ */
+void DeferredShading::init( GLint shadowMapsUnit, GLint shadowCompareUnit, GLint depthPyramidUnit, GLint shadowMomentsUnit )
+{
+	geometry.init( conf::SHADERS_FOLDER + "shader.vert", conf::SHADERS_FOLDER + "gbuffer.frag", OpenGL::DRAW_FEATURES );
+	Shaders shaders;
+	shaders.define( "PCF_SAMPLES", conf::PCF_SAMPLES );
+	lightingProgram = shaders.compile( conf::SHADERS_FOLDER + "shadowcopy.vert", conf::SHADERS_FOLDER + "deferred.frag" );
+	if( geometry.getPrograms().size() != OpenGL::DRAW_FEATURES.size() || lightingProgram == 0 )
+	{
+		cerr << "Failed to compile deferred shading programs!" << endl;
+		exit( EXIT_FAILURE );
+	}
+	const ProgramReflection& reflection = ProgramReflection::get( lightingProgram );
+	glUseProgram( lightingProgram );
+	glUniform1i( reflection[ProgramReflection::SHADOW_MAPS], shadowMapsUnit );
+	glUniform1i( reflection[ProgramReflection::SHADOW_MAPS_COMPARE], shadowCompareUnit );
+	glUniform1i( reflection[ProgramReflection::DEPTH_PYRAMID], depthPyramidUnit );
+	glUniform1i( reflection[ProgramReflection::SHADOW_MOMENTS], shadowMomentsUnit );
+
+	glGenFramebuffers( 1, &framebufferID );
+	glGenTextures( 1, &depthTextureID );
+	glGenTextures( 1, &albedoTextureID );
+	glGenTextures( 1, &normalTextureID );
+	glGenTextures( 1, &diffuseTextureID );
+	glGenVertexArrays( 1, &vertexArrayID );
+}
+
+/**
+ * (Re)allocate the G-buffer textures and attach them to the framebuffer.
+ */
+void DeferredShading::allocate()
+{
+	const GLuint textureIDs[] = { depthTextureID, albedoTextureID, normalTextureID, diffuseTextureID };
+	const GLint internalFormats[] = { GL_DEPTH_COMPONENT24, GL_RGBA8, GL_RGB10_A2, GL_RGB565 };
+	const GLenum formats[] = { GL_DEPTH_COMPONENT, GL_RGBA, GL_RGBA, GL_RGB };
+	const GLenum types[] = { GL_UNSIGNED_INT, GL_UNSIGNED_BYTE, GL_UNSIGNED_INT_2_10_10_10_REV, GL_UNSIGNED_SHORT_5_6_5 };
+	for( int i = 0; i < 4; i++ )
+	{
+		glBindTexture( GL_TEXTURE_2D, textureIDs[i] );
+		glTexImage2D( GL_TEXTURE_2D, 0, internalFormats[i], width, height, 0, formats[i], types[i], nullptr );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	}
+
+	glBindFramebuffer( GL_FRAMEBUFFER, framebufferID );
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTextureID, 0 );
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTextureID, 0 );
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTextureID, 0 );
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, diffuseTextureID, 0 );
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers( 3, drawBuffers );
+	if( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+	{
+		cerr << "G-buffer framebuffer is not complete!" << endl;
+		exit( EXIT_FAILURE );
+	}
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+/**
+ * Match the framebuffer size, reallocating only if it changed.
+ * @param fullWidth Framebuffer width.
+ * @param fullHeight Framebuffer height.
+ */
+void DeferredShading::resize( GLsizei fullWidth, GLsizei fullHeight )
+{
+	if( fullWidth == width && fullHeight == height )
+		return;
+
+	width = max( fullWidth, 1 );
+	height = max( fullHeight, 1 );
+	allocate();
+}
+
+/**
+ * Bind the G-buffer framebuffer, for the caller to render the opaque geometry into it with the geometry program.
+ */
+void DeferredShading::bindGeometryFramebuffer() const
+{
+	glBindFramebuffer( GL_FRAMEBUFFER, framebufferID );
+}
+
+/**
+ * Light the G-buffer into the default framebuffer, writing the opaque geometry's depth too.  The frame data uniform
+ * buffer must hold the camera pass' light space matrices and light positions, and the fill lights must have been bound to
+ * the lighting program (see LightClusters::bind).  The viewport is left to the caller.
+ * @param Projection The 4x4 camera projection matrix the G-buffer was rendered with.
+ * @param View The 4x4 camera view matrix.
+ * @param gBufferUnit First of four consecutive texture units to read the depth, albedo, normal, and diffuse textures through.
+ * @param useDepthPyramid Whether PCSS should skip the regions classified by the depth pyramid.
+ */
+void DeferredShading::light( const mat44& Projection, const mat44& View, GLint gBufferUnit, bool useDepthPyramid )
+{
+	const ProgramReflection& reflection = ProgramReflection::get( lightingProgram );
+	float inverseProjection[ELEMENTS_PER_MATRIX], inverseView[ELEMENTS_PER_MATRIX];
+	Tx::toOpenGLMatrix( inverseProjection, inv( Projection ) );
+	Tx::toOpenGLMatrix( inverseView, inv( View ) );
+
+	glUseProgram( lightingProgram );
+	glUniformMatrix4fv( reflection[ProgramReflection::INVERSE_PROJECTION], 1, GL_FALSE, inverseProjection );
+	glUniformMatrix4fv( reflection[ProgramReflection::INVERSE_VIEW], 1, GL_FALSE, inverseView );
+	glUniform1i( reflection[ProgramReflection::GBUFFER_DEPTH], gBufferUnit );
+	glUniform1i( reflection[ProgramReflection::GBUFFER_ALBEDO], gBufferUnit + 1 );
+	glUniform1i( reflection[ProgramReflection::GBUFFER_NORMAL], gBufferUnit + 2 );
+	glUniform1i( reflection[ProgramReflection::GBUFFER_DIFFUSE], gBufferUnit + 3 );
+	glUniform1i( reflection[ProgramReflection::USE_DEPTH_PYRAMID], useDepthPyramid );
+
+	const GLuint textureIDs[] = { depthTextureID, albedoTextureID, normalTextureID, diffuseTextureID };
+	for( int i = 0; i < 4; i++ )
+	{
+		glActiveTexture( GL_TEXTURE0 + gBufferUnit + i );
+		glBindTexture( GL_TEXTURE_2D, textureIDs[i] );
+	}
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	glBindVertexArray( vertexArrayID );
+	glDrawArrays( GL_TRIANGLES, 0, 3 );
+}
+
+/**
+ * Free the OpenGL objects.
+ */
+void DeferredShading::release()
+{
+	glDeleteFramebuffers( 1, &framebufferID );
+	glDeleteTextures( 1, &depthTextureID );
+	glDeleteTextures( 1, &albedoTextureID );
+	glDeleteTextures( 1, &normalTextureID );
+	glDeleteTextures( 1, &diffuseTextureID );
+	glDeleteVertexArrays( 1, &vertexArrayID );
+	geometry.release();
+	glDeleteProgram( lightingProgram );
+	ProgramReflection::release( lightingProgram );
+}
+
+/**
+ * @return Programs that write the G-buffer: use them through OpenGL::usePermutations, so that draws select their variant
+ * and send it their data.
+ */
+ShaderPermutations* DeferredShading::getGeometryPermutations()
+{
+	return &geometry;
+}
+
+/**
+ * @return Full-screen lighting program.
+ */
+GLuint DeferredShading::getLightingProgram() const
+{
+	return lightingProgram;
+}
@@ -0,0 +1,52 @@
+#ifndef OPENGL_DEFERREDSHADING_H
+#define OPENGL_DEFERREDSHADING_H
+
+#include <iostream>
+#include <armadillo>
+#include <OpenGL/gl3.h>
+#include "Shaders.h"
+#include "ShaderPermutations.h"
+#include "Transformations.h"
+
+#include "Configuration.h"
+
+using namespace std;
+using namespace arma;
+
+/**
+ * Deferred shading of the opaque geometry, as an alternative to the forward shader.frag.  The scene is drawn once with
+ * the geometry programs (shader.vert and gbuffer.frag, specialized per draw features), which take the same per-draw data
+ * from the OpenGL class, into a compact G-buffer: window depth, an RGBA8 target with the textured diffuse color and the
+ * specular intensity, an RGB10_A2 target with the octahedron-encoded view normal, the shininess, and whether the
+ * surface uses Blinn-Phong, and an RGB565 target with the untextured diffuse color, which the ambient term scales (as
+ * the material's ambient color does in shader.frag).
+ * A full-screen pass then lights every pixel once, with the shadowed lights and its cluster's fill lights, and writes
+ * its depth, so that translucent geometry can be blended on top with the forward program.
+ */
+class DeferredShading
+{
+private:
+	GLuint framebufferID = 0;
+	GLuint depthTextureID = 0;				// DEPTH_COMPONENT24: window depth.
+	GLuint albedoTextureID = 0;				// RGBA8: diffuse color and specular intensity.
+	GLuint normalTextureID = 0;				// RGB10_A2: octahedral normal, shininess / 128, and Blinn-Phong flag.
+	GLuint diffuseTextureID = 0;			// RGB565: untextured diffuse color, for the ambient term.
+	ShaderPermutations geometry;			// Write the G-buffer.
+	GLuint lightingProgram = 0;				// Full-screen lighting pass.
+	GLuint vertexArrayID = 0;				// Empty: the full-screen triangle is generated in the vertex shader.
+	GLsizei width = 0;
+	GLsizei height = 0;
+
+	void allocate();
+
+public:
+	void init( GLint shadowMapsUnit, GLint shadowCompareUnit, GLint depthPyramidUnit, GLint shadowMomentsUnit );
+	void resize( GLsizei fullWidth, GLsizei fullHeight );
+	void bindGeometryFramebuffer() const;
+	void light( const mat44& Projection, const mat44& View, GLint gBufferUnit, bool useDepthPyramid );
+	void release();
+	ShaderPermutations* getGeometryPermutations();
+	GLuint getLightingProgram() const;
+};
+
+#endif //OPENGL_DEFERREDSHADING_H
@@ -0,0 +1,124 @@
+#include "DepthPyramid.h"
+#include "ProgramReflection.h"
+
+#include <algorithm>
+
+/**
+ * Allocate the pyramid for a layered shadow map and compile the reduction program.
+ * @param shadowMapSide Shadow maps width and height.
+ * @param shadowMapLayers Number of shadow map layers.
+ */
+void DepthPyramid::init( GLsizei shadowMapSide, GLsizei shadowMapLayers )
+{
+	side = max( shadowMapSide / 2, 1 );
+	layers = shadowMapLayers;
+	levels = 1;
+	while( ( side >> levels ) > 0 )
+		levels++;
+
+	Shaders shaders;
+	program = shaders.compile( conf::SHADERS_FOLDER + "shadowcopy.vert", conf::SHADERS_FOLDER + "depthpyramid.frag", conf::SHADERS_FOLDER + "shadowcopy.geom" );
+	if( program == 0 )
+	{
+		cerr << "Failed to compile depth pyramid shaders program!" << endl;
+		exit( EXIT_FAILURE );
+	}
+	const ProgramReflection& reflection = ProgramReflection::get( program );
+	glUseProgram( program );
+	glUniform1i( reflection[ProgramReflection::LAYERS_COUNT], layers );
+
+	// RG16 keeps the pyramid at a quarter of the memory of the shadow maps; the reduction rounds level 0 outward.
+	glGenTextures( 1, &textureID );
+	glBindTexture( GL_TEXTURE_2D_ARRAY, textureID );
+	for( GLint level = 0; level < levels; level++ )
+		glTexImage3D( GL_TEXTURE_2D_ARRAY, level, GL_RG16, max( side >> level, 1 ), max( side >> level, 1 ), layers, 0, GL_RG, GL_UNSIGNED_SHORT, nullptr );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0 );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1 );
+
+	glGenFramebuffers( 1, &framebufferID );
+	glBindFramebuffer( GL_FRAMEBUFFER, framebufferID );
+	glFramebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureID, 0 );		// Layered attachment.
+	glDrawBuffer( GL_COLOR_ATTACHMENT0 );
+	if( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+	{
+		cerr << "Depth pyramid framebuffer is not complete!" << endl;
+		exit( EXIT_FAILURE );
+	}
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+
+	glGenVertexArrays( 1, &vertexArrayID );
+}
+
+/**
+ * Rebuild every level from the current shadow maps.  Leaves the pyramid bound to the given texture unit, the default
+ * framebuffer bound, and the viewport to be restored by the caller.
+ * @param shadowMapsTextureID Layered depth texture rendered in the shadow pass.
+ * @param unit Texture unit to read the sources through.
+ */
+void DepthPyramid::build( GLuint shadowMapsTextureID, GLint unit )
+{
+	const ProgramReflection& reflection = ProgramReflection::get( program );
+	glUseProgram( program );
+	glUniform1i( reflection[ProgramReflection::SOURCE_DEPTHS], unit );
+	glBindVertexArray( vertexArrayID );
+	glBindFramebuffer( GL_FRAMEBUFFER, framebufferID );
+	glActiveTexture( GL_TEXTURE0 + unit );
+
+	for( GLint level = 0; level < levels; level++ )
+	{
+		if( level == 0 )
+		{
+			glBindTexture( GL_TEXTURE_2D_ARRAY, shadowMapsTextureID );
+			glUniform1i( reflection[ProgramReflection::FROM_SHADOW_MAPS], true );
+		}
+		else
+		{
+			// Only the previous level may be sampled while this one is attached, or it'd be a feedback loop.
+			glBindTexture( GL_TEXTURE_2D_ARRAY, textureID );
+			glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, level - 1 );
+			glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, level - 1 );
+			glUniform1i( reflection[ProgramReflection::FROM_SHADOW_MAPS], false );
+		}
+
+		glFramebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureID, level );
+		glViewport( 0, 0, max( side >> level, 1 ), max( side >> level, 1 ) );
+		glDrawArrays( GL_TRIANGLES, 0, 3 );
+	}
+
+	glBindTexture( GL_TEXTURE_2D_ARRAY, textureID );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0 );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1 );
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+/**
+ * Free the OpenGL objects.
+ */
+void DepthPyramid::release()
+{
+	glDeleteFramebuffers( 1, &framebufferID );
+	glDeleteTextures( 1, &textureID );
+	glDeleteVertexArrays( 1, &vertexArrayID );
+	glDeleteProgram( program );
+	ProgramReflection::release( program );
+}
+
+/**
+ * @return Texture ID of the layered min/max depth pyramid.
+ */
+GLuint DepthPyramid::getTextureID() const
+{
+	return textureID;
+}
+
+/**
+ * @return Number of mip levels.
+ */
+GLint DepthPyramid::getLevels() const
+{
+	return levels;
+}
@@ -0,0 +1,38 @@
+#ifndef OPENGL_DEPTHPYRAMID_H
+#define OPENGL_DEPTHPYRAMID_H
+
+#include <iostream>
+#include <OpenGL/gl3.h>
+#include "Shaders.h"
+
+#include "Configuration.h"
+
+using namespace std;
+
+/**
+ * Hierarchical min/max depth of the layered shadow maps.  Level 0 has half of the shadow maps' resolution and keeps, in
+ * its red and green channels, the minimum and maximum depth of each 2x2 block of shadow map texels; every next level
+ * reduces 2x2 texels of the previous one.  Each level is built by a full-screen fragment pass that writes all layers at
+ * once (GL 4.1 has no compute shaders).  The fragment shader reads it to bound the depths of a whole PCSS search region
+ * with a handful of fetches.
+ */
+class DepthPyramid
+{
+private:
+	GLuint textureID = 0;					// GL_TEXTURE_2D_ARRAY with RG16 min/max depths and a full mip chain.
+	GLuint framebufferID = 0;
+	GLuint program = 0;						// Reduction program.
+	GLuint vertexArrayID = 0;				// Empty: the full-screen triangle is generated in the vertex shader.
+	GLsizei side = 0;						// Level 0 width and height.
+	GLsizei layers = 0;
+	GLint levels = 0;
+
+public:
+	void init( GLsizei shadowMapSide, GLsizei shadowMapLayers );
+	void build( GLuint shadowMapsTextureID, GLint unit );
+	void release();
+	GLuint getTextureID() const;
+	GLint getLevels() const;
+};
+
+#endif //OPENGL_DEPTHPYRAMID_H
@@ -0,0 +1,181 @@
+#include "Frustum.h"
+
+#include <cmath>
+
+#if defined( __SSE__ ) || defined( _M_X64 )
+#include <xmmintrin.h>
+#define FRUSTUM_USE_SSE
+#endif
+
+/**
+ * Build the bounds of a mesh from its axis-aligned box.
+ * @param boxMin Minimum corner of the box.
+ * @param boxMax Maximum corner of the box.
+ * @return Box and enclosing sphere.
+ */
+BoundingVolume BoundingVolume::fromBox( const float* boxMin, const float* boxMax )
+{
+	BoundingVolume bounds;
+	float squaredRadius = 0;
+	for( int j = 0; j < 3; j++ )
+	{
+		bounds.boxMin[j] = boxMin[j];
+		bounds.boxMax[j] = boxMax[j];
+		bounds.center[j] = ( boxMin[j] + boxMax[j] ) / 2.0f;
+		squaredRadius += ( boxMax[j] - bounds.center[j] ) * ( boxMax[j] - bounds.center[j] );
+	}
+	bounds.radius = sqrt( squaredRadius );
+	return bounds;
+}
+
+/**
+ * Constructor: a frustum that contains everything.
+ */
+Frustum::Frustum()
+{
+	for( int p = 0; p < PLANES; p++ )
+	{
+		planes[p][0] = planes[p][1] = planes[p][2] = 0;
+		planes[p][3] = 1e30f;
+	}
+}
+
+/**
+ * Extract the frustum planes from a projection-view matrix (Gribb and Hartmann): a point p is inside if the clip
+ * coordinates M * p satisfy -w <= x, y, z <= w, and each of those inequalities is a plane in world coordinates.
+ * @param ViewProjection The 4x4 Projection * View matrix.
+ */
+Frustum::Frustum( const mat44& ViewProjection )
+{
+	for( int p = 0; p < PLANES; p++ )
+	{
+		const int row = p / 2;											// Left, right, bottom, top, near, far.
+		const double sign = ( p % 2 == 0 )? 1.0 : -1.0;
+		double plane[4], length = 0;
+		for( int j = 0; j < 4; j++ )
+			plane[j] = ViewProjection( 3, j ) + sign * ViewProjection( row, j );
+		for( int j = 0; j < 3; j++ )
+			length += plane[j] * plane[j];
+		length = sqrt( length );
+		for( int j = 0; j < 4; j++ )									// Normalize so that distances are Euclidean.
+			planes[p][j] = static_cast<float>( ( length > 0 )? plane[j] / length : plane[j] );
+	}
+}
+
+/**
+ * Test bounding spheres against the frustum.
+ * @param x Sphere centers x-coordinates in world space.
+ * @param y Sphere centers y-coordinates.
+ * @param z Sphere centers z-coordinates.
+ * @param r Sphere radii.
+ * @param n Number of spheres.
+ * @param visible[out] For each sphere, 1 if it intersects the frustum, 0 if it's completely outside.
+ * @return Number of visible spheres.
+ */
+size_t Frustum::cullSpheres( const float* x, const float* y, const float* z, const float* r, size_t n, uint8_t* visible ) const
+{
+	size_t i = 0, count = 0;
+
+#ifdef FRUSTUM_USE_SSE
+	for( ; i + 4 <= n; i += 4 )											// Four spheres against one plane per iteration.
+	{
+		const __m128 X = _mm_loadu_ps( x + i ), Y = _mm_loadu_ps( y + i ), Z = _mm_loadu_ps( z + i );
+		const __m128 negR = _mm_sub_ps( _mm_setzero_ps(), _mm_loadu_ps( r + i ) );
+		__m128 outside = _mm_setzero_ps();
+		for( int p = 0; p < PLANES; p++ )
+		{
+			__m128 d = _mm_add_ps( _mm_mul_ps( X, _mm_set1_ps( planes[p][0] ) ), _mm_mul_ps( Y, _mm_set1_ps( planes[p][1] ) ) );
+			d = _mm_add_ps( d, _mm_add_ps( _mm_mul_ps( Z, _mm_set1_ps( planes[p][2] ) ), _mm_set1_ps( planes[p][3] ) ) );
+			outside = _mm_or_ps( outside, _mm_cmplt_ps( d, negR ) );	// Entirely behind this plane?
+		}
+		const int mask = _mm_movemask_ps( outside );
+		for( int k = 0; k < 4; k++ )
+		{
+			visible[i + k] = static_cast<uint8_t>( ( ( mask >> k ) & 1 ) == 0 );
+			count += visible[i + k];
+		}
+	}
+#endif
+
+	for( ; i < n; i++ )
+	{
+		bool outside = false;
+		for( int p = 0; p < PLANES && !outside; p++ )
+			outside = planes[p][0] * x[i] + planes[p][1] * y[i] + planes[p][2] * z[i] + planes[p][3] < -r[i];
+		visible[i] = static_cast<uint8_t>( !outside );
+		count += visible[i];
+	}
+
+	return count;
+}
+
+/**
+ * Test a transformed bounding box against the frustum.  The box is first enlarged to the world-space axis-aligned box
+ * that contains it; then, for each plane, only the corner farthest along the plane normal needs to be checked.
+ * @param bounds Model-space bounds.
+ * @param Model The 4x4 model transformation matrix.
+ * @return False if the box is completely outside the frustum.
+ */
+bool Frustum::intersectsBox( const BoundingVolume& bounds, const mat44& Model ) const
+{
+	float center[3], extent[3];
+	for( int i = 0; i < 3; i++ )
+	{
+		center[i] = static_cast<float>( Model( i, 3 ) );
+		extent[i] = 0;
+		for( int j = 0; j < 3; j++ )
+		{
+			const float m = static_cast<float>( Model( i, j ) );
+			center[i] += m * ( bounds.boxMin[j] + bounds.boxMax[j] ) / 2.0f;
+			extent[i] += fabs( m ) * ( bounds.boxMax[j] - bounds.boxMin[j] ) / 2.0f;
+		}
+	}
+
+	for( int p = 0; p < PLANES; p++ )
+	{
+		const float distance = planes[p][0] * center[0] + planes[p][1] * center[1] + planes[p][2] * center[2] + planes[p][3];
+		const float reach = fabs( planes[p][0] ) * extent[0] + fabs( planes[p][1] ) * extent[1] + fabs( planes[p][2] ) * extent[2];
+		if( distance < -reach )
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Test a single object: its sphere first, then its box.
+ * @param bounds Model-space bounds.
+ * @param Model The 4x4 model transformation matrix.
+ * @return False if the object is completely outside the frustum.
+ */
+bool Frustum::isVisible( const BoundingVolume& bounds, const mat44& Model ) const
+{
+	float center[3], radius;
+	uint8_t visible;
+	transformSphere( bounds, Model, center, radius );
+	return cullSpheres( &center[0], &center[1], &center[2], &radius, 1, &visible ) > 0 && intersectsBox( bounds, Model );
+}
+
+/**
+ * Transform a bounding sphere into world space.  The radius is scaled by the largest axis scaling of the model matrix,
+ * so the result encloses the object even under nonuniform scaling.
+ * @param bounds Model-space bounds.
+ * @param Model The 4x4 model transformation matrix.
+ * @param center[out] Sphere center in world coordinates.
+ * @param radius[out] Sphere radius in world units.
+ */
+void Frustum::transformSphere( const BoundingVolume& bounds, const mat44& Model, float* center, float& radius )
+{
+	double maxScale = 0;
+	for( int i = 0; i < 3; i++ )
+	{
+		double c = Model( i, 3 ), scale = 0;
+		for( int j = 0; j < 3; j++ )
+		{
+			c += Model( i, j ) * bounds.center[j];
+			scale += Model( j, i ) * Model( j, i );							// Squared length of the ith column.
+		}
+		center[i] = static_cast<float>( c );
+		maxScale = fmax( maxScale, scale );
+	}
+	radius = static_cast<float>( bounds.radius * sqrt( maxScale ) );
+}
@@ -0,0 +1,45 @@
+#ifndef OPENGL_FRUSTUM_H
+#define OPENGL_FRUSTUM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <armadillo>
+
+using namespace std;
+using namespace arma;
+
+/**
+ * Model-space bounds of a mesh: its axis-aligned box and the sphere that encloses it.
+ */
+struct BoundingVolume
+{
+	float boxMin[3];
+	float boxMax[3];
+	float center[3];						// Sphere center (the box center) and radius (half of the box diagonal).
+	float radius;
+
+	static BoundingVolume fromBox( const float* boxMin, const float* boxMax );
+};
+
+/**
+ * View volume given by a projection-view matrix, as six normalized planes in world coordinates, for rejecting objects
+ * before they are drawn.  Bounding spheres are tested four at a time with SSE (or one by one where it is unavailable),
+ * and spheres that pass can be refined with their boxes, which fit elongated objects better.
+ */
+class Frustum
+{
+private:
+	static const int PLANES = 6;
+
+	float planes[PLANES][4];				// a, b, c, d for the plane ax + by + cz + d = 0, normals pointing inside.
+
+public:
+	Frustum();
+	explicit Frustum( const mat44& ViewProjection );
+	size_t cullSpheres( const float* x, const float* y, const float* z, const float* r, size_t n, uint8_t* visible ) const;
+	bool intersectsBox( const BoundingVolume& bounds, const mat44& Model ) const;
+	bool isVisible( const BoundingVolume& bounds, const mat44& Model ) const;
+	static void transformSphere( const BoundingVolume& bounds, const mat44& Model, float* center, float& radius );
+};
+
+#endif //OPENGL_FRUSTUM_H
@@ -7,6 +7,10 @@
 //
 
 #include "Light.h"
+#include "Transformations.h"
+
+#include <algorithm>
+#include <limits>
 
 /**
  * Light constructor.
@@ -14,26 +18,35 @@
  * @param c Color triplet -- RGB.
  * @param P The 4x4 light projection matrix.
  * @param unit Shadow map index unit (for texture).
+ * @param technique Shadow technique: PCSS for quality, or EVSM for speed.
+ * @param cascades Number of shadow map cascades, 1 to MAX_CASCADES (each starts with the projection P).
  */
-Light::Light( const vec3& p, const vec3& c, const mat44& P, int unit )
+Light::Light( const vec3& p, const vec3& c, const mat44& P, int unit, ShadowTechnique technique, int cascades )
 {
 	position = vec3( p );
 	lY = position[1];																				// Build light components from its initial value.
 	lXZRadius = sqrt( position[0]*position[0] + position[2]*position[2] );
 	lAngle = atan2( position[0], position[2] );
 	color = { fmax(0.0, fmin(c[0], 1.0)), fmax(0.0, fmin(c[1], 1.0)), fmax(0.0, fmin(c[2], 1.0)) };	// Check color components.
-	Projection = mat44( P );
 	lUnit = unit;
+	lStaleCascades = ( 1u << MAX_CASCADES ) - 1;
+	lShadowTechnique = technique;
+	lCascades = std::max( 1, std::min( cascades, static_cast<int>( MAX_CASCADES ) ) );
+	Projections.assign( lCascades, P );
+	SpaceMatrices.assign( lCascades, P );
 }
 
 /**
  * Rotate light around y-axis.
+ * The static shadow maps of all cascades must be rendered again from the new position.
  * @param angle Amount of rotation in radians.
  */
 void Light::rotateBy( float angle )
 {
 	lAngle += angle;
 	position = { lXZRadius * sin( lAngle ), lY, lXZRadius * cos( lAngle ) };						// New position.
+	if( angle != 0 )
+		invalidateShadowCache();
 }
 
 /**
@@ -44,3 +57,191 @@ int Light::getUnit() const
 {
 	return lUnit;
 }
+
+/**
+ * Get the number of shadow map cascades, i.e. of consecutive shadow map layers that the light uses.
+ * @return Cascades.
+ */
+int Light::getCascadesCount() const
+{
+	return lCascades;
+}
+
+/**
+ * Check whether the static shadow maps of all cascades are up to date.
+ * @return True if static casters don't need to be rendered again.
+ */
+bool Light::isShadowCacheValid() const
+{
+	return ( lStaleCascades & ( ( 1u << lCascades ) - 1 ) ) == 0;
+}
+
+/**
+ * Check whether the static shadow map of a cascade is up to date.
+ * @param cascade Cascade index, 0 to getCascadesCount() - 1.
+ * @return True if static casters don't need to be rendered again into that cascade's layer.
+ */
+bool Light::isShadowCacheValid( int cascade ) const
+{
+	return ( lStaleCascades & ( 1u << cascade ) ) == 0;
+}
+
+/**
+ * Mark the static shadow maps of all cascades as up to date, after rendering the static casters into the stale ones.
+ */
+void Light::validateShadowCache()
+{
+	lStaleCascades = 0;
+}
+
+/**
+ * Force the static shadow maps of all cascades to be rendered again (e.g. because static casters moved).
+ */
+void Light::invalidateShadowCache()
+{
+	lStaleCascades = ( 1u << MAX_CASCADES ) - 1;
+}
+
+/**
+ * Fit the orthographic projection of every cascade to its slice of the camera's view.  Each slice is bounded by a sphere,
+ * whose radius doesn't change as the camera turns or moves, so neither does the size of a shadow map texel in the world;
+ * the sphere's box is then snapped to whole texels, so that it slides over the scene in texel steps and shadow edges
+ * don't shimmer.  Along an axis where the scene is narrower than the sphere, the scene's extent (rounded outward to whole
+ * world units) is used instead.  All cascades share the depth range: from the closest caster to the farthest receiver.
+ * The static shadow map cache of a cascade is invalidated when its projection changes, so that only the layers of the
+ * cascades that slid (usually the near ones, as the camera moves) are rendered again.
+ * @param View The 4x4 light view matrix.
+ * @param sceneBounds World bounds of all shadow casters and receivers.
+ * @param CameraView The 4x4 camera view matrix.
+ * @param CameraProjection The 4x4 camera perspective projection matrix.
+ * @param splits View depths where the cascades begin and end (see splitCascades()), one more than the cascades.
+ * @param side Shadow map width and height, in texels.
+ */
+void Light::fitCascades( const mat44& View, const BoundingVolume& sceneBounds, const mat44& CameraView, const mat44& CameraProjection,
+						 const vector<double>& splits, int side )
+{
+	const double STEP = 1.0;																		// Rounding grid of scene extents, in world units.
+	const double RADIUS_STEP = 1.0 / 64.0;															// Absorbs rounding noise in the slices' radii.
+	const double MIN_NEAR = 0.01;
+	
+	// Scene box in light view coordinates.
+	vec3 sceneMin, sceneMax;
+	sceneMin.fill( numeric_limits<double>::max() );
+	sceneMax.fill( -numeric_limits<double>::max() );
+	for( int c = 0; c < 8; c++ )
+	{
+		vec4 p = View * vec4{ ( c & 1 )? sceneBounds.boxMax[0] : sceneBounds.boxMin[0],
+							  ( c & 2 )? sceneBounds.boxMax[1] : sceneBounds.boxMin[1],
+							  ( c & 4 )? sceneBounds.boxMax[2] : sceneBounds.boxMin[2], 1.0 };
+		sceneMin = arma::min( sceneMin, p.head( 3 ) );
+		sceneMax = arma::max( sceneMax, p.head( 3 ) );
+	}
+	
+	// The light looks down -z: casters anywhere between it and the receivers must fit in front of the near plane.
+	const double near = fmax( floor( -sceneMax[2] / STEP ) * STEP, MIN_NEAR );
+	const double far = fmax( ceil( -sceneMin[2] / STEP ) * STEP, near + STEP );
+	
+	// Rays through the corners of the camera's view, in camera coordinates, scaled to a unit view depth.
+	const mat44 InvCameraProjection = inv( CameraProjection );
+	const mat44 CameraToLight = View * inv( CameraView );
+	vec3 rays[4];
+	for( int c = 0; c < 4; c++ )
+	{
+		vec4 p = InvCameraProjection * vec4{ ( c & 1 )? 1.0 : -1.0, ( c & 2 )? 1.0 : -1.0, -1.0, 1.0 };
+		rays[c] = p.head( 3 ) / -p[2];
+	}
+	
+	for( int k = 0; k < lCascades && k + 1 < static_cast<int>( splits.size() ); k++ )
+	{
+		// Bounding sphere of the slice, in light view coordinates.
+		vec3 corners[8];
+		vec3 center = zeros<vec>( 3 );
+		for( int c = 0; c < 8; c++ )
+		{
+			vec3 p = rays[c & 3] * splits[k + ( c >> 2 )];
+			vec4 q = CameraToLight * vec4{ p[0], p[1], p[2], 1.0 };
+			corners[c] = q.head( 3 );
+			center += corners[c] / 8.0;
+		}
+		double radius = 0;
+		for( int c = 0; c < 8; c++ )
+			radius = fmax( radius, norm( corners[c] - center ) );
+		radius = ceil( radius / RADIUS_STEP ) * RADIUS_STEP;
+		
+		double lo[2], hi[2];
+		for( int a = 0; a < 2; a++ )
+		{
+			double sceneLo = floor( sceneMin[a] / STEP ) * STEP, sceneHi = fmax( ceil( sceneMax[a] / STEP ) * STEP, sceneLo + STEP );
+			if( sceneHi - sceneLo <= 2.0 * radius )
+			{
+				lo[a] = sceneLo;
+				hi[a] = sceneHi;
+			}
+			else
+			{
+				const double texel = 2.0 * radius / side;
+				lo[a] = floor( ( center[a] - radius ) / texel ) * texel;
+				hi[a] = lo[a] + 2.0 * radius;
+			}
+		}
+		
+		mat44 P = Tx::ortographic( lo[0], hi[0], lo[1], hi[1], near, far );
+		if( accu( abs( P - Projections[k] ) ) > 0 )
+		{
+			Projections[k] = P;
+			lStaleCascades |= 1u << k;
+		}
+	}
+}
+
+/**
+ * Update the light space matrix of every cascade after its projection or the light's view changed.
+ * @param View The 4x4 light view matrix.
+ */
+void Light::setSpaceMatrices( const mat44& View )
+{
+	for( int k = 0; k < lCascades; k++ )
+		SpaceMatrices[k] = Projections[k] * View;
+}
+
+/**
+ * Split a range of view depths into cascades with the practical split scheme: a blend of the logarithmic split, which
+ * keeps the shadow map texels about the size of the screen pixels but makes the first cascades tiny, and the uniform
+ * split, which wastes resolution far from the camera.
+ * @param near View depth where the first cascade begins.
+ * @param far View depth where the last cascade ends.
+ * @param count Number of cascades (clamped to [1, MAX_CASCADES]).
+ * @param lambda Weight of the logarithmic split, in [0, 1].
+ * @return count + 1 view depths: the first cascade spans [splits[0], splits[1]], and so on.
+ */
+vector<double> Light::splitCascades( double near, double far, int count, double lambda )
+{
+	count = std::max( 1, std::min( count, static_cast<int>( MAX_CASCADES ) ) );
+	near = fmax( near, 1e-3 );
+	far = fmax( far, near );
+	vector<double> splits( count + 1 );
+	for( int i = 0; i <= count; i++ )
+	{
+		const double t = static_cast<double>( i ) / count;
+		splits[i] = lambda * near * pow( far / near, t ) + ( 1.0 - lambda ) * ( near + ( far - near ) * t );
+	}
+	return splits;
+}
+
+/**
+ * Get the technique that the shaders use to evaluate this light's shadows.
+ * @return PCSS or EVSM.
+ */
+Light::ShadowTechnique Light::getShadowTechnique() const
+{
+	return lShadowTechnique;
+}
+
+/**
+ * Choose the technique that the shaders use to evaluate this light's shadows.  It's sent with the lighting properties.
+ * @param technique PCSS or EVSM.
+ */
+void Light::setShadowTechnique( ShadowTechnique technique )
+{
+	lShadowTechnique = technique;
+}
@@ -11,7 +11,10 @@
 
 #include <armadillo>
 #include <OpenGL/gl3.h>
+#include <vector>
+#include "Frustum.h"
 
+using namespace std;
 using namespace arma;
 
 /**
@@ -19,25 +22,43 @@ using namespace arma;
  */
 class Light
 {
+public:
+	enum ShadowTechnique		// How the shaders turn the light's shadow map into a shadow (values as read in GLSL).
+	{
+		PCSS = 0,				// Percentage closer soft shadows: 31-tap blocker search plus PCF_SAMPLES (12) bilinear compare taps.
+		EVSM = 1				// Exponential variance shadow map: one filtered fetch of blurred, mipmapped moments.
+	};
+	static const int MAX_CASCADES = 4;	// Shadow map cascades per light (must match MAX_CASCADES in framedata.glsl).
+	
 private:
 	float lY;					// Starting height.
 	float lXZRadius;			// Pole distance of light on the xz-plane.
 	float lAngle;				// Angle with respect to +z in the xz-plane.
 	int lUnit;					// Unique unit index associated with its entries in the shader.
+	unsigned lStaleCascades;	// Bit c: the static shadow map layer of cascade c doesn't hold the static casters as seen now.
+	ShadowTechnique lShadowTechnique;
+	int lCascades;				// Shadow maps covering consecutive depth slices of the camera's view, 1 to MAX_CASCADES.
 	
 public:
 	vec3 position;				// 3D world light location.
 	vec3 color;					// Color in RGB.
-	mat44 Projection;			// Projection matrix.
-	mat44 SpaceMatrix;			// Product of Light Projection * Light View.
-	
-	GLuint shadowMapFBO;		// OpenGL shading objects for the shadow map (a.k.a. depth map).
-	GLuint shadowMapTextureID;	// Texture ID associated with shadow map.
-	GLint shadowMapLocation;	// Location of shadow map 2D samples in fragment shader.
+	vector<mat44> Projections;	// Projection matrix of each cascade.
+	vector<mat44> SpaceMatrices;	// Product of Light Projection * Light View of each cascade.
 	
-	Light( const vec3& p, const vec3& c, const mat44& P, int unit );
+	Light( const vec3& p, const vec3& c, const mat44& P, int unit, ShadowTechnique technique = PCSS, int cascades = 1 );
 	void rotateBy( float angle );
 	int getUnit() const;
+	int getCascadesCount() const;
+	bool isShadowCacheValid() const;
+	bool isShadowCacheValid( int cascade ) const;
+	void validateShadowCache();
+	void invalidateShadowCache();
+	void fitCascades( const mat44& View, const BoundingVolume& sceneBounds, const mat44& CameraView, const mat44& CameraProjection,
+					  const vector<double>& splits, int side );
+	void setSpaceMatrices( const mat44& View );
+	ShadowTechnique getShadowTechnique() const;
+	void setShadowTechnique( ShadowTechnique technique );
+	static vector<double> splitCascades( double near, double far, int count, double lambda );
 };
 
 #endif /* Light_h */
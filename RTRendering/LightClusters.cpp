@@ -0,0 +1,278 @@
+#include "LightClusters.h"
+#include "ProgramReflection.h"
+
+#include <algorithm>
+#include <limits>
+
+/**
+ * Create the texture buffers of the lights, the clusters' ranges, and the light index list.
+ */
+void LightClusters::init()
+{
+	glGenBuffers( 1, &lightsBufferID );
+	glGenBuffers( 1, &rangesBufferID );
+	glGenBuffers( 1, &indicesBufferID );
+	glGenTextures( 1, &lightsTextureID );
+	glGenTextures( 1, &rangesTextureID );
+	glGenTextures( 1, &indicesTextureID );
+
+	const GLuint bufferIDs[] = { lightsBufferID, rangesBufferID, indicesBufferID };
+	const GLuint textureIDs[] = { lightsTextureID, rangesTextureID, indicesTextureID };
+	const GLenum formats[] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+	for( int i = 0; i < 3; i++ )
+	{
+		upload( bufferIDs[i], 0, nullptr );
+		glBindTexture( GL_TEXTURE_BUFFER, textureIDs[i] );
+		glTexBuffer( GL_TEXTURE_BUFFER, formats[i], bufferIDs[i] );		// Follows the buffer when its data is respecified.
+	}
+	glBindTexture( GL_TEXTURE_BUFFER, 0 );
+}
+
+/**
+ * Respecify the data store of a texture buffer's buffer object.
+ * @param bufferID Buffer object.
+ * @param size Data size in bytes (an empty buffer still gets a few bytes).
+ * @param data Data, or null if size is 0.
+ */
+void LightClusters::upload( GLuint bufferID, GLsizeiptr size, const GLvoid* data )
+{
+	glBindBuffer( GL_TEXTURE_BUFFER, bufferID );
+	glBufferData( GL_TEXTURE_BUFFER, max( size, static_cast<GLsizeiptr>( 16 ) ), ( size > 0 )? data : nullptr, GL_STREAM_DRAW );
+	glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+}
+
+/**
+ * View depth where a slice begins: slice 0 spans from the camera to the near depth, and the others split the range up
+ * to the far depth exponentially, so that froxels keep roughly the same proportions.
+ * @param slice Slice index, 0 to GRID_Z (the end of the last slice).
+ * @return View depth.
+ */
+double LightClusters::sliceDepth( int slice ) const
+{
+	if( slice <= 0 )
+		return 0;
+	return near * pow( far / near, static_cast<double>( slice - 1 ) / ( GRID_Z - 1 ) );
+}
+
+/**
+ * Slice that holds a view depth, the same way as shader.frag computes it: depths past the far one fall in the last slice.
+ * @param depth View depth.
+ * @return Slice index, 0 to GRID_Z - 1.
+ */
+int LightClusters::sliceOf( double depth ) const
+{
+	if( depth < near )
+		return 0;
+	const double slice = 1.0 + floor( log( depth / near ) * ( GRID_Z - 1 ) / log( far / near ) );
+	return static_cast<int>( fmin( slice, GRID_Z - 1 ) );
+}
+
+/**
+ * Compute the view space bounding boxes of all froxels for the current depth range.
+ * @param Projection The 4x4 camera perspective projection matrix.
+ */
+void LightClusters::computeBoxes( const mat44& Projection )
+{
+	// Tile edges as rays in camera coordinates, scaled to a unit view depth: x = d * ( ndc + P02 ) / P00.
+	double raysX[GRID_X + 1], raysY[GRID_Y + 1];
+	for( int x = 0; x <= GRID_X; x++ )
+		raysX[x] = ( -1.0 + 2.0 * x / GRID_X + Projection( 0, 2 ) ) / Projection( 0, 0 );
+	for( int y = 0; y <= GRID_Y; y++ )
+		raysY[y] = ( -1.0 + 2.0 * y / GRID_Y + Projection( 1, 2 ) ) / Projection( 1, 1 );
+
+	boxes.resize( CLUSTERS_COUNT );
+	for( int z = 0; z < GRID_Z; z++ )
+	{
+		const double depths[2] = { sliceDepth( z ), sliceDepth( z + 1 ) };
+		for( int y = 0; y < GRID_Y; y++ )
+		{
+			for( int x = 0; x < GRID_X; x++ )
+			{
+				Box& box = boxes[( z * GRID_Y + y ) * GRID_X + x];
+				box.min[0] = box.min[1] = numeric_limits<double>::max();
+				box.max[0] = box.max[1] = -numeric_limits<double>::max();
+				for( int k = 0; k < 8; k++ )			// The froxel's corners.
+				{
+					const double px = raysX[x + ( k & 1 )] * depths[k >> 2], py = raysY[y + ( ( k >> 1 ) & 1 )] * depths[k >> 2];
+					box.min[0] = fmin( box.min[0], px );
+					box.max[0] = fmax( box.max[0], px );
+					box.min[1] = fmin( box.min[1], py );
+					box.max[1] = fmax( box.max[1], py );
+				}
+				box.min[2] = -depths[1];				// The camera looks down -z.
+				box.max[2] = -depths[0];
+			}
+		}
+	}
+	boxesProjection = Projection;
+}
+
+/**
+ * Assign the lights to the froxels they reach, and upload the lights, the clusters' ranges, and the index list.
+ * @param lights Point lights, in world coordinates (at most MAX_LIGHTS are used).
+ * @param Projection The 4x4 camera perspective projection matrix.
+ * @param View The 4x4 camera view matrix.
+ * @param nearDepth View depth where the exponential slices begin.
+ * @param farDepth View depth where the last slice ends.
+ */
+void LightClusters::build( const vector<PointLight>& lights, const mat44& Projection, const mat44& View, double nearDepth, double farDepth )
+{
+	nearDepth = fmax( nearDepth, 1e-3 );
+	farDepth = fmax( farDepth, nearDepth * 1.01 );
+	bool rebuildBoxes = boxes.empty() || nearDepth != near || farDepth != far;
+	for( int r = 0; r < 4 && !rebuildBoxes; r++ )
+		for( int c = 0; c < 4; c++ )
+			rebuildBoxes = rebuildBoxes || Projection( r, c ) != boxesProjection( r, c );
+	if( rebuildBoxes )
+	{
+		near = nearDepth;
+		far = farDepth;
+		computeBoxes( Projection );
+	}
+
+	lightsCount = static_cast<GLsizei>( min( lights.size(), static_cast<size_t>( MAX_LIGHTS ) ) );
+	lightsData.resize( 8 * static_cast<size_t>( lightsCount ) );
+	pairs.clear();
+	for( GLsizei i = 0; i < lightsCount; i++ )
+	{
+		const PointLight& light = lights[i];
+		const vec4 c = View * vec4{ light.position[0], light.position[1], light.position[2], 1.0 };
+		const double r = light.radius;
+		GLfloat* data = &lightsData[8 * static_cast<size_t>( i )];
+		for( int a = 0; a < 3; a++ )
+		{
+			data[a] = static_cast<GLfloat>( c[a] );
+			data[4 + a] = static_cast<GLfloat>( light.color[a] );
+		}
+		data[3] = static_cast<GLfloat>( r );
+		data[7] = 0;
+
+		const double dMin = -c[2] - r, dMax = -c[2] + r;
+		if( r <= 0 || dMax <= 0 || dMin >= far )		// Behind the camera, or beyond the clusters.
+			continue;
+
+		// Tiles covered by the sphere's box.  Normalized device x = P00 * x / d - P02 is monotonic in x and in 1/d, so its
+		// extremes lie at the box corners; a sphere that reaches the camera plane may cover any tile.
+		int x0 = 0, x1 = GRID_X - 1, y0 = 0, y1 = GRID_Y - 1;
+		if( dMin > 0 )
+		{
+			double ndcMin[2] = { numeric_limits<double>::max(), numeric_limits<double>::max() };
+			double ndcMax[2] = { -numeric_limits<double>::max(), -numeric_limits<double>::max() };
+			for( int k = 0; k < 4; k++ )
+			{
+				const double d = ( k & 1 )? dMax : dMin, offset = ( k & 2 )? r : -r;
+				for( int a = 0; a < 2; a++ )
+				{
+					const double ndc = Projection( a, a ) * ( c[a] + offset ) / d - Projection( a, 2 );
+					ndcMin[a] = fmin( ndcMin[a], ndc );
+					ndcMax[a] = fmax( ndcMax[a], ndc );
+				}
+			}
+			x0 = static_cast<int>( floor( fmax( ( ndcMin[0] + 1.0 ) * 0.5 * GRID_X, 0.0 ) ) );
+			x1 = static_cast<int>( floor( fmin( ( ndcMax[0] + 1.0 ) * 0.5 * GRID_X, GRID_X - 1 ) ) );
+			y0 = static_cast<int>( floor( fmax( ( ndcMin[1] + 1.0 ) * 0.5 * GRID_Y, 0.0 ) ) );
+			y1 = static_cast<int>( floor( fmin( ( ndcMax[1] + 1.0 ) * 0.5 * GRID_Y, GRID_Y - 1 ) ) );
+		}
+
+		const int z0 = sliceOf( fmax( dMin, 0.0 ) ), z1 = sliceOf( dMax );
+		for( int z = z0; z <= z1; z++ )
+		{
+			for( int y = y0; y <= y1; y++ )
+			{
+				for( int x = x0; x <= x1; x++ )
+				{
+					const GLuint cluster = static_cast<GLuint>( ( z * GRID_Y + y ) * GRID_X + x );
+					const Box& box = boxes[cluster];
+					double d2 = 0;						// Squared distance from the light to the froxel's box.
+					for( int a = 0; a < 3; a++ )
+					{
+						const double e = fmax( fmax( box.min[a] - c[a], c[a] - box.max[a] ), 0.0 );
+						d2 += e * e;
+					}
+					if( d2 <= r * r )
+						pairs.push_back( cluster << 16 | static_cast<GLuint>( i ) );
+				}
+			}
+		}
+	}
+
+	// Counting sort of the pairs by cluster: every cluster's lights stay in light order.
+	ranges.assign( 2 * CLUSTERS_COUNT, 0 );
+	for( GLuint pair : pairs )
+		ranges[2 * ( pair >> 16 ) + 1]++;
+	GLuint offset = 0;
+	for( int c = 0; c < CLUSTERS_COUNT; c++ )
+	{
+		ranges[2 * c] = offset;
+		offset += ranges[2 * c + 1];
+		ranges[2 * c + 1] = 0;
+	}
+	indices.resize( pairs.size() );
+	for( GLuint pair : pairs )
+	{
+		GLuint* range = &ranges[2 * ( pair >> 16 )];
+		indices[range[0] + range[1]++] = static_cast<GLushort>( pair & 0xFFFF );
+	}
+
+	upload( lightsBufferID, static_cast<GLsizeiptr>( lightsData.size() * sizeof( GLfloat ) ), lightsData.data() );
+	upload( rangesBufferID, static_cast<GLsizeiptr>( ranges.size() * sizeof( GLuint ) ), ranges.data() );
+	upload( indicesBufferID, static_cast<GLsizeiptr>( indices.size() * sizeof( GLushort ) ), indices.data() );
+}
+
+/**
+ * Bind the texture buffers and send the grid's uniforms to a program that includes clusters.glsl.  The program must be in
+ * use, and build() must have been called.
+ * @param program Rendering program.
+ * @param lightsUnit Texture unit for the lights.
+ * @param rangesUnit Texture unit for the clusters' ranges.
+ * @param indicesUnit Texture unit for the light index list.
+ * @param width Framebuffer width.
+ * @param height Framebuffer height.
+ */
+void LightClusters::bind( GLuint program, GLint lightsUnit, GLint rangesUnit, GLint indicesUnit, GLsizei width, GLsizei height ) const
+{
+	const ProgramReflection& reflection = ProgramReflection::get( program );
+	glUniform1i( reflection[ProgramReflection::FILL_LIGHTS], lightsUnit );
+	glUniform1i( reflection[ProgramReflection::CLUSTER_RANGES], rangesUnit );
+	glUniform1i( reflection[ProgramReflection::CLUSTER_LIGHT_INDICES], indicesUnit );
+	glUniform1i( reflection[ProgramReflection::FILL_LIGHTS_COUNT], lightsCount );
+	glUniform3i( reflection[ProgramReflection::CLUSTER_GRID], GRID_X, GRID_Y, GRID_Z );
+	glUniform2f( reflection[ProgramReflection::CLUSTER_TILE_SIZE], static_cast<float>( width ) / GRID_X, static_cast<float>( height ) / GRID_Y );
+	glUniform2f( reflection[ProgramReflection::CLUSTER_SLICING], static_cast<float>( near ), static_cast<float>( ( GRID_Z - 1 ) / log( far / near ) ) );
+
+	glActiveTexture( GL_TEXTURE0 + lightsUnit );
+	glBindTexture( GL_TEXTURE_BUFFER, lightsTextureID );
+	glActiveTexture( GL_TEXTURE0 + rangesUnit );
+	glBindTexture( GL_TEXTURE_BUFFER, rangesTextureID );
+	glActiveTexture( GL_TEXTURE0 + indicesUnit );
+	glBindTexture( GL_TEXTURE_BUFFER, indicesTextureID );
+}
+
+/**
+ * Free the OpenGL objects.
+ */
+void LightClusters::release()
+{
+	glDeleteTextures( 1, &lightsTextureID );
+	glDeleteTextures( 1, &rangesTextureID );
+	glDeleteTextures( 1, &indicesTextureID );
+	glDeleteBuffers( 1, &lightsBufferID );
+	glDeleteBuffers( 1, &rangesBufferID );
+	glDeleteBuffers( 1, &indicesBufferID );
+}
+
+/**
+ * @return Number of lights sent by the last build().
+ */
+GLsizei LightClusters::getLightsCount() const
+{
+	return lightsCount;
+}
+
+/**
+ * @return Length of the light index list written by the last build(), i.e. the sum of all clusters' light counts.
+ */
+size_t LightClusters::getIndicesCount() const
+{
+	return indices.size();
+}
@@ -0,0 +1,70 @@
+#ifndef OPENGL_LIGHTCLUSTERS_H
+#define OPENGL_LIGHTCLUSTERS_H
+
+#include <vector>
+#include <armadillo>
+#include <OpenGL/gl3.h>
+
+using namespace std;
+using namespace arma;
+
+/**
+ * Clustered forward shading of unshadowed point lights.  The camera's view volume is divided into a grid of froxels:
+ * GRID_X x GRID_Y screen tiles by GRID_Z depth slices, spaced exponentially between a near and a far view depth (the
+ * first slice reaches back to the camera).  Every frame, the CPU tests each light's sphere of influence against the view
+ * space boxes of the froxels it may touch, and lists, for every froxel, the indices of the lights that reach it.  The
+ * lights, the froxels' ranges in the list, and the list itself are uploaded to texture buffers (OpenGL 4.1 has neither
+ * compute shaders nor storage buffers), so that shader.frag visits only the lights of its fragment's froxel.
+ */
+class LightClusters
+{
+public:
+	static const int GRID_X = 16;						// Screen tiles along x.
+	static const int GRID_Y = 16;						// Screen tiles along y.
+	static const int GRID_Z = 24;						// Depth slices.
+	static const int CLUSTERS_COUNT = GRID_X * GRID_Y * GRID_Z;
+	static const int MAX_LIGHTS = 65536;				// Light indices are 16-bit.
+
+	struct PointLight
+	{
+		vec3 position;									// World coordinates.
+		vec3 color;
+		double radius;									// Distance at which the light's contribution fades to zero.
+	};
+
+private:
+	struct Box											// Froxel bounds in view coordinates.
+	{
+		double min[3];
+		double max[3];
+	};
+
+	GLuint lightsBufferID = 0, lightsTextureID = 0;		// RGBA32F: view position and radius, then color, of every light.
+	GLuint rangesBufferID = 0, rangesTextureID = 0;		// RG32UI: first index and count of every cluster's lights.
+	GLuint indicesBufferID = 0, indicesTextureID = 0;	// R16UI: light indices, cluster after cluster.
+
+	vector<Box> boxes;									// Cluster c = ( z * GRID_Y + y ) * GRID_X + x.
+	mat44 boxesProjection;								// Projection and depths the boxes were computed for.
+	double near = 0, far = 0;
+
+	vector<GLfloat> lightsData;
+	vector<GLuint> pairs;								// Cluster << 16 | light, for every light that reaches a cluster.
+	vector<GLuint> ranges;
+	vector<GLushort> indices;
+	GLsizei lightsCount = 0;
+
+	double sliceDepth( int slice ) const;
+	int sliceOf( double depth ) const;
+	void computeBoxes( const mat44& Projection );
+	static void upload( GLuint bufferID, GLsizeiptr size, const GLvoid* data );
+
+public:
+	void init();
+	void build( const vector<PointLight>& lights, const mat44& Projection, const mat44& View, double nearDepth, double farDepth );
+	void bind( GLuint program, GLint lightsUnit, GLint rangesUnit, GLint indicesUnit, GLsizei width, GLsizei height ) const;
+	void release();
+	GLsizei getLightsCount() const;
+	size_t getIndicesCount() const;
+};
+
+#endif //OPENGL_LIGHTCLUSTERS_H
@@ -0,0 +1,91 @@
+#include "MappedFile.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Release the mapping (if any).
+ */
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+/**
+ * Map a file into memory for reading.
+ * @param filename Full path to file.
+ * @return True if the file could be opened and mapped (empty files map to a null pointer with zero size), false otherwise.
+ */
+bool MappedFile::open( const string& filename )
+{
+	close();
+
+	int fd = ::open( filename.c_str(), O_RDONLY );
+	if( fd < 0 )
+		return false;
+
+	struct stat info;
+	if( fstat( fd, &info ) != 0 )
+	{
+		::close( fd );
+		return false;
+	}
+
+	mTime = info.st_mtime;
+	length = static_cast<size_t>( info.st_size );
+	if( length > 0 )
+	{
+		void* region = mmap( nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if( region == MAP_FAILED )
+		{
+			::close( fd );
+			length = 0;
+			return false;
+		}
+		madvise( region, length, MADV_SEQUENTIAL );			// We usually scan files front to back.
+		bytes = static_cast<const char*>( region );
+	}
+
+	::close( fd );											// The mapping stays valid after closing the descriptor.
+	return true;
+}
+
+/**
+ * Unmap the file.
+ */
+void MappedFile::close()
+{
+	if( bytes != nullptr )
+		munmap( const_cast<char*>( bytes ), length );
+	bytes = nullptr;
+	length = 0;
+}
+
+/**
+ * Pointer to the first byte of the file.
+ * @return Mapped data, or nullptr if the file is empty or not open.
+ */
+const char* MappedFile::data() const
+{
+	return bytes;
+}
+
+/**
+ * Number of mapped bytes.
+ * @return File size.
+ */
+size_t MappedFile::size() const
+{
+	return length;
+}
+
+/**
+ * Modification time of the file at the time it was mapped.
+ * @return Seconds since epoch.
+ */
+time_t MappedFile::modificationTime() const
+{
+	return mTime;
+}
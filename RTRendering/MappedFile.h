@@ -0,0 +1,32 @@
+#ifndef OPENGL_MAPPEDFILE_H
+#define OPENGL_MAPPEDFILE_H
+
+#include <string>
+#include <ctime>
+
+using namespace std;
+
+/**
+ * Read-only memory mapping of a whole file.
+ * The mapping is released when the object goes out of scope, so pointers into the data must not outlive it.
+ */
+class MappedFile
+{
+private:
+	const char* bytes = nullptr;			// Start of mapped region (nullptr for empty or closed files).
+	size_t length = 0;						// Size of mapped region in bytes.
+	time_t mTime = 0;						// Last modification time of the file when it was opened.
+
+public:
+	MappedFile() = default;
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile& operator=( const MappedFile& ) = delete;
+	~MappedFile();
+	bool open( const string& filename );
+	void close();
+	const char* data() const;
+	size_t size() const;
+	time_t modificationTime() const;
+};
+
+#endif //OPENGL_MAPPEDFILE_H
@@ -0,0 +1,486 @@
+#include "Mesh.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "MeshOptimizer.h"
+
+/**
+ * Build the mesh from an .obj file.
+ * @param filename Full path to the .obj file.
+ * @param encoding How to store vertex positions.
+ * @return True if the file was read and parsed, false otherwise.
+ */
+bool Mesh::loadOBJ( const string& filename, VertexFormat::PositionEncoding encoding )
+{
+	MappedFile file;
+	if( !file.open( filename ) )
+	{
+		cerr << "Unable to open file " << filename << endl;
+		return false;
+	}
+
+	auto start = chrono::steady_clock::now();
+	ObjData obj;
+	if( !ObjParser::parse( file.data(), file.data() + file.size(), obj, 0 ) )
+	{
+		cerr << "File can't be read by our parser: Try exporting with other options" << endl;
+		return false;
+	}
+	auto parsed = chrono::steady_clock::now();
+	build( obj, encoding );								// Deduplication and cache optimization: not part of the parser's throughput.
+
+	double parseSeconds = chrono::duration<double>( parsed - start ).count();
+	double buildMilliseconds = chrono::duration<double, milli>( chrono::steady_clock::now() - parsed ).count();
+	double megabytes = file.size() / ( 1024.0 * 1024.0 );
+	cout << "Finished loading " << obj.triangleCount() << " triangles! (" << megabytes << " MB parsed at "
+		 << megabytes / max( parseSeconds, 1e-9 ) << " MB/s, built in " << buildMilliseconds << " ms)" << endl;
+	return true;
+}
+
+/**
+ * Key that identifies a unique vertex: the (v, vt, vn) indices of a face corner.
+ */
+struct CornerKey
+{
+	int32_t v;
+	int32_t vt;
+	int32_t vn;
+
+	bool operator==( const CornerKey& other ) const
+	{
+		return v == other.v && vt == other.vt && vn == other.vn;
+	}
+};
+
+/**
+ * Hash for corner keys.
+ */
+struct CornerKeyHash
+{
+	size_t operator()( const CornerKey& k ) const
+	{
+		uint64_t h = static_cast<uint32_t>( k.v ) * 0x9E3779B97F4A7C15ULL;
+		h ^= ( ( static_cast<uint64_t>( static_cast<uint32_t>( k.vt ) ) << 32 ) | static_cast<uint32_t>( k.vn ) ) * 0xC2B2AE3D27D4EB4FULL;
+		return static_cast<size_t>( h ^ ( h >> 29 ) );
+	}
+};
+
+/**
+ * Build the indexed, interleaved vertex stream from the parsed face corners.
+ * Corners that share the same (v, vt, vn) triplet become a single vertex.  Corners that lack a normal get their
+ * triangle's face normal, so they are only shared within their own triangle.
+ * @param obj Parsed .obj data.
+ * @param encoding How to store vertex positions.
+ */
+void Mesh::build( const ObjData& obj, VertexFormat::PositionEncoding encoding )
+{
+	const size_t nCorners = obj.corners.size() / 3;
+	withUVs = !obj.uvs.empty();
+	for( size_t i = 0; i < nCorners && withUVs; i++ )
+		withUVs = ( obj.corners[3 * i + 1] >= 0 );
+	if( !withUVs && !obj.uvs.empty() )						// Did we read an inconsistent number of UV texture indices?
+		cout << "WARNING! The UV information is incomplete or missing -- it'll be ignored" << endl;
+
+	// Deduplicate corners: each new triplet gets the next vertex index, and we remember the corner it came from.
+	unordered_map<CornerKey, uint32_t, CornerKeyHash> uniqueVertices;
+	uniqueVertices.reserve( nCorners );
+	vector<uint32_t> indices( nCorners );
+	vector<uint32_t> sourceCorners;
+	sourceCorners.reserve( nCorners );
+	for( size_t i = 0; i < nCorners; i++ )
+	{
+		const int32_t* corner = &obj.corners[3 * i];
+		CornerKey key = { corner[0], withUVs? corner[1] : -1, ( corner[2] >= 0 )? corner[2] : -2 - static_cast<int32_t>( i / 3 ) };
+		auto inserted = uniqueVertices.emplace( key, static_cast<uint32_t>( sourceCorners.size() ) );
+		if( inserted.second )
+			sourceCorners.push_back( static_cast<uint32_t>( i ) );
+		indices[i] = inserted.first->second;
+	}
+	unordered_map<CornerKey, uint32_t, CornerKeyHash>().swap( uniqueVertices );
+
+	// Gather the full-precision attributes of each unique vertex.
+	const size_t nVertices = sourceCorners.size();
+	vector<float> positions( 3 * nVertices ), normals( 3 * nVertices ), uvs( withUVs? 2 * nVertices : 0 );
+	for( size_t i = 0; i < nVertices; i++ )
+	{
+		const size_t c = sourceCorners[i];
+		const int32_t* corner = &obj.corners[3 * c];
+		memcpy( &positions[3 * i], &obj.positions[3 * corner[0]], 3 * sizeof( float ) );			// Vertices.
+		if( withUVs )
+			memcpy( &uvs[2 * i], &obj.uvs[2 * corner[1]], 2 * sizeof( float ) );					// UV coordinates.
+		if( corner[2] >= 0 )
+			memcpy( &normals[3 * i], &obj.normals[3 * corner[2]], 3 * sizeof( float ) );			// Normals.
+		else
+		{
+			const size_t t = c - c % 3;															// Face normal of the corner's triangle.
+			const float* a = &obj.positions[3 * obj.corners[3 * t]];
+			const float* b = &obj.positions[3 * obj.corners[3 * ( t + 1 )]];
+			const float* d = &obj.positions[3 * obj.corners[3 * ( t + 2 )]];
+			float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e2[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float length = sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+			for( int j = 0; j < 3; j++ )
+				normals[3 * i + j] = ( length > 0 )? n[j] / length : 0;
+		}
+	}
+
+	optimize( indices, positions, normals, uvs );
+	computeBounds( positions );
+
+	// Interleave and compress the attributes.
+	format = VertexFormat::create( encoding, true, withUVs, boundsMin, boundsMax );
+	storage.resize( nVertices * format.stride );									// The stream is sized exactly once.
+	format.encode( nVertices, positions.data(), normals.data(), uvs.data(), storage.data() );
+
+	// Narrow the indices to 16 bits whenever they fit.
+	indexSize = ( nVertices <= 0xFFFF )? sizeof( uint16_t ) : sizeof( uint32_t );
+	indexStorage.resize( nCorners * indexSize );
+	if( indexSize == sizeof( uint16_t ) )
+	{
+		uint16_t* narrow = reinterpret_cast<uint16_t*>( indexStorage.data() );
+		for( size_t i = 0; i < nCorners; i++ )
+			narrow[i] = static_cast<uint16_t>( indices[i] );
+	}
+	else if( nCorners > 0 )
+		memcpy( indexStorage.data(), indices.data(), nCorners * sizeof( uint32_t ) );
+
+	cache.close();
+	vertexData = storage.data();
+	vertexBytes = storage.size();
+	verticesCount = static_cast<uint32_t>( nVertices );
+	indexData = indexStorage.data();
+	indicesCount = static_cast<uint32_t>( nCorners );
+
+	cout << "Indexed " << indicesCount << " corners into " << verticesCount << " unique vertices (" << indexSize * 8 << "-bit indices, "
+		 << format.stride << " bytes per vertex)" << endl;
+}
+
+/**
+ * Reorder the triangles for the post-transform vertex cache and for less overdraw, then renumber the vertices in
+ * first-use order and permute the vertex attributes to match.  Reports the cache efficiency before and after.
+ * @param indices [in/out] Triangle list.
+ * @param positions [in/out] Vertex positions as x, y, z triplets.
+ * @param normals [in/out] Vertex normals as x, y, z triplets.
+ * @param uvs [in/out] Vertex texture coordinates as u, v pairs (or empty).
+ */
+void Mesh::optimize( vector<uint32_t>& indices, vector<float>& positions, vector<float>& normals, vector<float>& uvs )
+{
+	const size_t nVertices = positions.size() / 3;
+	if( indices.empty() )
+		return;
+
+	MeshOptimizer::Statistics before = MeshOptimizer::analyzeVertexCache( indices, nVertices, MeshOptimizer::LRU_CACHE );
+	MeshOptimizer::Statistics beforeFIFO = MeshOptimizer::analyzeVertexCache( indices, nVertices, MeshOptimizer::FIFO_CACHE );
+	MeshOptimizer::optimizeVertexCache( indices, nVertices );
+	MeshOptimizer::optimizeOverdraw( indices, positions.data(), nVertices );
+	vector<uint32_t> remap = MeshOptimizer::optimizeVertexFetch( indices, nVertices );
+	MeshOptimizer::Statistics after = MeshOptimizer::analyzeVertexCache( indices, nVertices, MeshOptimizer::LRU_CACHE );
+	MeshOptimizer::Statistics afterFIFO = MeshOptimizer::analyzeVertexCache( indices, nVertices, MeshOptimizer::FIFO_CACHE );
+
+	// Permute each attribute array by the remap table.
+	for( vector<float>* attribute : { &positions, &normals, &uvs } )
+	{
+		const size_t n = attribute->size() / max<size_t>( nVertices, 1 );
+		vector<float> permuted( attribute->size() );
+		for( size_t i = 0; i < nVertices && n > 0; i++ )
+			memcpy( &permuted[n * remap[i]], &( *attribute )[n * i], n * sizeof( float ) );
+		attribute->swap( permuted );
+	}
+
+	cout << "Vertex cache ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr
+		 << " (" << MeshOptimizer::FORSYTH_CACHE_SIZE << "-entry LRU, as optimized for); ACMR " << beforeFIFO.acmr << " -> "
+		 << afterFIFO.acmr << ", ATVR " << beforeFIFO.atvr << " -> " << afterFIFO.atvr << " (" << MeshOptimizer::FIFO_CACHE_SIZE
+		 << "-entry FIFO)" << endl;
+}
+
+/**
+ * Compute the axis-aligned bounding box of the vertex positions.
+ * @param positions Vertex positions as x, y, z triplets.
+ */
+void Mesh::computeBounds( const vector<float>& positions )
+{
+	const size_t nVertices = positions.size() / 3;
+	for( int j = 0; j < 3; j++ )
+	{
+		boundsMin[j] = ( nVertices > 0 )? positions[j] : 0;
+		boundsMax[j] = boundsMin[j];
+	}
+	for( size_t i = 1; i < nVertices; i++ )
+	{
+		for( int j = 0; j < 3; j++ )
+		{
+			boundsMin[j] = min( boundsMin[j], positions[3 * i + j] );
+			boundsMax[j] = max( boundsMax[j], positions[3 * i + j] );
+		}
+	}
+}
+
+/**
+ * Name of the binary cache that goes next to an .obj file.
+ * @param filename Path to the .obj file.
+ * @return Same path with its extension replaced by .rtmesh.
+ */
+string Mesh::cacheFilename( const string& filename )
+{
+	size_t dot = filename.find_last_of( '.' );
+	size_t slash = filename.find_last_of( '/' );
+	if( dot == string::npos || ( slash != string::npos && dot < slash ) )
+		return filename + ".rtmesh";
+	return filename.substr( 0, dot ) + ".rtmesh";
+}
+
+/**
+ * Read the mesh from the .rtmesh cache of an .obj file, if the cache is up to date.
+ * The cache is valid if it was written by this version of the code for the same canonical source path and file size,
+ * and either the source modification time is unchanged or (if the file was touched) its contents hash the same.
+ * The cached vertex stream must also use the requested position encoding.
+ * @param filename Full path to the .obj file (not to the cache).
+ * @param encoding How vertex positions must be stored.
+ * @return True if the mesh now refers to the mapped cache, false if there is no valid cache.
+ */
+bool Mesh::loadCache( const string& filename, VertexFormat::PositionEncoding encoding )
+{
+	if( !cache.open( cacheFilename( filename ) ) || cache.size() < sizeof( CacheHeader ) )
+	{
+		cache.close();
+		return false;
+	}
+
+	CacheHeader header, source;
+	memcpy( &header, cache.data(), sizeof( CacheHeader ) );
+	bool valid = header.magic == CACHE_MAGIC && header.version == CACHE_VERSION
+				 && describeSource( filename, source, false )
+				 && header.sourcePathHash == source.sourcePathHash && header.sourceSize == source.sourceSize;
+	if( valid && header.sourceMTime != source.sourceMTime )						// Touched but maybe not modified: compare contents.
+		valid = describeSource( filename, source, true ) && header.sourceHash == source.sourceHash;
+	valid = valid && header.format.getPositionEncoding() == encoding
+			&& header.vertexBytes == static_cast<uint64_t>( header.verticesCount ) * header.format.stride
+			&& header.vertexOffset + header.vertexBytes <= cache.size() && header.indexOffset + header.indexBytes <= cache.size()
+			&& header.indexBytes == static_cast<uint64_t>( header.indicesCount ) * header.indexSize;
+	if( !valid )
+	{
+		cache.close();
+		return false;
+	}
+
+	vector<uint8_t>().swap( storage );
+	vector<uint8_t>().swap( indexStorage );
+	vertexData = cache.data() + header.vertexOffset;
+	vertexBytes = header.vertexBytes;
+	verticesCount = header.verticesCount;
+	indexData = cache.data() + header.indexOffset;
+	indicesCount = header.indicesCount;
+	indexSize = header.indexSize;
+	withUVs = ( header.withUVs != 0 );
+	memcpy( boundsMin, header.boundsMin, sizeof( boundsMin ) );
+	memcpy( boundsMax, header.boundsMax, sizeof( boundsMax ) );
+	format = header.format;
+	return true;
+}
+
+/**
+ * Write the mesh to the .rtmesh cache of its .obj file.
+ * The file is written under a temporary name and then renamed, so readers never see a partial cache.
+ * @param filename Full path to the .obj file the mesh was built from (not to the cache).
+ * @return True if the cache was written, false otherwise.
+ */
+bool Mesh::saveCache( const string& filename ) const
+{
+	const size_t ALIGNMENT = 64;						// Streams start at cache-line (and thus any attribute) alignment.
+
+	CacheHeader header;
+	memset( &header, 0, sizeof( header ) );
+	if( !describeSource( filename, header, true ) )
+		return false;
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.verticesCount = verticesCount;
+	header.withUVs = withUVs;
+	header.indicesCount = indicesCount;
+	header.indexSize = indexSize;
+	memcpy( header.boundsMin, boundsMin, sizeof( boundsMin ) );
+	memcpy( header.boundsMax, boundsMax, sizeof( boundsMax ) );
+	header.vertexOffset = ( sizeof( CacheHeader ) + ALIGNMENT - 1 ) / ALIGNMENT * ALIGNMENT;
+	header.vertexBytes = vertexBytes;
+	header.indexOffset = header.vertexOffset + ( vertexBytes + ALIGNMENT - 1 ) / ALIGNMENT * ALIGNMENT;
+	header.indexBytes = static_cast<uint64_t>( indicesCount ) * indexSize;
+	header.format = format;
+
+	string cacheName = cacheFilename( filename );
+	string temporaryName = cacheName + ".tmp";
+	FILE* file = fopen( temporaryName.c_str(), "wb" );
+	if( file == nullptr )
+		return false;
+
+	const char padding[ALIGNMENT] = {};
+	bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1
+			  && fwrite( padding, 1, header.vertexOffset - sizeof( header ), file ) == header.vertexOffset - sizeof( header )
+			  && ( vertexBytes == 0 || fwrite( vertexData, vertexBytes, 1, file ) == 1 )
+			  && fwrite( padding, 1, header.indexOffset - header.vertexOffset - vertexBytes, file ) == header.indexOffset - header.vertexOffset - vertexBytes
+			  && ( header.indexBytes == 0 || fwrite( indexData, header.indexBytes, 1, file ) == 1 );
+	ok = ( fclose( file ) == 0 ) && ok;
+	if( !ok || rename( temporaryName.c_str(), cacheName.c_str() ) != 0 )
+	{
+		remove( temporaryName.c_str() );
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Fill in the source-identification fields of a cache header.
+ * @param filename Path to the .obj file.
+ * @param header Header whose source fields are set.
+ * @param withContentHash Whether to also hash the file contents (requires reading the whole file).
+ * @return True if the file exists and could be read, false otherwise.
+ */
+bool Mesh::describeSource( const string& filename, CacheHeader& header, bool withContentHash )
+{
+	char* canonical = realpath( filename.c_str(), nullptr );		// Same key no matter how the path was spelled.
+	if( canonical == nullptr )
+		return false;
+	header.sourcePathHash = hash( canonical, strlen( canonical ) );
+	free( canonical );
+
+	struct stat info;
+	if( stat( filename.c_str(), &info ) != 0 )
+		return false;
+	header.sourceSize = static_cast<uint64_t>( info.st_size );
+	header.sourceMTime = static_cast<int64_t>( info.st_mtime );
+	header.sourceHash = 0;
+
+	if( withContentHash )
+	{
+		MappedFile file;
+		if( !file.open( filename ) )
+			return false;
+		header.sourceHash = hash( file.data(), file.size() );
+	}
+	return true;
+}
+
+/**
+ * 64-bit FNV-1a hash.
+ * @param data Bytes to hash.
+ * @param size Number of bytes.
+ * @param seed Initial hash value (to chain calls).
+ * @return Hash value.
+ */
+uint64_t Mesh::hash( const void* data, size_t size, uint64_t seed )
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>( data );
+	uint64_t h = seed;
+	for( size_t i = 0; i < size; i++ )
+	{
+		h ^= bytes[i];
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+
+/**
+ * Pointer to the vertex stream (valid while the mesh is alive).
+ * @return Start of the interleaved vertices (see getVertexFormat).
+ */
+const void* Mesh::getVertexData() const
+{
+	return vertexData;
+}
+
+/**
+ * Size of the vertex stream.
+ * @return Number of bytes.
+ */
+size_t Mesh::getVertexDataSize() const
+{
+	return vertexBytes;
+}
+
+/**
+ * Number of vertices in the stream.
+ * @return Vertex count.
+ */
+uint32_t Mesh::getVerticesCount() const
+{
+	return verticesCount;
+}
+
+/**
+ * Pointer to the triangle index stream (valid while the mesh is alive).
+ * @return Start of the 16- or 32-bit indices, three per triangle.
+ */
+const void* Mesh::getIndexData() const
+{
+	return indexData;
+}
+
+/**
+ * Size of the index stream.
+ * @return Number of bytes.
+ */
+size_t Mesh::getIndexDataSize() const
+{
+	return static_cast<size_t>( indicesCount ) * indexSize;
+}
+
+/**
+ * Number of indices (three per triangle).
+ * @return Index count.
+ */
+uint32_t Mesh::getIndicesCount() const
+{
+	return indicesCount;
+}
+
+/**
+ * Width of each index.
+ * @return 2 for 16-bit indices, 4 for 32-bit indices.
+ */
+uint32_t Mesh::getIndexSize() const
+{
+	return indexSize;
+}
+
+/**
+ * Does the stream contain texture coordinates?
+ * @return True if every vertex has u, v coordinates.
+ */
+bool Mesh::hasUVs() const
+{
+	return withUVs;
+}
+
+/**
+ * Layout of the vertex stream, including the dequantization of positions.
+ * @return Vertex format.
+ */
+const VertexFormat& Mesh::getVertexFormat() const
+{
+	return format;
+}
+
+/**
+ * Minimum corner of the model-space bounding box.
+ * @return Pointer to x, y, z.
+ */
+const float* Mesh::getBoundsMin() const
+{
+	return boundsMin;
+}
+
+/**
+ * Maximum corner of the model-space bounding box.
+ * @return Pointer to x, y, z.
+ */
+const float* Mesh::getBoundsMax() const
+{
+	return boundsMax;
+}
@@ -0,0 +1,93 @@
+#ifndef OPENGL_MESH_H
+#define OPENGL_MESH_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "MappedFile.h"
+#include "ObjParser.h"
+#include "VertexFormat.h"
+
+using namespace std;
+
+/**
+ * GPU-ready geometry of a 3D object model: a vertex stream and a triangle index stream that can be handed as-is to
+ * glBufferData, plus bounds.  Vertices are the unique (position, texture coordinate, normal) combinations referenced
+ * by the faces, interleaved and compressed as described by the mesh's VertexFormat.  Indices are 16-bit when there
+ * are at most 65535 vertices, 32-bit otherwise.  Triangles are ordered for the post-transform vertex cache and for
+ * low overdraw, and vertices are numbered in the order the triangles first use them (see MeshOptimizer).
+ *
+ * A mesh is either built from an .obj file or read from its binary .rtmesh cache.  In the latter case the stream
+ * points straight into the memory-mapped cache file, so nothing is parsed or copied.  This class doesn't depend on
+ * OpenGL, so that offline tools can bake caches without a context.
+ */
+class Mesh
+{
+private:
+	static const uint32_t CACHE_MAGIC = 0x48534D52;		// "RMSH" in little-endian byte order.
+	static const uint32_t CACHE_VERSION = 4;				// Bump whenever the layout of the cached streams changes.
+
+	struct CacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourcePathHash;			// Hash of the canonical .obj path.
+		uint64_t sourceSize;				// Size of the .obj file in bytes.
+		int64_t sourceMTime;				// Modification time of the .obj file.
+		uint64_t sourceHash;				// Hash of the .obj contents (checked only if the modification time changed).
+		uint32_t verticesCount;
+		uint32_t withUVs;
+		uint32_t indicesCount;
+		uint32_t indexSize;					// Bytes per index: 2 or 4.
+		float boundsMin[3];
+		float boundsMax[3];
+		uint64_t vertexOffset;				// Byte offset and size of the vertex stream within the cache file.
+		uint64_t vertexBytes;
+		uint64_t indexOffset;				// Byte offset and size of the index stream.
+		uint64_t indexBytes;
+		VertexFormat format;				// Layout of the vertex stream.
+	};
+
+	vector<uint8_t> storage;				// Owned interleaved vertex stream (when built from an .obj file).
+	vector<uint8_t> indexStorage;			// Owned index stream of 16- or 32-bit indices.
+	MappedFile cache;						// Mapped cache file (when read from an .rtmesh file).
+	const void* vertexData = nullptr;		// Vertex stream, in either of the above.
+	size_t vertexBytes = 0;
+	uint32_t verticesCount = 0;
+	const void* indexData = nullptr;		// Index stream, in either of the above.
+	uint32_t indicesCount = 0;
+	uint32_t indexSize = 0;
+	bool withUVs = false;
+	VertexFormat format = {};				// How the vertex stream is laid out.
+	float boundsMin[3] = { 0, 0, 0 };		// Axis-aligned bounding box in model space.
+	float boundsMax[3] = { 0, 0, 0 };
+
+	void build( const ObjData& obj, VertexFormat::PositionEncoding encoding );
+	static void optimize( vector<uint32_t>& indices, vector<float>& positions, vector<float>& normals, vector<float>& uvs );
+	void computeBounds( const vector<float>& positions );
+	static bool describeSource( const string& filename, CacheHeader& header, bool withContentHash );
+	static uint64_t hash( const void* data, size_t size, uint64_t seed = 0xCBF29CE484222325ULL );
+
+public:
+	Mesh() = default;
+	Mesh( const Mesh& ) = delete;
+	Mesh& operator=( const Mesh& ) = delete;
+	bool loadOBJ( const string& filename, VertexFormat::PositionEncoding encoding );
+	bool loadCache( const string& filename, VertexFormat::PositionEncoding encoding );
+	bool saveCache( const string& filename ) const;
+	static string cacheFilename( const string& filename );
+
+	const void* getVertexData() const;
+	size_t getVertexDataSize() const;
+	uint32_t getVerticesCount() const;
+	const void* getIndexData() const;
+	size_t getIndexDataSize() const;
+	uint32_t getIndicesCount() const;
+	uint32_t getIndexSize() const;
+	bool hasUVs() const;
+	const VertexFormat& getVertexFormat() const;
+	const float* getBoundsMin() const;
+	const float* getBoundsMax() const;
+};
+
+#endif //OPENGL_MESH_H
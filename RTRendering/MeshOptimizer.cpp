@@ -0,0 +1,381 @@
+#include "MeshOptimizer.h"
+
+#include <cmath>
+#include <algorithm>
+
+/**
+ * Reorder triangles for post-transform vertex cache locality, with Tom Forsyth's linear-speed algorithm.
+ * Every vertex gets a score from its position in a modeled LRU cache and from how many triangles still use it;
+ * triangles are emitted greedily by the sum of their vertices' scores, looking only at triangles adjacent to the cache.
+ * @param indices [in/out] Triangle list; reordered in place.
+ * @param nVertices Number of vertices referenced by the indices.
+ */
+void MeshOptimizer::optimizeVertexCache( vector<uint32_t>& indices, size_t nVertices )
+{
+	const size_t nTriangles = indices.size() / 3;
+	const size_t NONE = nTriangles;
+	if( nTriangles == 0 )
+		return;
+
+	// Vertex-to-triangle adjacency, in compressed rows.
+	vector<uint32_t> liveTriangles( nVertices, 0 );
+	for( uint32_t v : indices )
+		liveTriangles[v]++;
+	vector<uint32_t> offsets( nVertices + 1, 0 );
+	for( size_t v = 0; v < nVertices; v++ )
+		offsets[v + 1] = offsets[v] + liveTriangles[v];
+	vector<uint32_t> adjacency( indices.size() );
+	vector<uint32_t> fill( offsets.begin(), offsets.end() - 1 );
+	for( size_t t = 0; t < nTriangles; t++ )
+		for( int k = 0; k < 3; k++ )
+			adjacency[fill[indices[3 * t + k]]++] = static_cast<uint32_t>( t );
+
+	// Initial scores.
+	vector<int> cachePosition( nVertices, -1 );
+	vector<float> vertexScores( nVertices );
+	for( size_t v = 0; v < nVertices; v++ )
+		vertexScores[v] = forsythVertexScore( -1, liveTriangles[v] );
+	vector<float> triangleScores( nTriangles );
+	vector<bool> emitted( nTriangles, false );
+	size_t bestTriangle = 0;
+	for( size_t t = 0; t < nTriangles; t++ )
+	{
+		triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+		if( triangleScores[t] > triangleScores[bestTriangle] )
+			bestTriangle = t;
+	}
+
+	uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+	int cacheCount = 0;
+	vector<uint32_t> result;
+	result.reserve( indices.size() );
+	size_t cursor = 0;										// Fallback scan position when nothing in the cache is adjacent.
+
+	for( size_t n = 0; n < nTriangles; n++ )
+	{
+		if( bestTriangle == NONE )
+		{
+			while( emitted[cursor] )
+				cursor++;
+			bestTriangle = cursor;
+		}
+
+		// Emit the triangle and detach it from its vertices.
+		const uint32_t* triangle = &indices[3 * bestTriangle];
+		result.insert( result.end(), triangle, triangle + 3 );
+		emitted[bestTriangle] = true;
+		for( int k = 0; k < 3; k++ )
+		{
+			uint32_t* begin = &adjacency[offsets[triangle[k]]];
+			uint32_t* end = begin + liveTriangles[triangle[k]];
+			uint32_t* it = find( begin, end, static_cast<uint32_t>( bestTriangle ) );
+			if( it != end )
+			{
+				swap( *it, *( end - 1 ) );
+				liveTriangles[triangle[k]]--;
+			}
+		}
+
+		// New LRU cache: the triangle's vertices go to the front.
+		uint32_t newCache[FORSYTH_CACHE_SIZE + 3];
+		int newCount = 0;
+		for( int k = 0; k < 3; k++ )
+			if( find( newCache, newCache + newCount, triangle[k] ) == newCache + newCount )
+				newCache[newCount++] = triangle[k];
+		for( int i = 0; i < cacheCount; i++ )
+			if( cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2] )
+				newCache[newCount++] = cache[i];
+
+		// Rescore every vertex that was touched (including those just evicted) and propagate to their triangles.
+		for( int i = 0; i < newCount; i++ )
+		{
+			uint32_t v = newCache[i];
+			cachePosition[v] = ( i < FORSYTH_CACHE_SIZE )? i : -1;
+			float score = forsythVertexScore( cachePosition[v], liveTriangles[v] );
+			float delta = score - vertexScores[v];
+			vertexScores[v] = score;
+			for( uint32_t j = offsets[v]; j < offsets[v] + liveTriangles[v]; j++ )
+				triangleScores[adjacency[j]] += delta;
+		}
+		cacheCount = min( newCount, static_cast<int>( FORSYTH_CACHE_SIZE ) );
+		for( int i = 0; i < cacheCount; i++ )
+			cache[i] = newCache[i];
+
+		// The next triangle is the best one adjacent to the cache.
+		bestTriangle = NONE;
+		float bestScore = -1;
+		for( int i = 0; i < cacheCount; i++ )
+		{
+			uint32_t v = cache[i];
+			for( uint32_t j = offsets[v]; j < offsets[v] + liveTriangles[v]; j++ )
+			{
+				if( triangleScores[adjacency[j]] > bestScore )
+				{
+					bestScore = triangleScores[adjacency[j]];
+					bestTriangle = adjacency[j];
+				}
+			}
+		}
+	}
+
+	indices.swap( result );
+}
+
+/**
+ * Reorder clusters of triangles to reduce overdraw, independently of the view direction.
+ * The (cache-optimized) triangle list is cut into clusters wherever the modeled FIFO cache starts over and, within
+ * those, wherever the running cache miss ratio is within `threshold` of the cluster's; clusters are then sorted so that
+ * the ones facing away from the mesh center (which tend to occlude the rest) are drawn first.
+ * @param indices [in/out] Triangle list; reordered in place.
+ * @param positions Vertex positions as x, y, z triplets.
+ * @param nVertices Number of vertices.
+ * @param threshold Allowed cache miss ratio degradation (1.05 allows 5% more vertex transforms).
+ */
+void MeshOptimizer::optimizeOverdraw( vector<uint32_t>& indices, const float* positions, size_t nVertices, float threshold )
+{
+	const size_t nTriangles = indices.size() / 3;
+	if( nTriangles < 2 )
+		return;
+
+	// Hard boundaries: triangles that miss the cache on all three vertices usually start a disjoint patch.
+	vector<unsigned int> timestamps( nVertices, 0 );
+	unsigned int timestamp = FIFO_CACHE_SIZE + 1;
+	vector<size_t> hardBoundaries;
+	for( size_t t = 0; t < nTriangles; t++ )
+		if( updateFIFOCache( &indices[3 * t], timestamps, timestamp ) == 3 || t == 0 )
+			hardBoundaries.push_back( t );
+	hardBoundaries.push_back( nTriangles );
+
+	// Soft boundaries: split patches wherever the running miss ratio is already good enough.
+	fill( timestamps.begin(), timestamps.end(), 0 );
+	timestamp = 0;
+	vector<size_t> clusters;
+	for( size_t h = 0; h + 1 < hardBoundaries.size(); h++ )
+	{
+		const size_t start = hardBoundaries[h], end = hardBoundaries[h + 1];
+		size_t misses = 0;
+		timestamp += FIFO_CACHE_SIZE + 1;									// Flush the cache.
+		for( size_t t = start; t < end; t++ )
+			misses += updateFIFOCache( &indices[3 * t], timestamps, timestamp );
+		const float clusterThreshold = threshold * static_cast<float>( misses ) / static_cast<float>( end - start );
+
+		clusters.push_back( start );
+		timestamp += FIFO_CACHE_SIZE + 1;
+		size_t runningMisses = 0, runningTriangles = 0;
+		for( size_t t = start; t < end; t++ )
+		{
+			runningMisses += updateFIFOCache( &indices[3 * t], timestamps, timestamp );
+			runningTriangles++;
+			if( static_cast<float>( runningMisses ) / static_cast<float>( runningTriangles ) <= clusterThreshold )
+			{
+				clusters.push_back( t + 1 );
+				timestamp += FIFO_CACHE_SIZE + 1;
+				runningMisses = runningTriangles = 0;
+			}
+		}
+		if( clusters.back() != start )										// Merge the (incomplete) tail into the last cluster.
+			clusters.pop_back();
+	}
+	clusters.push_back( nTriangles );
+
+	// Area-weighted centroid and normal per cluster, and centroid of the whole mesh.
+	const size_t nClusters = clusters.size() - 1;
+	vector<float> sortKeys( nClusters );
+	vector<float> clusterData( 6 * nClusters, 0 );							// Centroid (x, y, z) and normal (x, y, z).
+	double meshCentroid[3] = { 0, 0, 0 }, meshArea = 0;
+	for( size_t c = 0; c < nClusters; c++ )
+	{
+		float* centroid = &clusterData[6 * c];
+		float* normal = centroid + 3;
+		float area = 0;
+		for( size_t t = clusters[c]; t < clusters[c + 1]; t++ )
+		{
+			const float* p0 = &positions[3 * indices[3 * t]];
+			const float* p1 = &positions[3 * indices[3 * t + 1]];
+			const float* p2 = &positions[3 * indices[3 * t + 2]];
+			float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float a = sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+			for( int j = 0; j < 3; j++ )
+			{
+				centroid[j] += a * ( p0[j] + p1[j] + p2[j] ) / 3.0f;
+				normal[j] += n[j];
+			}
+			area += a;
+		}
+		for( int j = 0; j < 3; j++ )
+			meshCentroid[j] += centroid[j];
+		meshArea += area;
+		float length = sqrt( normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2] );
+		for( int j = 0; j < 3; j++ )
+		{
+			centroid[j] = ( area > 0 )? centroid[j] / area : 0;
+			normal[j] = ( length > 0 )? normal[j] / length : 0;
+		}
+	}
+	for( int j = 0; j < 3; j++ )
+		meshCentroid[j] = ( meshArea > 0 )? meshCentroid[j] / meshArea : 0;
+	for( size_t c = 0; c < nClusters; c++ )
+	{
+		const float* centroid = &clusterData[6 * c];
+		const float* normal = centroid + 3;
+		sortKeys[c] = static_cast<float>( ( centroid[0] - meshCentroid[0] ) * normal[0] + ( centroid[1] - meshCentroid[1] ) * normal[1] + ( centroid[2] - meshCentroid[2] ) * normal[2] );
+	}
+
+	// Outward-facing clusters first.
+	vector<size_t> order( nClusters );
+	for( size_t c = 0; c < nClusters; c++ )
+		order[c] = c;
+	stable_sort( order.begin(), order.end(), [&sortKeys]( size_t a, size_t b ){ return sortKeys[a] > sortKeys[b]; } );
+
+	vector<uint32_t> result;
+	result.reserve( indices.size() );
+	for( size_t c : order )
+		result.insert( result.end(), indices.begin() + 3 * clusters[c], indices.begin() + 3 * clusters[c + 1] );
+	indices.swap( result );
+}
+
+/**
+ * Renumber vertices in the order the triangle list first uses them, so attribute fetches walk memory forward.
+ * Unreferenced vertices are moved to the end.
+ * @param indices [in/out] Triangle list; rewritten with the new vertex numbers.
+ * @param nVertices Number of vertices.
+ * @return Remap table: new index of each old vertex.  The caller must permute the vertex attributes accordingly.
+ */
+vector<uint32_t> MeshOptimizer::optimizeVertexFetch( vector<uint32_t>& indices, size_t nVertices )
+{
+	const uint32_t UNUSED = UINT32_MAX;
+	vector<uint32_t> remap( nVertices, UNUSED );
+	uint32_t next = 0;
+	for( uint32_t& index : indices )
+	{
+		if( remap[index] == UNUSED )
+			remap[index] = next++;
+		index = remap[index];
+	}
+	for( uint32_t& r : remap )
+		if( r == UNUSED )
+			r = next++;
+	return remap;
+}
+
+/**
+ * Measure post-transform cache efficiency with a modeled cache.
+ * @param indices Triangle list.
+ * @param nVertices Number of vertices.
+ * @param model Cache to simulate: the optimizer's LRU cache, or a smaller FIFO cache.
+ * @return ACMR (1.0 is ideal for large meshes, 3.0 is worst) and ATVR (1.0 is ideal).
+ */
+MeshOptimizer::Statistics MeshOptimizer::analyzeVertexCache( const vector<uint32_t>& indices, size_t nVertices, CacheModel model )
+{
+	const size_t nTriangles = indices.size() / 3;
+	size_t misses = 0;
+	if( model == LRU_CACHE )
+	{
+		uint32_t cache[FORSYTH_CACHE_SIZE];
+		int cacheCount = 0;
+		for( size_t t = 0; t < nTriangles; t++ )
+			misses += updateLRUCache( &indices[3 * t], cache, cacheCount );
+	}
+	else
+	{
+		vector<unsigned int> timestamps( nVertices, 0 );
+		unsigned int timestamp = FIFO_CACHE_SIZE + 1;
+		for( size_t t = 0; t < nTriangles; t++ )
+			misses += updateFIFOCache( &indices[3 * t], timestamps, timestamp );
+	}
+
+	vector<bool> referenced( nVertices, false );
+	size_t nReferenced = 0;
+	for( uint32_t v : indices )
+	{
+		nReferenced += !referenced[v];
+		referenced[v] = true;
+	}
+
+	Statistics statistics;
+	statistics.acmr = ( nTriangles > 0 )? static_cast<float>( misses ) / nTriangles : 0;
+	statistics.atvr = ( nReferenced > 0 )? static_cast<float>( misses ) / nReferenced : 0;
+	return statistics;
+}
+
+/**
+ * Forsyth vertex score: favors vertices recently used (but not by the last triangle as much as the two before it) and
+ * vertices with few remaining triangles, so that they get finished off and leave the cache.
+ * @param cachePosition Position in the modeled LRU cache, or -1 if not cached.
+ * @param liveTriangles Number of triangles not yet emitted that use the vertex.
+ * @return Score (-1 for vertices with no triangles left).
+ */
+float MeshOptimizer::forsythVertexScore( int cachePosition, unsigned int liveTriangles )
+{
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	if( liveTriangles == 0 )
+		return -1.0f;
+
+	float score = 0;
+	if( cachePosition >= 0 )
+	{
+		if( cachePosition < 3 )
+			score = LAST_TRIANGLE_SCORE;
+		else
+		{
+			const float scaler = 1.0f / ( FORSYTH_CACHE_SIZE - 3 );
+			score = pow( 1.0f - ( cachePosition - 3 ) * scaler, CACHE_DECAY_POWER );
+		}
+	}
+	return score + VALENCE_BOOST_SCALE * pow( static_cast<float>( liveTriangles ), -VALENCE_BOOST_POWER );
+}
+
+/**
+ * Run one triangle through a modeled LRU cache, most recently used vertex first.
+ * @param triangle Three vertex indices.
+ * @param cache [in/out] Cached vertices; room for FORSYTH_CACHE_SIZE.
+ * @param cacheCount [in/out] Number of cached vertices.
+ * @return Number of cache misses (0 to 3).
+ */
+unsigned int MeshOptimizer::updateLRUCache( const uint32_t* triangle, uint32_t* cache, int& cacheCount )
+{
+	unsigned int misses = 0;
+	for( int k = 0; k < 3; k++ )
+	{
+		uint32_t* it = find( cache, cache + cacheCount, triangle[k] );
+		if( it == cache + cacheCount )
+		{
+			if( cacheCount < FORSYTH_CACHE_SIZE )
+				cacheCount++;
+			else
+				it--;										// Evict the least recently used vertex.
+			*it = triangle[k];
+			misses++;
+		}
+		rotate( cache, it, it + 1 );						// Move it to the front.
+	}
+	return misses;
+}
+
+/**
+ * Run one triangle through a modeled FIFO cache.  Vertices are cached if they were inserted within the last
+ * FIFO_CACHE_SIZE insertions, which is tracked with timestamps so the cache never has to be scanned.
+ * @param triangle Three vertex indices.
+ * @param timestamps Per-vertex insertion time.
+ * @param timestamp [in/out] Current time; advancing it by more than the cache size flushes the cache.
+ * @return Number of cache misses (0 to 3).
+ */
+unsigned int MeshOptimizer::updateFIFOCache( const uint32_t* triangle, vector<unsigned int>& timestamps, unsigned int& timestamp )
+{
+	unsigned int misses = 0;
+	for( int k = 0; k < 3; k++ )
+	{
+		if( timestamp - timestamps[triangle[k]] > FIFO_CACHE_SIZE )
+		{
+			timestamps[triangle[k]] = timestamp++;
+			misses++;
+		}
+	}
+	return misses;
+}
@@ -0,0 +1,44 @@
+#ifndef OPENGL_MESHOPTIMIZER_H
+#define OPENGL_MESHOPTIMIZER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Triangle and vertex reordering for indexed triangle lists, to make better use of the GPU's post-transform vertex
+ * cache, reduce overdraw, and fetch vertex attributes in memory order.  The stages are meant to run in this order:
+ * optimizeVertexCache, optimizeOverdraw, optimizeVertexFetch.
+ */
+class MeshOptimizer
+{
+private:
+	static float forsythVertexScore( int cachePosition, unsigned int liveTriangles );
+	static unsigned int updateLRUCache( const uint32_t* triangle, uint32_t* cache, int& cacheCount );
+	static unsigned int updateFIFOCache( const uint32_t* triangle, vector<unsigned int>& timestamps, unsigned int& timestamp );
+
+public:
+	static const int FORSYTH_CACHE_SIZE = 32;			// Modeled LRU cache size for the vertex cache optimizer.
+	static const unsigned int FIFO_CACHE_SIZE = 16;		// Modeled FIFO cache size for statistics and overdraw clustering.
+
+	enum CacheModel
+	{
+		LRU_CACHE,								// FORSYTH_CACHE_SIZE entries: what optimizeVertexCache orders for.
+		FIFO_CACHE								// FIFO_CACHE_SIZE entries: closer to the fixed-size caches of older GPUs.
+	};
+
+	struct Statistics
+	{
+		float acmr;								// Average cache miss ratio: transformed vertices per triangle.
+		float atvr;								// Average transformed vertex ratio: transformed vertices per unique vertex.
+	};
+
+	static void optimizeVertexCache( vector<uint32_t>& indices, size_t nVertices );
+	static void optimizeOverdraw( vector<uint32_t>& indices, const float* positions, size_t nVertices, float threshold = 1.05f );
+	static vector<uint32_t> optimizeVertexFetch( vector<uint32_t>& indices, size_t nVertices );
+	static Statistics analyzeVertexCache( const vector<uint32_t>& indices, size_t nVertices, CacheModel model );
+};
+
+#endif //OPENGL_MESHOPTIMIZER_H
@@ -0,0 +1,466 @@
+#include "ObjParser.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+/**
+ * Is the character a space or a tab?
+ */
+static inline bool isBlank( char c )
+{
+	return c == ' ' || c == '\t';
+}
+
+/**
+ * Is the character a decimal digit?
+ */
+static inline bool isDigit( char c )
+{
+	return static_cast<unsigned char>( c - '0' ) < 10;
+}
+
+/**
+ * Number of triangles after fan-triangulating all polygons.
+ * @return Triangle count.
+ */
+size_t ObjData::triangleCount() const
+{
+	return corners.size() / 9;
+}
+
+/**
+ * Parse an .obj text buffer.
+ * Records other than `v`, `vt`, `vn` and `f` (comments, groups, materials, smoothing groups) are skipped.
+ * @param begin First character of the buffer.
+ * @param end One past the last character of the buffer (the buffer need not be null-terminated).
+ * @param out Output data (previous contents are replaced).
+ * @param nThreads Maximum number of threads to use: 0 to use all hardware threads, 1 for a sequential scan.
+ * @return True if the whole buffer was parsed and all face indices are in range, false otherwise.
+ */
+bool ObjParser::parse( const char* begin, const char* end, ObjData& out, unsigned int nThreads )
+{
+	if( nThreads == 0 )
+		nThreads = max( thread::hardware_concurrency(), 1u );
+	const size_t size = static_cast<size_t>( end - begin );
+	const size_t nChunks = max<size_t>( 1, min<size_t>( min<size_t>( nThreads, MAX_THREADS ), size / MIN_CHUNK_SIZE ) );
+
+	// Split the buffer into chunks that start at the beginning of a line.
+	vector<Chunk> chunks( nChunks );
+	for( size_t i = 0; i < nChunks; i++ )
+	{
+		const char* split = ( i == 0 )? begin : skipLine( begin + i * size / nChunks - 1, end );
+		chunks[i].begin = ( i == 0 )? begin : max( split, chunks[i - 1].begin );
+		if( i > 0 )
+			chunks[i - 1].end = chunks[i].begin;
+	}
+	chunks.back().end = end;
+
+	// Reserve pass: count the records in every chunk.
+	runParallel( nChunks, [&chunks]( size_t i ){
+		chunks[i].counts = count( chunks[i].begin, chunks[i].end );
+	} );
+
+	// Prefix sums give each chunk the global offsets of its attributes, so the output arrays can be sized just once.
+	Counts total = { 0, 0, 0, 0, 0 };
+	for( Chunk& chunk : chunks )
+	{
+		chunk.base = total;
+		total.positions += chunk.counts.positions;
+		total.uvs += chunk.counts.uvs;
+		total.normals += chunk.counts.normals;
+		total.faces += chunk.counts.faces;
+		total.lines += chunk.counts.lines;
+	}
+	out.positions.assign( 3 * total.positions, 0 );
+	out.uvs.assign( 2 * total.uvs, 0 );
+	out.normals.assign( 3 * total.normals, 0 );
+	out.corners.clear();
+	out.nPolygons = 0;
+
+	// Parsing pass: attributes go straight into the shared arrays, and faces into per-chunk corner lists.
+	runParallel( nChunks, [&chunks, &out]( size_t i ){
+		chunks[i].ok = parseChunk( chunks[i], out );
+	} );
+
+	// Merge the corner lists at their prefix-summed offsets.
+	vector<size_t> offsets( nChunks + 1, 0 );
+	for( size_t i = 0; i < nChunks; i++ )
+	{
+		if( !chunks[i].ok )
+			return false;
+		offsets[i + 1] = offsets[i] + chunks[i].corners.size();
+		out.nPolygons += chunks[i].nPolygons;
+	}
+	out.corners.resize( offsets.back() );
+	runParallel( nChunks, [&chunks, &offsets, &out]( size_t i ){
+		if( !chunks[i].corners.empty() )
+			memcpy( out.corners.data() + offsets[i], chunks[i].corners.data(), chunks[i].corners.size() * sizeof( int32_t ) );
+		vector<int32_t>().swap( chunks[i].corners );					// Release chunk memory right away.
+	} );
+
+	return validate( out );
+}
+
+/**
+ * Parse one line-aligned chunk.
+ * Attribute records are written into the (already sized) output arrays starting at the chunk's base offsets.
+ * @param chunk Chunk to parse; its corners, polygon count and status are filled in.
+ * @param out Shared output data.
+ * @return True if every record in the chunk is well formed, false otherwise.
+ */
+bool ObjParser::parseChunk( Chunk& chunk, ObjData& out )
+{
+	float* positions = out.positions.data() + 3 * chunk.base.positions;
+	float* uvs = out.uvs.data() + 2 * chunk.base.uvs;
+	float* normals = out.normals.data() + 3 * chunk.base.normals;
+	int64_t counts[3] = { static_cast<int64_t>( chunk.base.positions ),		// Global number of attributes read so far.
+						  static_cast<int64_t>( chunk.base.uvs ),
+						  static_cast<int64_t>( chunk.base.normals ) };
+	chunk.corners.clear();
+	chunk.corners.reserve( 9 * chunk.counts.faces );						// Exact for triangle meshes; n-gons may still grow it.
+	chunk.nPolygons = 0;
+
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+	size_t line = chunk.base.lines;
+	while( p < end )
+	{
+		line++;
+		p = skipBlanks( p, end );
+		if( p + 1 < end && p[0] == 'v' )
+		{
+			if( isBlank( p[1] ) )												// Vertex position: v x y z [w].
+			{
+				if( !( p = parseFloats( p + 1, end, positions, 3 ) ) )
+				{
+					cerr << "Malformed vertex position at line " << line << endl;
+					return false;
+				}
+				positions += 3;
+				counts[0]++;
+			}
+			else if( p[1] == 't' && p + 2 < end && isBlank( p[2] ) )			// Texture coordinate: vt u v [w].
+			{
+				if( !( p = parseFloats( p + 2, end, uvs, 2 ) ) )
+				{
+					cerr << "Malformed texture coordinate at line " << line << endl;
+					return false;
+				}
+				uvs += 2;
+				counts[1]++;
+			}
+			else if( p[1] == 'n' && p + 2 < end && isBlank( p[2] ) )			// Normal: vn x y z.
+			{
+				if( !( p = parseFloats( p + 2, end, normals, 3 ) ) )
+				{
+					cerr << "Malformed vertex normal at line " << line << endl;
+					return false;
+				}
+				normals += 3;
+				counts[2]++;
+			}
+		}
+		else if( p + 1 < end && p[0] == 'f' && isBlank( p[1] ) )				// Face: f v1[/vt1][/vn1] v2... vN.
+		{
+			p++;
+			if( !parseFace( p, end, counts, chunk.corners, line ) )
+				return false;
+			chunk.nPolygons++;
+		}
+
+		p = skipLine( p, end );
+	}
+
+	return true;
+}
+
+/**
+ * Count the records of each kind in a buffer, without parsing their contents.
+ * @param begin First character of the buffer.
+ * @param end One past the last character.
+ * @return Number of `v`, `vt`, `vn`, and `f` records, and number of lines.
+ */
+ObjParser::Counts ObjParser::count( const char* begin, const char* end )
+{
+	Counts counts = { 0, 0, 0, 0, 0 };
+	const char* p = begin;
+	while( p < end )
+	{
+		counts.lines++;
+		p = skipBlanks( p, end );
+		if( p + 1 < end )
+		{
+			if( p[0] == 'v' )
+			{
+				if( isBlank( p[1] ) )
+					counts.positions++;
+				else if( p + 2 < end && isBlank( p[2] ) )
+				{
+					if( p[1] == 't' )
+						counts.uvs++;
+					else if( p[1] == 'n' )
+						counts.normals++;
+				}
+			}
+			else if( p[0] == 'f' && isBlank( p[1] ) )
+				counts.faces++;
+		}
+		p = skipLine( p, end );
+	}
+
+	return counts;
+}
+
+/**
+ * Parse the corners of a face record and append them as a triangle fan.
+ * Relative (negative) indices are resolved against the number of attributes read so far.
+ * @param p [in/out] Position right after the `f` token; on return, the position where parsing stopped.
+ * @param end One past the last character of the buffer.
+ * @param counts Number of positions, texture coordinates, and normals defined before this face.
+ * @param corners Corner array that receives three triplets per triangle.
+ * @param line Current line number, for error reporting.
+ * @return True if the face has at least three well-formed corners, false otherwise.
+ */
+bool ObjParser::parseFace( const char*& p, const char* end, const int64_t counts[3], vector<int32_t>& corners, size_t line )
+{
+	int32_t first[3], previous[3], current[3];
+	int nCorners = 0;
+
+	while( true )
+	{
+		p = skipBlanks( p, end );
+		if( p >= end || *p == '\n' || *p == '\r' || *p == '#' )
+			break;
+
+		int64_t indices[3] = { 0, 0, 0 };										// Zero means absent (OBJ indices start at 1).
+		if( !( p = parseIndex( p, end, indices[0] ) ) )
+			break;
+		if( p < end && *p == '/' )
+		{
+			p++;
+			if( p < end && *p != '/' && !( p = parseIndex( p, end, indices[1] ) ) )
+				break;
+			if( p < end && *p == '/' && !( p = parseIndex( p + 1, end, indices[2] ) ) )
+				break;
+		}
+
+		for( int k = 0; k < 3; k++ )
+		{
+			int64_t resolved = ( indices[k] > 0 )? indices[k] - 1 : counts[k] + indices[k];
+			if( indices[k] == 0 )
+				resolved = -1;
+			else if( resolved < 0 || resolved > INT32_MAX )
+			{
+				cerr << "Face index out of range at line " << line << endl;
+				return false;
+			}
+			current[k] = static_cast<int32_t>( resolved );
+		}
+		if( current[0] < 0 )
+		{
+			cerr << "Face corner without a vertex position at line " << line << endl;
+			return false;
+		}
+
+		if( nCorners == 0 )
+			memcpy( first, current, sizeof( first ) );
+		else if( nCorners >= 2 )														// Fan triangulation: (first, previous, current).
+		{
+			corners.insert( corners.end(), first, first + 3 );
+			corners.insert( corners.end(), previous, previous + 3 );
+			corners.insert( corners.end(), current, current + 3 );
+		}
+		memcpy( previous, current, sizeof( previous ) );
+		nCorners++;
+	}
+
+	if( p == nullptr || nCorners < 3 )
+	{
+		cerr << "Malformed face at line " << line << endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Parse a fixed number of blank-separated floats.
+ * @param p Start position (leading blanks are allowed).
+ * @param end One past the last character.
+ * @param values Output array with room for n values.
+ * @param n Number of values to read.
+ * @return Position right after the last value, or nullptr if any value is missing or malformed.
+ */
+const char* ObjParser::parseFloats( const char* p, const char* end, float* values, int n )
+{
+	for( int i = 0; i < n && p; i++ )
+		p = parseFloat( skipBlanks( p, end ), end, values[i] );
+	return p;
+}
+
+/**
+ * Parse a decimal floating point number in the style of std::from_chars.
+ * Up to 19 significant digits are accumulated into an integer mantissa; when the mantissa and the decimal exponent
+ * are small enough, a single exact multiplication or division by a power of ten gives the correctly rounded double.
+ * Anything else (very long mantissas, large exponents) falls back to strtod.
+ * @param p Start position.
+ * @param end One past the last character.
+ * @param value Parsed number.
+ * @return Position right after the number, or nullptr if there is no number at p.
+ */
+const char* ObjParser::parseFloat( const char* p, const char* end, float& value )
+{
+	static const double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+											1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const char* start = p;
+	bool negative = false;
+	if( p < end && ( *p == '-' || *p == '+' ) )
+	{
+		negative = ( *p == '-' );
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+	bool anyDigit = false;
+	for( ; p < end && isDigit( *p ); p++ )										// Integer part.
+	{
+		anyDigit = true;
+		if( digits < 19 )
+		{
+			mantissa = mantissa * 10 + static_cast<uint64_t>( *p - '0' );
+			digits += ( mantissa != 0 );										// Leading zeros are not significant.
+		}
+		else
+			exponent++;
+	}
+	if( p < end && *p == '.' )													// Fractional part.
+	{
+		for( p++; p < end && isDigit( *p ); p++ )
+		{
+			anyDigit = true;
+			if( digits < 19 )
+			{
+				mantissa = mantissa * 10 + static_cast<uint64_t>( *p - '0' );
+				digits += ( mantissa != 0 );
+				exponent--;
+			}
+		}
+	}
+	if( !anyDigit )
+		return nullptr;
+
+	if( p < end && ( *p == 'e' || *p == 'E' ) )									// Exponent (only consumed if well formed).
+	{
+		const char* q = p + 1;
+		bool negativeExponent = false;
+		if( q < end && ( *q == '-' || *q == '+' ) )
+		{
+			negativeExponent = ( *q == '-' );
+			q++;
+		}
+		if( q < end && isDigit( *q ) )
+		{
+			int e = 0;
+			for( ; q < end && isDigit( *q ); q++ )
+				e = ( e < 10000 )? e * 10 + ( *q - '0' ) : e;
+			exponent += negativeExponent? -e : e;
+			p = q;
+		}
+	}
+
+	double result;
+	if( mantissa == 0 )
+		result = 0.0;
+	else if( mantissa <= ( 1ULL << 53 ) && exponent >= -22 && exponent <= 22 )	// Fast exact path.
+		result = ( exponent < 0 )? static_cast<double>( mantissa ) / POWERS_OF_TEN[-exponent] : static_cast<double>( mantissa ) * POWERS_OF_TEN[exponent];
+	else
+	{
+		char buffer[64];														// strtod needs a null-terminated copy.
+		size_t n = min( static_cast<size_t>( p - start ), sizeof( buffer ) - 1 );
+		memcpy( buffer, start, n );
+		buffer[n] = '\0';
+		result = fabs( strtod( buffer, nullptr ) );
+	}
+
+	value = static_cast<float>( negative? -result : result );
+	return p;
+}
+
+/**
+ * Parse a (possibly negative) integer face index.
+ * @param p Start position.
+ * @param end One past the last character.
+ * @param value Parsed index.
+ * @return Position right after the index, or nullptr if there is no index at p.
+ */
+const char* ObjParser::parseIndex( const char* p, const char* end, int64_t& value )
+{
+	bool negative = false;
+	if( p < end && *p == '-' )
+	{
+		negative = true;
+		p++;
+	}
+	if( p >= end || !isDigit( *p ) )
+		return nullptr;
+
+	int64_t v = 0;
+	for( ; p < end && isDigit( *p ); p++ )
+		v = ( v < INT64_C( 100000000000 ) )? v * 10 + ( *p - '0' ) : v;			// Saturate; anything this large is rejected later.
+	value = negative? -v : v;
+	return p;
+}
+
+/**
+ * Skip spaces and tabs.
+ * @param p Start position.
+ * @param end One past the last character.
+ * @return First position that is not a blank.
+ */
+const char* ObjParser::skipBlanks( const char* p, const char* end )
+{
+	while( p < end && isBlank( *p ) )
+		p++;
+	return p;
+}
+
+/**
+ * Move to the beginning of the next line.
+ * @param p Any position within the current line.
+ * @param end One past the last character.
+ * @return Position right after the next newline, or end.
+ */
+const char* ObjParser::skipLine( const char* p, const char* end )
+{
+	if( p >= end )
+		return end;
+	const void* newline = memchr( p, '\n', static_cast<size_t>( end - p ) );
+	return ( newline != nullptr )? static_cast<const char*>( newline ) + 1 : end;
+}
+
+/**
+ * Check that every face corner references existing attributes (positive indices may point forward, so this can only
+ * be verified once the whole file has been read).
+ * @param data Parsed data.
+ * @return True if all indices are valid, false otherwise.
+ */
+bool ObjParser::validate( const ObjData& data )
+{
+	const int64_t counts[3] = { static_cast<int64_t>( data.positions.size() / 3 ),
+								static_cast<int64_t>( data.uvs.size() / 2 ),
+								static_cast<int64_t>( data.normals.size() / 3 ) };
+	for( size_t i = 0; i < data.corners.size(); i++ )
+	{
+		if( data.corners[i] >= counts[i % 3] )
+		{
+			cerr << "Face references an undefined " << ( ( i % 3 == 0 )? "vertex" : ( i % 3 == 1 )? "texture coordinate" : "normal" ) << endl;
+			return false;
+		}
+	}
+	return true;
+}
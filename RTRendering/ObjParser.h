@@ -0,0 +1,93 @@
+#ifndef OPENGL_OBJPARSER_H
+#define OPENGL_OBJPARSER_H
+
+#include <vector>
+#include <cstdint>
+#include <thread>
+
+using namespace std;
+
+/**
+ * Raw contents of an .obj file: attribute pools stored as flat float arrays plus triangulated face corners.
+ */
+struct ObjData
+{
+	vector<float> positions;				// x, y, z for each `v` record.
+	vector<float> uvs;						// u, v for each `vt` record.
+	vector<float> normals;					// x, y, z for each `vn` record.
+	vector<int32_t> corners;				// Zero-based (v, vt, vn) index triplets, three corners per triangle; -1 if vt or vn is absent.
+	size_t nPolygons = 0;					// Number of `f` records before triangulation.
+
+	size_t triangleCount() const;
+};
+
+/**
+ * Allocation-free .obj tokenizer for memory-mapped files.
+ * The text is scanned twice: a cheap pass that counts records so that every output array is sized exactly once,
+ * and a parsing pass that writes straight into those arrays.  Faces may be triangles, quads or n-gons (fan-triangulated),
+ * use negative (relative) indices, and come as `v`, `v/vt`, `v//vn`, or `v/vt/vn`.
+ *
+ * Large files are split into line-aligned chunks that are counted and parsed on worker threads.  A prefix sum over the
+ * per-chunk record counts gives every chunk its global attribute offsets, so relative indices resolve exactly as in a
+ * sequential scan and the output is byte-identical for any number of threads.
+ */
+class ObjParser
+{
+private:
+	static const size_t MIN_CHUNK_SIZE = 1 << 20;	// Don't bother splitting work into chunks smaller than 1 MB.
+	static const unsigned int MAX_THREADS = 64;
+
+	struct Counts
+	{
+		size_t positions;
+		size_t uvs;
+		size_t normals;
+		size_t faces;
+		size_t lines;
+	};
+
+	struct Chunk
+	{
+		const char* begin;						// Line-aligned range of text.
+		const char* end;
+		Counts counts;							// Records within this chunk.
+		Counts base;							// Records in all preceding chunks.
+		vector<int32_t> corners;				// Triangulated corners with global indices.
+		size_t nPolygons;
+		bool ok;
+	};
+
+	static Counts count( const char* begin, const char* end );
+	static bool parseChunk( Chunk& chunk, ObjData& out );
+	static bool parseFace( const char*& p, const char* end, const int64_t counts[3], vector<int32_t>& corners, size_t line );
+	static const char* parseFloats( const char* p, const char* end, float* values, int n );
+	static const char* parseFloat( const char* p, const char* end, float& value );
+	static const char* parseIndex( const char* p, const char* end, int64_t& value );
+	static const char* skipBlanks( const char* p, const char* end );
+	static const char* skipLine( const char* p, const char* end );
+	static bool validate( const ObjData& data );
+	template<typename F> static void runParallel( size_t n, const F& task );
+
+public:
+	static bool parse( const char* begin, const char* end, ObjData& out, unsigned int nThreads = 1 );
+};
+
+/**
+ * Run task(0), ..., task(n-1) concurrently: one worker thread per extra task, and the caller runs task(0).
+ * @param n Number of tasks.
+ * @param task Callable taking the task index.
+ */
+template<typename F>
+void ObjParser::runParallel( size_t n, const F& task )
+{
+	vector<thread> workers;
+	workers.reserve( n );
+	for( size_t i = 1; i < n; i++ )
+		workers.emplace_back( [&task, i](){ task( i ); } );
+	if( n > 0 )
+		task( 0 );
+	for( thread& worker : workers )
+		worker.join();
+}
+
+#endif //OPENGL_OBJPARSER_H
@@ -3,9 +3,13 @@
 
 #include <string>
 #include <iostream>
+#include <chrono>
 #include <OpenGL/gl3.h>
 #include <armadillo>
 #include "stb_image.h"
+#include "Mesh.h"
+#include "VertexArray.h"
+#include "Frustum.h"
 
 #include "Configuration.h"
 
@@ -20,18 +24,33 @@ class Object3D
 private:
 	string kind;							// Object type (should be unique for multiple kinds of objects in a scene).
 	GLuint bufferID;						// Buffer ID given by OpenGL.
+	GLuint vertexArrayID;					// Vertex array object with the attribute layout and the element buffer.
+	GLuint depthBufferID;					// Positions only, for depth-only passes.
+	GLuint depthVertexArrayID;				// Vertex array object that reads the positions only buffer.
+	GLuint instanceBufferID;				// Per-instance matrices for instanced rendering.
 	GLuint textureID;						// Texture ID is user creates object with a texture.
 	GLsizei verticesCount;					// Number of vertices stored in buffer.
+	GLuint indexBufferID;					// Element buffer with the triangle indices into the vertex buffer.
+	GLsizei indicesCount;					// Number of indices (three per triangle).
+	GLenum indexType;						// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+	VertexFormat format;					// Layout of the interleaved vertex buffer.
+	BoundingVolume bounds;					// Model-space bounds for frustum culling.
 	bool withTexture;						// Does the object have an enabled texture?
 
-	GLsizei getData( const vector<vec3>& inVs, const vector<vec2>& inUVs, const vector<vec3>& inNs, vector<float>& outVs, vector<float>& outUVs, vector<float>& outNs ) const;
-
 public:
 	Object3D();
 	Object3D( const char* type, const char* filename, const char* textureFilename = nullptr );
-	void loadOBJ( const char* filename, vector<vec3 >& outVertices, vector<vec2>& outUVs, vector<vec3>& outNormals ) const;
 	GLuint getBufferID() const;
+	GLuint getVertexArrayID() const;
+	GLuint getDepthBufferID() const;
+	GLuint getDepthVertexArrayID() const;
+	GLuint getInstanceBufferID() const;
 	GLsizei getVerticesCount() const;
+	GLuint getIndexBufferID() const;
+	GLsizei getIndicesCount() const;
+	GLenum getIndexType() const;
+	const VertexFormat& getVertexFormat() const;
+	const BoundingVolume& getBounds() const;
 	GLuint getTextureID() const;
 	bool hasTexture() const;
 };
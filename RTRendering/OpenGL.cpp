@@ -1,5 +1,13 @@
 #include "OpenGL.h"
 
+#include <cstring>
+#include <limits>
+
+// Textured and plain Blinn-Phong for solids and 3D objects, flat color for paths, and points (see selectVariant()).
+const vector<unsigned> OpenGL::DRAW_FEATURES = {
+	ShaderPermutations::BLINN_PHONG | ShaderPermutations::TEXTURE, ShaderPermutations::BLINN_PHONG, 0, ShaderPermutations::POINT
+};
+
 /**
  * Constructor.
  */
@@ -11,6 +19,8 @@ OpenGL::OpenGL(){}
 OpenGL::~OpenGL()
 {
 	glDeleteVertexArrays( 1, &vao );
+	glDeleteBuffers( 1, &frameDataBufferID );
+	glDeleteBuffers( 1, &drawDataBufferID );
 	glDeleteProgram( glyphsProgram );
 }
 
@@ -22,6 +32,25 @@ void OpenGL::init()
 	// Create vertex array object.
 	glGenVertexArrays( 1, &vao );
 	glBindVertexArray( vao );
+
+	// Uniform buffers: the frame data stays bound to its binding point; draw data is bound per draw at a ring offset.
+	static_assert( sizeof( FrameData ) == 5872, "FrameData must match the std140 layout of the FrameData block" );
+	static_assert( sizeof( DrawData ) == 208, "DrawData must match the std140 layout of the DrawData block" );
+	memset( &frameData, 0, sizeof( frameData ) );
+	memset( &drawData, 0, sizeof( drawData ) );
+	frameData.cascadesCount = 1;
+	frameData.layersMask[0] = frameData.layersMask[1] = ~0u;
+	glGenBuffers( 1, &frameDataBufferID );
+	glBindBuffer( GL_UNIFORM_BUFFER, frameDataBufferID );
+	glBufferData( GL_UNIFORM_BUFFER, sizeof( FrameData ), nullptr, GL_DYNAMIC_DRAW );
+	glBindBufferBase( GL_UNIFORM_BUFFER, ProgramReflection::FRAME_DATA, frameDataBufferID );
+
+	GLint alignment;
+	glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment );
+	drawDataStride = ( ( sizeof( DrawData ) + alignment - 1 ) / alignment ) * alignment;
+	glGenBuffers( 1, &drawDataBufferID );
+	glBindBuffer( GL_UNIFORM_BUFFER, drawDataBufferID );
+	glBufferData( GL_UNIFORM_BUFFER, drawDataStride * DRAW_DATA_SLOTS, nullptr, GL_STREAM_DRAW );
 	
 	// Initialize glyphs via FreeType.
 	initGlyphs();
@@ -168,22 +197,27 @@ void OpenGL::drawPrism( const mat44& Projection, const mat44& Camera, const mat4
  */
 void OpenGL::drawPath( const mat44& Projection, const mat44& Camera, const mat44& Model, const vector<vec3>& vertices )
 {
+	if( isFilteredOut() || recordingBounds )
+		return;
+
+	if( frameData.layersCount > 0 )						// Layered shadow pass: cast shadows into every layer.
+	{
+		setSequenceInformation( Projection, Camera, Model, vertices );
+		drawLayeredSequence( GL_LINE_STRIP );
+		return;
+	}
+
 	if( material.ambient[3] < 1.0 )		// If alpha channel in current material color is not fully opaque, enable blending for transparency.
 	{
 		glEnable( GL_BLEND );
 		glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
 	}
 
-	auto posL = setSequenceInformation( Projection, Camera, Model, vertices );		// Prepare drawing by sending shading information to shaders.
+	setSequenceInformation( Projection, Camera, Model, vertices );		// Prepare drawing by sending shading information to shaders.
 
 	// Draw connected line segments.
-	if( posL >= 0 )
-	{
-		glDrawArrays( GL_LINE_STRIP, 0, path->verticesCount );
-		
-		// Disable vertex attribute array position we sent in the setSequenceInformation function.
-		glDisableVertexAttribArray( posL );
-	}
+	bindDrawData();
+	glDrawArrays( GL_LINE_STRIP, 0, path->verticesCount );
 
 	if( material.ambient[3] < 1.0 )		// Restore blending if necessary.
 		glDisable( GL_BLEND );
@@ -202,37 +236,80 @@ void OpenGL::drawPoints( const mat44& Projection, const mat44& Camera, const mat
 	if( size < 0 )
 		size = 10.0;
 
-	if( material.ambient[3] < 1.0 )		// If alpha channel in current material color is not fully opaque, enable blending for transparency.
+	if( isFilteredOut() || recordingBounds )
+		return;
+
+	const bool layered = frameData.layersCount > 0;		// Layered shadow pass: cast shadows into every layer.
+	if( material.ambient[3] < 1.0 && !layered )		// If alpha channel in current material color is not fully opaque, enable blending for transparency.
 	{
 		glEnable( GL_BLEND );
 		glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
 	}
 
-	auto posL = setSequenceInformation( Projection, Camera, Model, vertices );		// Prepare drawing by sending shading information to shaders.
-	if( posL >= 0 )
+	setSequenceInformation( Projection, Camera, Model, vertices );		// Prepare drawing by sending shading information to shaders.
+
+	// Overriding the point size set by the sendShadingInformation() function in vertex shader.
+	drawData.pointSize = size;
+	
+	// Specify we are drawing a point --setSequenceInformation (via sendShadingInformation) set a false, but here we'll override it with a 1.
+	drawData.drawPoint = true;
+	selectVariant( ShaderPermutations::POINT );
+	
+	glEnable( GL_PROGRAM_POINT_SIZE );
+	if( layered )
+		drawLayeredSequence( GL_POINTS );
+	else
 	{
-		// Overriding the point size set by the sendShadingInformation() function in vertex shader.
-		int pointSize_location = glGetUniformLocation( renderingProgram, "pointSize" );
-		if( pointSize_location >= 0 )
-			glUniform1f( pointSize_location, size );
-		
-		// Specify we are drawing a point --setSequenceInformation (via sendShadingInformation) sent a false, but here we'll override it with a 1.
-		int drawPoint_location = glGetUniformLocation( renderingProgram, "drawPoint" );
-		if( drawPoint_location >= 0 )
-			glUniform1i( drawPoint_location, true );
-		
-		glEnable( GL_PROGRAM_POINT_SIZE );
+		bindDrawData();
 		glDrawArrays( GL_POINTS, 0, path->verticesCount );
-		glDisable( GL_PROGRAM_POINT_SIZE );
-		
-		// Disable vertex attribute array position we sent in the setSequenceInformation function.
-		glDisableVertexAttribArray( posL );
 	}
+	glDisable( GL_PROGRAM_POINT_SIZE );
 
-	if( material.ambient[3] < 1.0 )		// Restore blending mode.
+	if( material.ambient[3] < 1.0 && !layered )		// Restore blending mode.
 		glDisable( GL_BLEND );
 };
 
+/**
+ * Draw the sequence in the path buffer into all shadow map layers, with the layered program for its primitive (the
+ * program in use fans out triangles only), and then return to the program in use.
+ * @param mode GL_LINE_STRIP or GL_POINTS.
+ */
+void OpenGL::drawLayeredSequence( GLenum mode )
+{
+	const GLuint program = ( mode == GL_POINTS )? layeredPointsProgram : layeredLinesProgram;
+	if( program == 0 )									// Not given: sequences don't cast shadows.
+		return;
+
+	const GLuint previous = renderingProgram;
+	bindProgram( program );
+	bindDrawData();
+	glDrawArrays( mode, 0, path->verticesCount );
+	if( previous != 0 )
+		bindProgram( previous );
+}
+
+/**
+ * Choose the texture unit that 3D object models' textures are bound to.  The programs' objectTexture samplers must be
+ * set to the same unit once (e.g. with ShaderPermutations::setUniform), rather than on every draw.
+ * @param unit Texture unit, after the ones that stay bound for the whole frame (e.g. shadow maps).
+ */
+void OpenGL::setObjectTextureUnit( GLint unit )
+{
+	objectTextureUnit = unit;
+}
+
+/**
+ * Set the programs that draw paths and points into the shadow map layers, like the layered program set with useProgram()
+ * does for triangles (e.g. shadow.geom compiled for lines and for points).
+ * @param linesProgram Program for line strips, or 0 for paths not to cast shadows.
+ * @param pointsProgram Program for points, or 0 for points not to cast shadows.
+ */
+void OpenGL::setLayeredSequencePrograms( GLuint linesProgram, GLuint pointsProgram )
+{
+	layeredLinesProgram = linesProgram;
+	layeredPointsProgram = pointsProgram;
+}
+
 /**
  * Auxiliary function to draw any geometry.
  * This function considers the right geometry buffer has been bound (active) and executes all
@@ -245,17 +322,9 @@ void OpenGL::drawPoints( const mat44& Projection, const mat44& Camera, const mat
  */
 void OpenGL::drawGeom( const mat44& Projection, const mat44& Camera, const mat44& Model, GeometryBuffer** G, GeometryTypes t )
 {
-	if( material.ambient[3] < 1.0 )		// If alpha channel in current material color is not fully opaque, enable blending.
-	{
-		glEnable( GL_BLEND );
-		glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
-	}
-
 	if( *G == nullptr )					// No data yet loaded into the buffer?
 	{
 		*G = new GeometryBuffer();
-		glGenBuffers( 1, &((*G)->bufferID) );
-		glBindBuffer( GL_ARRAY_BUFFER, (*G)->bufferID );
 		
 		OpenGLGeometry geom;
 		switch( t )						// Create a geometry vertices and normals according to requested type.
@@ -266,137 +335,259 @@ void OpenGL::drawGeom( const mat44& Projection, const mat44& Camera, const mat44
 			case PRISM: geom.createPrism(); break;
 		}
 
-		vector<float> vertexPositions;
-		vector<float> normals;
-		(*G)->verticesCount = geom.getData( vertexPositions, normals );
+		vector<uint8_t> vertices;
+		(*G)->verticesCount = geom.getData( vertices, (*G)->format, (*G)->bounds, conf::QUANTIZE_POSITIONS? VertexFormat::INT16_POSITIONS : VertexFormat::FLOAT_POSITIONS );
 		
-		// Allocate space for the buffer.
-		const size_t size = sizeof(float) * vertexPositions.size();				// Size of arrays in bytes.
-		glBufferData( GL_ARRAY_BUFFER, 2 * size, nullptr, GL_STATIC_DRAW );
-		glBufferSubData( GL_ARRAY_BUFFER, 0, size, vertexPositions.data() );	// Copy actual position and normal data.
-		glBufferSubData( GL_ARRAY_BUFFER, size, size, normals.data() );
+		// Allocate space for the buffer, record its layout, and copy the interleaved position and normal data.
+		glGenBuffers( 1, &((*G)->bufferID) );
+		(*G)->vertexArrayID = VertexArray::create( (*G)->format, (*G)->bufferID );
+		glBufferData( GL_ARRAY_BUFFER, vertices.size(), vertices.data(), GL_STATIC_DRAW );
+
+		// And the positions alone for depth-only passes.
+		const VertexFormat depthFormat = (*G)->format.positionsOnly();
+		vector<uint8_t> positions( (*G)->verticesCount * depthFormat.stride );
+		(*G)->format.extractPositions( (*G)->verticesCount, vertices.data(), positions.data() );
+		glGenBuffers( 1, &((*G)->depthBufferID) );
+		(*G)->depthVertexArrayID = VertexArray::create( depthFormat, (*G)->depthBufferID );
+		glBufferData( GL_ARRAY_BUFFER, positions.size(), positions.data(), GL_STATIC_DRAW );
 	}
-	else									// Data is already there; just make geom bufferID the active buffer.
-		glBindBuffer( GL_ARRAY_BUFFER, (*G)->bufferID );
-	
-	// Set up our vertex attributes.
-	int position_location = glGetAttribLocation( renderingProgram, "position" );
-	int normal_location = glGetAttribLocation( renderingProgram, "normal" );
-	if( position_location >= 0 )
+
+	if( recordingBounds )
 	{
-		glEnableVertexAttribArray( position_location );
-		glVertexAttribPointer( position_location, ELEMENTS_PER_VERTEX, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET( 0 ) );
-		
-		if( normal_location >= 0 )
-		{
-			glEnableVertexAttribArray( normal_location );
-			size_t offset = sizeof(float) * (*G)->verticesCount * ELEMENTS_PER_VERTEX;
-			glVertexAttribPointer( normal_location, ELEMENTS_PER_VERTEX, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET( offset ) );
-		}
-		
-		sendShadingInformation( Projection, Camera, Model, true );
-		
-		// Draw triangles.
+		recordBounds( (*G)->bounds, Model );
+		return;
+	}
+
+	if( isFilteredOut() || isOutsideFrustum( Projection, Camera, (*G)->bounds, Model ) )
+		return;
+
+	if( depthOnly )						// Positions and transforms only.
+	{
+		glBindVertexArray( (*G)->depthVertexArrayID );
+		sendPositionDequantization( (*G)->format );
+		sendDepthInformation( Projection, Camera, Model );
+		bindDrawData();
 		glDrawArrays( GL_TRIANGLES, 0, (*G)->verticesCount );
-		
-		// Disable attributes.
-		glDisableVertexAttribArray( position_location );
-		if( normal_location >= 0 )
-			glDisableVertexAttribArray( normal_location );
+		return;
 	}
 
+	glBindVertexArray( (*G)->vertexArrayID );
+
+	if( material.ambient[3] < 1.0 )		// If alpha channel in current material color is not fully opaque, enable blending.
+	{
+		glEnable( GL_BLEND );
+		glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+	}
+	
+	sendPositionDequantization( (*G)->format );
+	sendShadingInformation( Projection, Camera, Model, true );
+	
+	// Draw triangles.
+	bindDrawData();
+	glDrawArrays( GL_TRIANGLES, 0, (*G)->verticesCount );
+
 	if( material.ambient[3] < 1.0 )
 		glDisable( GL_BLEND );
 }
 
 /**
- * Send shading information to GPU.
+ * Set the dequantization of vertex positions for the next draw, so that the vertex shader can recover model coordinates.
+ * @param format Vertex format of the geometry about to be drawn.
+ */
+void OpenGL::sendPositionDequantization( const VertexFormat& format )
+{
+	memcpy( drawData.positionScale, format.positionScale, sizeof( drawData.positionScale ) );
+	memcpy( drawData.positionOffset, format.positionOffset, sizeof( drawData.positionOffset ) );
+}
+
+/**
+ * Set shading information for the next draw.
+ * Projection and view go to the frame uniform buffer, which is sent only when they (or the lights) change, so that it is
+ * written once per pass.  Everything else goes to the draw data, which bindDrawData() sends right before drawing.
  * @param Projection 4x4 Projection matrix.
  * @param Camera 4x4 Camera matrix.
  * @param Model 4x4 Model matrix.
  * @param usingBlinnPhong Whether use phong model of flat coloring of geoms.
  * @param usingTexture Whether to render with just colors or with a loaded texture (usually for 3D object models).
+ * @param usingInstancing Whether model and normal matrices come per instance from the vertex array (Model is then applied on top).
  */
-void OpenGL::sendShadingInformation( const mat44& Projection, const mat44& Camera, const mat44& Model, bool usingBlinnPhong, bool usingTexture )
+void OpenGL::sendShadingInformation( const mat44& Projection, const mat44& Camera, const mat44& Model, bool usingBlinnPhong, bool usingTexture, bool usingInstancing )
 {
-	// Send the model, view, projection, and light space matrices (if they exist).
-	int model_location = glGetUniformLocation( renderingProgram, "Model" );
-	int view_location = glGetUniformLocation( renderingProgram, "View");
-	int proj_location = glGetUniformLocation( renderingProgram, "Projection" );
-	int itmv_location = glGetUniformLocation( renderingProgram, "InvTransModelView" );
-	
-	if( model_location >= 0 )			// Send model matrix only if shaders have corresponding receptor.
-	{
-		float model_matrix[ELEMENTS_PER_MATRIX];
-		Tx::toOpenGLMatrix( model_matrix, Model );
-		glUniformMatrix4fv( model_location, 1, GL_FALSE, model_matrix );
-	}
-	
-	if( view_location >= 0 )			// Send view matrix only if shaders have corresponding receptor.
-	{
-		float view_matrix[ELEMENTS_PER_MATRIX];
-		Tx::toOpenGLMatrix( view_matrix, Camera );
-		glUniformMatrix4fv( view_location, 1, GL_FALSE, view_matrix );
-	}
-	
-	if( proj_location >= 0 )			// Send projection matrix only if shaders have corresponding receptor.
-	{
-		float proj_matrix[ELEMENTS_PER_MATRIX];
-		Tx::toOpenGLMatrix( proj_matrix, Projection );
-		glUniformMatrix4fv( proj_location, 1, GL_FALSE, proj_matrix );
-	}
+	selectVariant( ( ( usingBlinnPhong )? ShaderPermutations::BLINN_PHONG : 0u ) | ( ( usingTexture )? ShaderPermutations::TEXTURE : 0u ) );
+	updateFrameData( Projection, Camera );
 
-	if( usingBlinnPhong && itmv_location >= 0 )
+	Tx::toOpenGLMatrix( drawData.Model, Model );
+
+	if( usingBlinnPhong )
 	{
 		float itmv_matrix[9];
 		mat33 InvTransMV = Tx::getInvTransModelView( Camera * Model, usingUniformScaling );		// The inverse transpose of the upper left 3x3 matrix in the Model View matrix.
 		Tx::toOpenGLMatrix( itmv_matrix, InvTransMV );
-		glUniformMatrix3fv( itmv_location, 1, GL_FALSE, itmv_matrix );
+		for( int j = 0; j < VECTOR_SIZE_3D; j++ )													// Copy column by column into the padded layout.
+			memcpy( drawData.InvTransModelView[j], &itmv_matrix[VECTOR_SIZE_3D * j], VECTOR_SIZE_3D * sizeof( float ) );
 	}
 
-	// Specify if we will use phong lighting model.
-	int useBlinnPhong_location = glGetUniformLocation( renderingProgram, "useBlinnPhong" );
-	if( useBlinnPhong_location >= 0 )
-		glUniform1i( useBlinnPhong_location, usingBlinnPhong );
-
-	// Specify we are not drawing points.
-	int drawPoint_location = glGetUniformLocation( renderingProgram, "drawPoint" );
-	if( drawPoint_location >= 0 )
-		glUniform1i( drawPoint_location, false );
-	
-	// Specify if we'll use texture as diffuse component in fragment shader.
-	int useTexture_location = glGetUniformLocation( renderingProgram, "useTexture" );
-	if( useTexture_location != -1 )
-		glUniform1i( useTexture_location, usingTexture );
+	drawData.useBlinnPhong = usingBlinnPhong;			// Specify if we will use phong lighting model.
+	drawData.drawPoint = false;							// Specify we are not drawing points.
+	drawData.pointSize = 1.0f;
+	drawData.useTexture = usingTexture;					// Specify if we'll use texture as diffuse component in fragment shader.
+	drawData.useInstancing = usingInstancing;			// Specify if we'll read the model and normal matrices from instance attributes.
 
 	// Set up material shading.
-	int shininess_location = glGetUniformLocation( renderingProgram, "shininess" );
-	if( shininess_location >= 0 )
-		glUniform1f( shininess_location, material.shininess );
+	drawData.shininess = material.shininess;
+	Tx::toOpenGLMatrix( drawData.ambient, material.ambient );
+	Tx::toOpenGLMatrix( drawData.diffuse, material.diffuse );
+	Tx::toOpenGLMatrix( drawData.specular, material.specular );
+}
 
-	int ambient_location = glGetUniformLocation( renderingProgram, "ambient" );
-	int diffuse_location = glGetUniformLocation( renderingProgram, "diffuse" );
-	int specular_location = glGetUniformLocation( renderingProgram, "specular" );
-	
-	if( ambient_location >= 0 )
+/**
+ * Fill the per-draw data read by depth-only programs: the model transform only.  The material, the normal matrix, and
+ * the shading flags are left as they are, since nothing reads them.
+ * @param Projection 4x4 Projection matrix.
+ * @param Camera 4x4 View matrix.
+ * @param Model 4x4 Model matrix (identity for instanced draws).
+ * @param usingInstancing Whether instances carry their own model matrices.
+ */
+void OpenGL::sendDepthInformation( const mat44& Projection, const mat44& Camera, const mat44& Model, bool usingInstancing )
+{
+	updateFrameData( Projection, Camera );
+	Tx::toOpenGLMatrix( drawData.Model, Model );
+	drawData.useInstancing = usingInstancing;
+	drawData.drawPoint = false;
+	drawData.pointSize = 1.0f;
+}
+
+/**
+ * Send the frame uniform buffer if the projection or view matrices differ from the ones last sent, or if lights changed.
+ * The culling frustum follows the projection and view matrices.
+ * @param Projection 4x4 Projection matrix.
+ * @param View 4x4 View matrix.
+ */
+void OpenGL::updateFrameData( const mat44& Projection, const mat44& View )
+{
+	float proj_matrix[ELEMENTS_PER_MATRIX], view_matrix[ELEMENTS_PER_MATRIX];
+	Tx::toOpenGLMatrix( proj_matrix, Projection );
+	Tx::toOpenGLMatrix( view_matrix, View );
+	if( memcmp( proj_matrix, frameData.Projection, sizeof( proj_matrix ) ) != 0 || memcmp( view_matrix, frameData.View, sizeof( view_matrix ) ) != 0 )
 	{
-		float ambient_vector[HOMOGENEOUS_VECTOR_SIZE];
-		Tx::toOpenGLMatrix( ambient_vector, material.ambient );
-		glUniform4fv( ambient_location, 1, ambient_vector );
+		memcpy( frameData.Projection, proj_matrix, sizeof( proj_matrix ) );
+		memcpy( frameData.View, view_matrix, sizeof( view_matrix ) );
+		frameDataDirty = true;
+		frustum = Frustum( Projection * View );
 	}
 
-	if( diffuse_location >= 0 )
+	if( frameDataDirty )
 	{
-		float diffuse_vector[HOMOGENEOUS_VECTOR_SIZE];
-		Tx::toOpenGLMatrix( diffuse_vector, material.diffuse );
-		glUniform4fv( diffuse_location, 1, diffuse_vector );
+		glBindBuffer( GL_UNIFORM_BUFFER, frameDataBufferID );
+		glBufferData( GL_UNIFORM_BUFFER, sizeof( FrameData ), &frameData, GL_DYNAMIC_DRAW );		// Orphan, so that draws in flight keep the old data.
+		frameDataDirty = false;
 	}
-	
-	if( specular_location >= 0 )
+}
+
+/**
+ * Orphan the DrawData ring, so that this frame's draws fill fresh storage while the GPU may still read the last frame's.
+ * Call it once at the start of every frame.
+ */
+void OpenGL::beginFrame()
+{
+	glBindBuffer( GL_UNIFORM_BUFFER, drawDataBufferID );
+	glBufferData( GL_UNIFORM_BUFFER, drawDataStride * DRAW_DATA_SLOTS, nullptr, GL_STREAM_DRAW );
+	drawDataSlot = 0;
+}
+
+/**
+ * Copy the draw data into the next slot of the ring and bind that slot to the DrawData block.
+ * Slots are written once between orphanings (at the start of the frame, or when the ring fills up), so no draw in flight
+ * reads them and they are mapped without synchronizing with the GPU.
+ */
+void OpenGL::bindDrawData()
+{
+	if( drawDataSlot == DRAW_DATA_SLOTS )
+		beginFrame();
+
+	const GLintptr offset = drawDataStride * drawDataSlot++;
+	glBindBufferRange( GL_UNIFORM_BUFFER, ProgramReflection::DRAW_DATA, drawDataBufferID, offset, sizeof( DrawData ) );	// Also binds GL_UNIFORM_BUFFER.
+	void* slot = glMapBufferRange( GL_UNIFORM_BUFFER, offset, sizeof( DrawData ), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+	memcpy( slot, &drawData, sizeof( DrawData ) );
+	glUnmapBuffer( GL_UNIFORM_BUFFER );
+}
+
+/**
+ * Test whether an object is outside the view frustum of the current pass (or of all of its layers), and count it.
+ * @param Projection 4x4 Projection matrix.
+ * @param Camera 4x4 Camera matrix.
+ * @param bounds Model-space bounds of the object.
+ * @param Model 4x4 Model matrix.
+ * @return True if the object can be skipped.
+ */
+bool OpenGL::isOutsideFrustum( const mat44& Projection, const mat44& Camera, const BoundingVolume& bounds, const mat44& Model )
+{
+	if( !usingFrustumCulling )
+		return false;
+
+	updateFrameData( Projection, Camera );				// Make sure the frustum is the current pass's.
+	cullingStats.tested++;
+	for( int i = 0; i < getCullingFrustaCount(); i++ )
+		if( isCullingFrustumRendered( i ) && getCullingFrustum( i ).isVisible( bounds, Model ) )
+			return false;
+
+	cullingStats.culled++;
+	return true;
+}
+
+/**
+ * Number of view volumes of the current pass: one per shadow map layer in layered passes, otherwise one.
+ * @return Number of frusta an object must be outside of to be culled.
+ */
+int OpenGL::getCullingFrustaCount() const
+{
+	return ( frameData.layersCount > 0 )? frameData.layersCount : 1;
+}
+
+/**
+ * View volume of the current pass.
+ * @param i Index in [0, getCullingFrustaCount()).
+ * @return Frustum of the ith layer's light, or the regular frustum if the pass isn't layered.
+ */
+const Frustum& OpenGL::getCullingFrustum( int i ) const
+{
+	return ( frameData.layersCount > 0 )? lightFrusta[i] : frustum;
+}
+
+/**
+ * Check whether a view volume of the current pass is drawn into (see setShadowLayers).
+ * @param i Index in [0, getCullingFrustaCount()).
+ * @return False if the ith layer is masked out of a layered pass, so that nothing needs to be drawn for it.
+ */
+bool OpenGL::isCullingFrustumRendered( int i ) const
+{
+	return frameData.layersCount == 0 || ( frameData.layersMask[i / 32] & ( 1u << ( i % 32 ) ) );
+}
+
+/**
+ * Check the current material against the pass's material filter.
+ * @return True if draws with the current material should be skipped in this pass.
+ */
+bool OpenGL::isFilteredOut() const
+{
+	const bool translucent = material.ambient[3] < 1.0;
+	return ( materialFilter == OPAQUE_MATERIALS && translucent ) || ( materialFilter == TRANSLUCENT_MATERIALS && !translucent );
+}
+
+/**
+ * Grow the recorded world bounds by the box of a draw call.
+ * @param bounds Model-space bounds.
+ * @param Model The 4x4 model transformation matrix.
+ */
+void OpenGL::recordBounds( const BoundingVolume& bounds, const mat44& Model )
+{
+	for( int c = 0; c < 8; c++ )
 	{
-		float specular_vector[HOMOGENEOUS_VECTOR_SIZE];
-		Tx::toOpenGLMatrix( specular_vector, material.specular );
-		glUniform4fv( specular_location, 1, specular_vector );
+		vec4 corner = Model * vec4{ ( c & 1 )? bounds.boxMax[0] : bounds.boxMin[0],
+								   ( c & 2 )? bounds.boxMax[1] : bounds.boxMin[1],
+								   ( c & 4 )? bounds.boxMax[2] : bounds.boxMin[2], 1.0 };
+		recordedMin = arma::min( recordedMin, corner.head( 3 ) );
+		recordedMax = arma::max( recordedMax, corner.head( 3 ) );
 	}
 }
 
@@ -406,16 +597,21 @@ void OpenGL::sendShadingInformation( const mat44& Projection, const mat44& Camer
  * @param Camera The 4x4 camera matrix.
  * @param Model The 4x4 model transformation matrix.
  * @param vertices A vector of 3D vertices.
- * @return The position attribute location in shader, so that the pointer can be disabled in the caller.
  */
-GLint OpenGL::setSequenceInformation( const mat44& Projection, const mat44& Camera, const mat44& Model, const vector<vec3>& vertices )
+void OpenGL::setSequenceInformation( const mat44& Projection, const mat44& Camera, const mat44& Model, const vector<vec3>& vertices )
 {
-	if( path == nullptr )									// We haven't used this buffer before? Create it.
+	if( path == nullptr )									// We haven't used this buffer before? Create it with its (position only) layout.
 	{
 		path = new GeometryBuffer;
+		path->format = VertexFormat::create( VertexFormat::FLOAT_POSITIONS, false, false );
 		glGenBuffers( 1, &(path->bufferID) );
+		path->vertexArrayID = VertexArray::create( path->format, path->bufferID );
+	}
+	else
+	{
+		glBindVertexArray( path->vertexArrayID );			// Make path buffer the current one.
+		glBindBuffer( GL_ARRAY_BUFFER, path->bufferID );
 	}
-	glBindBuffer( GL_ARRAY_BUFFER, path->bufferID );		// Make path buffer the current one.
 
 	// Load vertices and (virtually no) normals.
 	path->verticesCount = static_cast<GLuint>( vertices.size() );
@@ -431,17 +627,8 @@ GLint OpenGL::setSequenceInformation( const mat44& Projection, const mat44& Came
 	const size_t size = sizeof(float) * totalElements;		// Size of arrays in bytes.
 	glBufferData( GL_ARRAY_BUFFER, size, vertexPositions, GL_DYNAMIC_DRAW );
 
-	// Set up our vertex attributes (no normals needed).
-	int position_location = glGetAttribLocation( renderingProgram, "position" );
-	if( position_location >= 0 )
-	{
-		glEnableVertexAttribArray( position_location );
-		glVertexAttribPointer( position_location, ELEMENTS_PER_VERTEX, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET( 0 ) );
-		
-		sendShadingInformation( Projection, Camera, Model, false );			// Without using phong model.
-	}
-
-	return position_location;
+	sendPositionDequantization( path->format );
+	sendShadingInformation( Projection, Camera, Model, false );			// Without using phong model.
 }
 
 /**
@@ -451,13 +638,30 @@ GLint OpenGL::setSequenceInformation( const mat44& Projection, const mat44& Came
  * @param Model The 4x4 model transformation matrix.
  * @param objectType Type of object to be rendered.
  * @param useTexture Whether or not use texture loaded for object.
- * @param textureUnit Which texture unit activate for sampling in shader.
  */
-void OpenGL::render3DObject( const mat44& Projection, const mat44& Camera, const mat44& Model, const char* objectType, bool useTexture, int textureUnit )
+void OpenGL::render3DObject( const mat44& Projection, const mat44& Camera, const mat44& Model, const char* objectType, bool useTexture )
 {
 	try
 	{
-		Object3D o = objectModels.at( string( objectType ) );	// Retrieve object.
+		const Object3D& o = objectModels.at( string( objectType ) );	// Retrieve object.
+		if( recordingBounds )
+		{
+			recordBounds( o.getBounds(), Model );
+			return;
+		}
+
+		if( isFilteredOut() || isOutsideFrustum( Projection, Camera, o.getBounds(), Model ) )
+			return;
+
+		if( depthOnly )						// Positions and transforms only.
+		{
+			glBindVertexArray( o.getDepthVertexArrayID() );
+			sendPositionDequantization( o.getVertexFormat() );
+			sendDepthInformation( Projection, Camera, Model );
+			bindDrawData();
+			glDrawElements( GL_TRIANGLES, o.getIndicesCount(), o.getIndexType(), BUFFER_OFFSET( 0 ) );
+			return;
+		}
 
 		if( material.ambient[3] < 1.0 )		// If alpha channel in current material color is not fully opaque, enable blending.
 		{
@@ -465,54 +669,155 @@ void OpenGL::render3DObject( const mat44& Projection, const mat44& Camera, const
 			glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
 		}
 
-		glBindBuffer( GL_ARRAY_BUFFER, o.getBufferID() );
+		glBindVertexArray( o.getVertexArrayID() );		// Vertex and element buffers with all of their attributes.
+
+		useTexture = useTexture && o.hasTexture();		// Do we want to render with texture instead of color?
+		sendPositionDequantization( o.getVertexFormat() );
+		sendShadingInformation( Projection, Camera, Model, true, useTexture );	// Indicate we are using texture if the above condition holds.
+		
+		if( useTexture )
+		{
+			// Enable texture rendering: programs sample the unit set once with setObjectTextureUnit().
+			glActiveTexture( GL_TEXTURE0 + objectTextureUnit );
+			glBindTexture( GL_TEXTURE_2D, o.getTextureID() );
+		}
+		
+		// Draw indexed triangles.
+		bindDrawData();
+		glDrawElements( GL_TRIANGLES, o.getIndicesCount(), o.getIndexType(), BUFFER_OFFSET( 0 ) );
+
+		if( material.ambient[3] < 1.0 )
+			glDisable( GL_BLEND );
+
+	}
+	catch( const out_of_range& oor )
+	{
+		cerr << "Attempting to render a nonexistent type of 3D object model!" << endl;
+	}
+}
+
+/**
+ * Render many copies of a 3D object model of a selected type with a single draw call.
+ * Instances outside the view frustum are dropped; the model matrices and their normal matrices (the inverse transpose
+ * of their 3x3 principal submatrices) of the rest are uploaded to the object's instance buffer, and the shaders read
+ * them per instance when useInstancing is on.
+ * @param Projection The 4x4 projection matrix.
+ * @param Camera The 4x4 camera matrix.
+ * @param models The 4x4 model transformation matrix of each instance.
+ * @param objectType Type of object to be rendered.
+ * @param useTexture Whether or not use texture loaded for object.
+ */
+void OpenGL::render3DObjectInstanced( const mat44& Projection, const mat44& Camera, const vector<mat44>& models, const char* objectType, bool useTexture )
+{
+	if( models.empty() || isFilteredOut() )
+		return;
+
+	try
+	{
+		const Object3D& o = objectModels.at( string( objectType ) );	// Retrieve object.
+		if( recordingBounds )
+		{
+			for( const mat44& M : models )
+				recordBounds( o.getBounds(), M );
+			return;
+		}
+
+		const size_t N = models.size();
 
-		// Set up our vertex (and texture) attributes.
-		GLint position_location = glGetAttribLocation( renderingProgram, "position" );
-		GLint normal_location = glGetAttribLocation( renderingProgram, "normal" );
-		GLint texCoords_location = glGetAttribLocation( renderingProgram, "texCoords" );
-		if( position_location != -1 )		// Need to have at least the vertices positions to render.
+		// Test the instances' bounding spheres against the frustum in one batch.
+		cullingVisibility.assign( N, !usingFrustumCulling );
+		if( usingFrustumCulling )
 		{
-			glEnableVertexAttribArray( position_location );
-			glVertexAttribPointer( position_location, ELEMENTS_PER_VERTEX, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET( 0 ) );
-			
-			size_t offset = sizeof(float) * o.getVerticesCount() * ELEMENTS_PER_VERTEX;
-			
-			if( normal_location != -1 )		// Do we need normals?
+			updateFrameData( Projection, Camera );					// Make sure the frustum is the current pass's.
+			cullingSpheres.resize( 4 * N );
+			float* x = &cullingSpheres[0];
+			float* y = x + N;
+			float* z = y + N;
+			float* r = z + N;
+			for( size_t i = 0; i < N; i++ )
 			{
-				glEnableVertexAttribArray( normal_location );
-				glVertexAttribPointer( normal_location, ELEMENTS_PER_VERTEX, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET( offset ) );
+				float center[3];
+				Frustum::transformSphere( o.getBounds(), models[i], center, r[i] );
+				x[i] = center[0];
+				y[i] = center[1];
+				z[i] = center[2];
 			}
-			
-			if( texCoords_location != -1 && useTexture && o.hasTexture() )			// Do we want to render with texture instead of color?
+			cullingLayerVisibility.resize( N );
+			for( int l = 0; l < getCullingFrustaCount(); l++ )		// Layered passes keep instances inside any of the rendered layers.
 			{
-				glEnableVertexAttribArray( texCoords_location );
-				glVertexAttribPointer( texCoords_location, TEX_ELEMENTS_PER_VERTEX, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET( offset * 2 ) );
-				
-				// Enable texture rendering.
-				glActiveTexture( GL_TEXTURE0 + textureUnit );												// Recall for objects we assigned texture unit after all lights.
-				glBindTexture( GL_TEXTURE_2D, o.getTextureID() );
-				glUniform1i( glGetUniformLocation( renderingProgram, "objectTexture" ), textureUnit );		// And tell OpenGL so.
+				if( !isCullingFrustumRendered( l ) )
+					continue;
+				getCullingFrustum( l ).cullSpheres( x, y, z, r, N, cullingLayerVisibility.data() );
+				for( size_t i = 0; i < N; i++ )
+					cullingVisibility[i] |= cullingLayerVisibility[i];
 			}
-			else
-				useTexture = false;
-			
-			sendShadingInformation( Projection, Camera, Model, true, useTexture );	// Indicate we are using texture if the above condition holds.
-			
-			// Draw triangles.
-			glDrawArrays( GL_TRIANGLES, 0, o.getVerticesCount() );
-			
-			// Disable attribute arrays for position and normals.
-			glDisableVertexAttribArray( position_location );
-			if( normal_location != -1 )
-				glDisableVertexAttribArray( normal_location );
-			if( texCoords_location != -1 )
-				glDisableVertexAttribArray( texCoords_location );
 		}
 
+		// Gather the per-instance matrices of visible instances (whose boxes also intersect the frustum) in column-major order.
+		instanceData.resize( VertexArray::INSTANCE_ELEMENTS * N );
+		size_t instancesCount = 0;
+		for( size_t i = 0; i < N; i++ )
+		{
+			if( !cullingVisibility[i] )
+				continue;
+			bool insideBox = !usingFrustumCulling;
+			for( int l = 0; l < getCullingFrustaCount() && !insideBox; l++ )
+				insideBox = isCullingFrustumRendered( l ) && getCullingFrustum( l ).intersectsBox( o.getBounds(), models[i] );
+			if( !insideBox )
+				continue;
+			GLfloat* instance = &instanceData[VertexArray::INSTANCE_ELEMENTS * instancesCount++];
+			Tx::toOpenGLMatrix( instance, models[i] );
+			if( !depthOnly )												// Depth-only passes don't read normals.
+				Tx::toOpenGLMatrix( instance + ELEMENTS_PER_MATRIX, Tx::getInvTransModelView( models[i], usingUniformScaling ) );
+		}
+		instanceData.resize( VertexArray::INSTANCE_ELEMENTS * instancesCount );
+
+		if( usingFrustumCulling )
+		{
+			cullingStats.tested += N;
+			cullingStats.culled += N - instancesCount;
+		}
+		if( instancesCount == 0 )
+			return;
+
+		// Vertex (or positions only), element, and instance buffers with all of their attributes.
+		glBindVertexArray( ( depthOnly )? o.getDepthVertexArrayID() : o.getVertexArrayID() );
+		glBindBuffer( GL_ARRAY_BUFFER, o.getInstanceBufferID() );
+		glBufferData( GL_ARRAY_BUFFER, instanceData.size() * sizeof( GLfloat ), instanceData.data(), GL_STREAM_DRAW );
+
+		const mat44 Identity = eye< mat >( 4, 4 );
+		if( depthOnly )						// Positions and transforms only.
+		{
+			sendPositionDequantization( o.getVertexFormat() );
+			sendDepthInformation( Projection, Camera, Identity, true );
+			bindDrawData();
+			glDrawElementsInstanced( GL_TRIANGLES, o.getIndicesCount(), o.getIndexType(), BUFFER_OFFSET( 0 ), static_cast<GLsizei>( instancesCount ) );
+			return;
+		}
+
+		if( material.ambient[3] < 1.0 )		// If alpha channel in current material color is not fully opaque, enable blending.
+		{
+			glEnable( GL_BLEND );
+			glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+		}
+
+		useTexture = useTexture && o.hasTexture();		// Do we want to render with texture instead of color?
+		sendPositionDequantization( o.getVertexFormat() );
+		sendShadingInformation( Projection, Camera, Identity, true, useTexture, true );		// Instances carry their own model matrices.
+
+		if( useTexture )
+		{
+			// Enable texture rendering: programs sample the unit set once with setObjectTextureUnit().
+			glActiveTexture( GL_TEXTURE0 + objectTextureUnit );
+			glBindTexture( GL_TEXTURE_2D, o.getTextureID() );
+		}
+
+		// Draw all instances of the indexed triangles.
+		bindDrawData();
+		glDrawElementsInstanced( GL_TRIANGLES, o.getIndicesCount(), o.getIndexType(), BUFFER_OFFSET( 0 ), static_cast<GLsizei>( instancesCount ) );
+
 		if( material.ambient[3] < 1.0 )
 			glDisable( GL_BLEND );
-
 	}
 	catch( const out_of_range& oor )
 	{
@@ -542,6 +847,7 @@ void OpenGL::renderText( const char* text, const Atlas* a, float x, float y, flo
 	glUniform1i( a->uniform_tex_loc, 0 );			// We are using here the unit 0 for the text sampler.
 
 	// Set up the VBO for our vertex data.
+	glBindVertexArray( vao );
 	glEnableVertexAttribArray( a->attribute_coord_loc );
 	glBindBuffer( GL_ARRAY_BUFFER, glyphsBufferID );
 	glVertexAttribPointer( a->attribute_coord_loc, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
@@ -615,11 +921,13 @@ void OpenGL::create3DObject( const char* name, const char* filename, const char*
 	auto it = objectModels.find( sName );
 	if( it != objectModels.end() )					// Element found?
 	{
-		Object3D o = it->second;
+		const Object3D& o = it->second;
 		cout << "WARNING!  You are attempting to create a new type of 3D object with an existing name.  The old one will be replaced!" << endl;
-		GLuint bufferID = o.getBufferID();
+		GLuint bufferIDs[4] = { o.getBufferID(), o.getIndexBufferID(), o.getInstanceBufferID(), o.getDepthBufferID() };
+		GLuint vertexArrayIDs[2] = { o.getVertexArrayID(), o.getDepthVertexArrayID() };
 		GLuint textureID = o.getTextureID();
-		glDeleteBuffers( 1, &bufferID );			// Empty buffer and texture.
+		glDeleteVertexArrays( 2, vertexArrayIDs );	// Empty vertex arrays, buffers, and texture.
+		glDeleteBuffers( 4, bufferIDs );
 		if( o.hasTexture() && glIsTexture( textureID ) )
 			glDeleteTextures( 1, &textureID );
 	}
@@ -633,56 +941,201 @@ void OpenGL::create3DObject( const char* name, const char* filename, const char*
  * @param program OpenGL program ID.
  */
 void OpenGL::useProgram( GLuint program )
+{
+	permutations = nullptr;
+	bindProgram( program );
+}
+
+/**
+ * Render with the variants of a permuted program: every draw selects, as the rendering program, the variant compiled
+ * for its features.  Nothing is bound until the next draw.
+ * @param p Program variants (kept by the caller).
+ */
+void OpenGL::usePermutations( ShaderPermutations* p )
+{
+	permutations = p;
+	renderingProgram = 0;				// The caller may have used other programs since the last draw.
+}
+
+/**
+ * Make a program the rendering program, and bind it.
+ * @param program OpenGL program ID.
+ */
+void OpenGL::bindProgram( GLuint program )
 {
 	renderingProgram = program;
+	reflection = &ProgramReflection::get( program );		// Located once, when the program was compiled.
+	if( reflection->blockSize( ProgramReflection::FRAME_DATA ) > static_cast<GLint>( sizeof( FrameData ) ) ||
+		reflection->blockSize( ProgramReflection::DRAW_DATA ) > static_cast<GLint>( sizeof( DrawData ) ) )
+		cerr << "WARNING! The uniform blocks of program " << program << " are larger than the data the renderer sends" << endl;
 	glUseProgram( renderingProgram );
 }
 
 /**
- * Set and send the lighting properties to shaders attached to current rendering program.
+ * Bind the variant of the permuted program (if any is in use) for the features of the next draw.  Textures are read
+ * only with Blinn-Phong shading, so that flag alone never picks a variant of its own.
+ * @param features Mask of ShaderPermutations::Feature bits.
+ */
+void OpenGL::selectVariant( unsigned features )
+{
+	if( !permutations )
+		return;
+
+	if( !( features & ShaderPermutations::BLINN_PHONG ) )
+		features &= ~static_cast<unsigned>( ShaderPermutations::TEXTURE );
+	GLuint program = permutations->get( features );
+	if( program != renderingProgram )
+		bindProgram( program );
+}
+
+/**
+ * Enable or disable frustum culling of geoms and 3D object models.
+ * @param u True to skip objects outside the view frustum.
+ */
+void OpenGL::setUsingFrustumCulling( bool u )
+{
+	usingFrustumCulling = u;
+}
+
+/**
+ * Render the following geometry into several layers of the bound framebuffer at once: the geometry shader fans each
+ * triangle out to layer i with LightSpaceMatrices[i], which setLighting sets for each cascade of each light.  Objects are
+ * culled only if they are outside all of the cascades' frusta.  Paths and points are drawn with the layered programs
+ * given to setLayeredSequencePrograms().
+ * @param layers Number of layers (lights times cascades), or 0 to go back to single-view rendering.
+ * @param mask Layers to render among those (bit l for layer l), e.g. the stale layers of the static shadow cache.
+ */
+void OpenGL::setShadowLayers( int layers, uint64_t mask )
+{
+	frameData.layersCount = min( max( layers, 0 ), static_cast<int>( SHADOW_LAYERS ) );
+	frameData.layersMask[0] = static_cast<GLuint>( mask );
+	frameData.layersMask[1] = static_cast<GLuint>( mask >> 32 );
+	frameDataDirty = true;
+}
+
+/**
+ * Set how many lights the shaders loop over: units 0 to count - 1, each set up with setLighting().  Shading cost follows
+ * the lights in use rather than FRAME_LIGHTS.
+ * @param count Number of lights, up to FRAME_LIGHTS.
+ */
+void OpenGL::setLightsCount( int count )
+{
+	frameData.lightsCount = min( max( count, 0 ), static_cast<int>( FRAME_LIGHTS ) );
+	frameDataDirty = true;
+}
+
+/**
+ * Set the view depths where the lights' cascades end, so that the shaders can pick a cascade per fragment.  Every light
+ * must have been set up with as many cascades.
+ * @param splits View depths where the cascades begin and end, as given by Light::splitCascades().
+ */
+void OpenGL::setShadowCascades( const vector<double>& splits )
+{
+	frameData.cascadesCount = min( max( static_cast<int>( splits.size() ) - 1, 1 ), static_cast<int>( Light::MAX_CASCADES ) );
+	for( int c = 0; c < Light::MAX_CASCADES; c++ )
+		frameData.cascadeSplits[c] = static_cast<float>( ( c + 1 < static_cast<int>( splits.size() ) )? splits[c + 1] : splits.back() );
+	frameDataDirty = true;
+}
+
+/**
+ * Get the number of objects tested against the frustum, and culled, since the counters were last reset.
+ * @return Culling counters.
+ */
+const OpenGL::CullingStats& OpenGL::getCullingStats() const
+{
+	return cullingStats;
+}
+
+/**
+ * Reset the culling counters (e.g. at the start of a rendering pass).
+ */
+void OpenGL::resetCullingStats()
+{
+	cullingStats = { 0, 0 };
+}
+
+/**
+ * Start recording: instead of drawing, the following draw calls of geoms and 3D object models only accumulate their world
+ * bounding box (paths and points are skipped).  The scene can be "rendered" this way to fit the lights' projections.
+ */
+void OpenGL::beginBoundsRecording()
+{
+	recordingBounds = true;
+	recordedMin.fill( numeric_limits<double>::max() );
+	recordedMax.fill( -numeric_limits<double>::max() );
+}
+
+/**
+ * Stop recording and get the bounds of the draw calls since beginBoundsRecording().
+ * @return World-space box (and sphere) around everything that was "drawn", or an empty box at the origin if nothing was.
+ */
+BoundingVolume OpenGL::endBoundsRecording()
+{
+	recordingBounds = false;
+	if( recordedMin[0] > recordedMax[0] )
+		recordedMin = recordedMax = zeros<vec>( 3 );
+
+	const float boxMin[3] = { static_cast<float>( recordedMin[0] ), static_cast<float>( recordedMin[1] ), static_cast<float>( recordedMin[2] ) };
+	const float boxMax[3] = { static_cast<float>( recordedMax[0] ), static_cast<float>( recordedMax[1] ), static_cast<float>( recordedMax[2] ) };
+	return BoundingVolume::fromBox( boxMin, boxMax );
+}
+
+/**
+ * Restrict the following draw calls to opaque or to translucent materials, so that a pass can render either group alone
+ * (e.g. a depth pre-pass of opaque geometry, with translucent geometry blended afterwards).
+ * @param f Materials to draw.
+ */
+void OpenGL::setMaterialFilter( MaterialFilter f )
+{
+	materialFilter = f;
+}
+
+/**
+ * Enable or disable the depth-only mode for passes that write depth alone (shadow maps, depth pre-pass): geoms and 3D
+ * object models are drawn from their positions only streams, and only their transforms are sent, with no material,
+ * normal matrices, textures, or blending.
+ * @param d True to draw depth only.
+ */
+void OpenGL::setDepthOnly( bool d )
+{
+	depthOnly = d;
+}
+
+/**
+ * Set the lighting properties of a light's unit in the frame data read by the shaders attached to current rendering
+ * program: its position and color, and the light space matrix and box of each of its cascades (shadow map layers).
+ * They are sent along with the next draw.
  * @param light Light object.
  * @param View The 4x4 view transformation matrix (usually the camera matrix).
- * @param useUnitSuffix Wheter attach light index as suffix to shader uniform variables.
  */
-void OpenGL::setLighting( const Light& light, const mat44& View, bool useUnitSuffix )
+void OpenGL::setLighting( const Light& light, const mat44& View )
 {
-	string lightSpaceMatrixStr = "LightSpaceMatrix";
-	string lightPositionStr = "lightPosition";
-	string lightColorStr = "lightColor";
-	
-	if( useUnitSuffix )		// Does the shader have light names with suffix corresponding to unit?
+	const int unit = light.getUnit(), cascades = light.getCascadesCount();
+	if( unit < 0 || unit >= FRAME_LIGHTS || ( unit + 1 ) * cascades > SHADOW_LAYERS )
 	{
-		lightSpaceMatrixStr += to_string( light.getUnit() );
-		lightPositionStr += to_string( light.getUnit() );
-		lightColorStr += to_string( light.getUnit() );
-	}
-	
-	// Send light space matrix transform if shaders have corresponding receptor.
-	int lsm_location = glGetUniformLocation( renderingProgram, lightSpaceMatrixStr.c_str() );
-	if( lsm_location >= 0 )
-	{
-		float lsm_matrix[ELEMENTS_PER_MATRIX];
-		Tx::toOpenGLMatrix( lsm_matrix, light.SpaceMatrix );
-		glUniformMatrix4fv( lsm_location, 1, GL_FALSE, lsm_matrix );
-	}
-	
-	// Light position.
-	int lightSource_location = glGetUniformLocation( renderingProgram, lightPositionStr.c_str() );
-	if( lightSource_location >= 0 )
-	{
-		float ls_vector[HOMOGENEOUS_VECTOR_SIZE];
-		Tx::toOpenGLMatrix( ls_vector, View * vec4{ light.position[0], light.position[1], light.position[2], 1.0 } );		// We must send the light position in view coordinates.
-		glUniform4fv( lightSource_location, 1, ls_vector );
+		cerr << "Light unit " << unit << " doesn't fit in the frame data!" << endl;
+		return;
 	}
+
+	Tx::toOpenGLMatrix( frameData.lightPositions[unit], View * vec4{ light.position[0], light.position[1], light.position[2], 1.0 } );	// We must send the light position in view coordinates.
+	Tx::toOpenGLMatrix( frameData.lightColors[unit], light.color );
+	frameData.shadowTechniques[unit] = light.getShadowTechnique();
 	
-	// Light color.
-	int lightColor_location = glGetUniformLocation( renderingProgram, lightColorStr.c_str() );
-	if( lightColor_location >= 0 )
+	for( int c = 0; c < cascades; c++ )
 	{
-		float lightColor_vector[VECTOR_SIZE_3D];
-		Tx::toOpenGLMatrix( lightColor_vector, light.color );
-		glUniform3fv( lightColor_location, 1, lightColor_vector );
+		const int layer = unit * cascades + c;
+		const mat44& P = light.Projections[c];
+		Tx::toOpenGLMatrix( frameData.LightSpaceMatrices[layer], light.SpaceMatrices[c] );
+		lightFrusta[layer] = Frustum( light.SpaceMatrices[c] );
+		
+		// The shaders convert depths and UVs of the fitted frustum into the ones PCSS was tuned for: read them off the matrix.
+		const double depthRange = -2.0 / P( 2, 2 );											// far - near.
+		frameData.lightBoxes[layer][0] = static_cast<float>( 2.0 / P( 0, 0 ) );				// right - left.
+		frameData.lightBoxes[layer][1] = static_cast<float>( 2.0 / P( 1, 1 ) );				// top - bottom.
+		frameData.lightBoxes[layer][2] = static_cast<float>( ( -P( 2, 3 ) - 1.0 ) * depthRange / 2.0 );	// near.
+		frameData.lightBoxes[layer][3] = static_cast<float>( frameData.lightBoxes[layer][2] + depthRange );	// far.
 	}
+	frameDataDirty = true;
 }
 
 
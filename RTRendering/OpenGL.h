@@ -14,10 +14,12 @@
 #include <vector>
 #include <map>
 #include "Shaders.h"
+#include "ShaderPermutations.h"
 #include "OpenGLGeometry.h"
 #include "Atlas.h"
 #include "Object3D.h"
 #include "Light.h"
+#include "Frustum.h"
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -53,12 +55,22 @@ private:
 	struct GeometryBuffer
 	{
 		GLuint bufferID;						// Buffer ID given by OpenGL.
+		GLuint vertexArrayID;					// Vertex array object with the buffer's attribute layout.
 		GLuint verticesCount;					// Number of vertices stored in buffer.
+		VertexFormat format;					// Layout of the interleaved vertices.
+		BoundingVolume bounds;					// Model-space bounds for frustum culling.
+		GLuint depthBufferID;					// Positions only, for depth-only passes.
+		GLuint depthVertexArrayID;
 	};
 	enum GeometryTypes { CUBE, SPHERE, CYLINDER, PRISM };
 	
 	GLuint renderingProgram;					// Geom/sequence full color renderer's shader program.
-	GLuint vao;									// Vertex array object.
+	const ProgramReflection* reflection = nullptr;	// Uniform locations of the rendering program.
+	ShaderPermutations* permutations = nullptr;	// If set, every draw selects its variant as the rendering program.
+	GLuint layeredLinesProgram = 0;				// Programs that cast the shadows of paths and points in layered passes.
+	GLuint layeredPointsProgram = 0;
+	GLint objectTextureUnit = 1;				// Texture unit that 3D object models' textures are bound to.
+	GLuint vao;									// Vertex array object for glyphs (geoms and 3D objects have their own).
 	
 	GeometryBuffer* cube = nullptr;				// Buffers for solids.
 	GeometryBuffer* sphere = nullptr;
@@ -69,6 +81,94 @@ private:
 	bool usingUniformScaling = true;			// True if only uniform scaling is used.
 
 	map<string, Object3D> objectModels;			// Store 3D object models per kind.
+	vector<GLfloat> instanceData;				// Staging area for per-instance matrices (reused across instanced draws).
+
+	////////////////////////////////////////////// Uniform buffer variables ////////////////////////////////////////////
+
+public:
+	static const int FRAME_LIGHTS = 16;			// Most lights in the FrameData block (units 0 to FRAME_LIGHTS - 1).
+	static const int SHADOW_LAYERS = FRAME_LIGHTS * Light::MAX_CASCADES;	// Shadow map layers (light unit * cascades + cascade).
+	static const vector<unsigned> DRAW_FEATURES;	// ShaderPermutations feature masks that the draw calls select.
+
+private:
+	static const GLuint DRAW_DATA_SLOTS = 4096;	// Draws that fit in the DrawData ring (orphaned every frame, or when full).
+
+	struct FrameData							// Mirror of the std140 FrameData block (framedata.glsl): sent once per pass.
+	{
+		GLfloat View[ELEMENTS_PER_MATRIX];
+		GLfloat Projection[ELEMENTS_PER_MATRIX];
+		GLfloat LightSpaceMatrices[SHADOW_LAYERS][ELEMENTS_PER_MATRIX];		// One per shadow map layer (light cascade).
+		GLfloat lightPositions[FRAME_LIGHTS][HOMOGENEOUS_VECTOR_SIZE];		// In view coordinates.
+		GLfloat lightColors[FRAME_LIGHTS][HOMOGENEOUS_VECTOR_SIZE];			// RGB padded to a vec4.
+		GLfloat lightBoxes[SHADOW_LAYERS][HOMOGENEOUS_VECTOR_SIZE];			// Width, height, near, and far of each orthographic projection.
+		GLfloat cascadeSplits[Light::MAX_CASCADES];								// View depth where each cascade ends (a vec4).
+		GLint shadowTechniques[FRAME_LIGHTS];									// Light::ShadowTechnique per unit (ivec4s of four units).
+		GLuint layersMask[2];													// Layers in use among those: bit l % 32 of entry l / 32.
+		GLint layersCount;														// Shadow map layers geometry is fanned out to.
+		GLint cascadesCount;													// Cascades per light.
+		GLint lightsCount;														// Units in use; the shaders loop over them.
+		GLint padding[3];
+	};
+
+	struct DrawData								// Mirror of the std140 DrawData block (drawdata.glsl): sent once per draw.
+	{
+		GLfloat Model[ELEMENTS_PER_MATRIX];
+		GLfloat InvTransModelView[VECTOR_SIZE_3D][HOMOGENEOUS_VECTOR_SIZE];	// std140 pads each mat3 column to a vec4.
+		GLfloat ambient[HOMOGENEOUS_VECTOR_SIZE];
+		GLfloat diffuse[HOMOGENEOUS_VECTOR_SIZE];
+		GLfloat specular[HOMOGENEOUS_VECTOR_SIZE];
+		GLfloat positionScale[VECTOR_SIZE_3D];
+		GLfloat shininess;														// Packed after the vec3, as std140 does.
+		GLfloat positionOffset[VECTOR_SIZE_3D];
+		GLfloat pointSize;
+		GLint useBlinnPhong;													// GLSL bools are 4 bytes in std140.
+		GLint useTexture;
+		GLint useInstancing;
+		GLint drawPoint;
+	};
+
+	FrameData frameData;						// Current pass data, and whether it changed since it was last sent.
+	bool frameDataDirty = true;
+	GLuint frameDataBufferID;
+
+	DrawData drawData;							// Data for the next draw call.
+	GLuint drawDataBufferID;					// Ring of DRAW_DATA_SLOTS blocks, each bound with glBindBufferRange.
+	GLintptr drawDataStride;					// Bytes between slots (sizeof( DrawData ) rounded up to the offset alignment).
+	GLuint drawDataSlot = 0;					// Next free slot.
+
+	///////////////////////////////////////////////// Culling variables ////////////////////////////////////////////////
+
+public:
+	struct CullingStats
+	{
+		size_t tested;							// Objects (or instances) tested against the frustum.
+		size_t culled;							// Those that were outside and weren't drawn.
+	};
+
+private:
+	Frustum frustum;							// View volume of the current pass (rebuilt with the frame data).
+	Frustum lightFrusta[SHADOW_LAYERS];			// View volumes of the lights' cascades, used instead in layered passes.
+	bool usingFrustumCulling = true;
+	CullingStats cullingStats = { 0, 0 };
+	vector<float> cullingSpheres;				// Staging area for instance bounding spheres: x's, y's, z's, and radii.
+	vector<uint8_t> cullingVisibility;
+	vector<uint8_t> cullingLayerVisibility;
+
+	//////////////////////////////////////////////// Pass filter variables /////////////////////////////////////////////
+
+public:
+	enum MaterialFilter							// Which materials the draw calls of the current pass render.
+	{
+		ALL_MATERIALS,
+		OPAQUE_MATERIALS,						// Fully opaque materials only (alpha = 1).
+		TRANSLUCENT_MATERIALS					// Blended materials only (alpha < 1).
+	};
+
+private:
+	MaterialFilter materialFilter = ALL_MATERIALS;
+	bool depthOnly = false;						// Draw positions only, without material, normals, textures, or blending?
+	bool recordingBounds = false;				// Accumulate the world bounds of draw calls instead of drawing?
+	vec3 recordedMin, recordedMax;				// World bounds recorded so far.
 	
 	/////////////////////////////////////////////// FreeType variables /////////////////////////////////////////////////
 
@@ -85,9 +185,22 @@ private:
 	GLuint glyphsProgram;						// Glyphs shaders program.
 	GLuint glyphsBufferID;						// Glyphs buffer ID.
 
-	void sendShadingInformation( const mat44& Projection, const mat44& Camera, const mat44& Model, bool usingBlinnPhong, bool usingTexture = false );
-	GLint setSequenceInformation( const mat44& Projection, const mat44& Camera, const mat44& Model, const vector<vec3>& vertices );
+	void sendShadingInformation( const mat44& Projection, const mat44& Camera, const mat44& Model, bool usingBlinnPhong, bool usingTexture = false, bool usingInstancing = false );
+	void setSequenceInformation( const mat44& Projection, const mat44& Camera, const mat44& Model, const vector<vec3>& vertices );
 	void drawGeom( const mat44& Projection, const mat44& Camera, const mat44& Model, GeometryBuffer** G, GeometryTypes t );
+	void sendPositionDequantization( const VertexFormat& format );
+	void sendDepthInformation( const mat44& Projection, const mat44& Camera, const mat44& Model, bool usingInstancing = false );
+	void updateFrameData( const mat44& Projection, const mat44& View );
+	void bindProgram( GLuint program );
+	void drawLayeredSequence( GLenum mode );
+	void selectVariant( unsigned features );
+	void bindDrawData();
+	bool isOutsideFrustum( const mat44& Projection, const mat44& Camera, const BoundingVolume& bounds, const mat44& Model );
+	int getCullingFrustaCount() const;
+	const Frustum& getCullingFrustum( int i ) const;
+	bool isCullingFrustumRendered( int i ) const;
+	bool isFilteredOut() const;
+	void recordBounds( const BoundingVolume& bounds, const mat44& Model );
 	void initGlyphs();
 
 public:
@@ -105,13 +218,28 @@ public:
 	void drawPrism( const mat44& Projection, const mat44& Camera, const mat44& Model );
 	void drawPath( const mat44& Projection, const mat44& Camera, const mat44& Model, const vector<vec3>& vertices );
 	void drawPoints( const mat44& Projection, const mat44& Camera, const mat44& Model, const vector<vec3>& vertices, float size = 10.0f );
-	void render3DObject( const mat44& Projection, const mat44& Camera, const mat44& Model, const char* objectType, bool useTexture = false, int textureUnit = 1 );
+	void render3DObject( const mat44& Projection, const mat44& Camera, const mat44& Model, const char* objectType, bool useTexture = false );
+	void render3DObjectInstanced( const mat44& Projection, const mat44& Camera, const vector<mat44>& models, const char* objectType, bool useTexture = false );
 	void renderText( const char* text, const Atlas* a, float x, float y, float sx, float sy, const float* color );
 	GLuint getGlyphsProgram();
 	void setUsingUniformScaling( bool u );
 	void create3DObject( const char* name, const char* filename, const char* textureFilename = nullptr );
 	void useProgram( GLuint program );
-	void setLighting( const Light& light, const mat44& View, bool useUnitSuffix = false );
+	void usePermutations( ShaderPermutations* p );
+	void setLayeredSequencePrograms( GLuint linesProgram, GLuint pointsProgram );
+	void setObjectTextureUnit( GLint unit );
+	void setLighting( const Light& light, const mat44& View );
+	void setUsingFrustumCulling( bool u );
+	void setShadowLayers( int layers, uint64_t mask = ~0ull );
+	void setShadowCascades( const vector<double>& splits );
+	void setLightsCount( int count );
+	const CullingStats& getCullingStats() const;
+	void resetCullingStats();
+	void beginFrame();
+	void setMaterialFilter( MaterialFilter f );
+	void setDepthOnly( bool d );
+	void beginBoundsRecording();
+	BoundingVolume endBoundsRecording();
 };
 
 #endif /* OpenGL_h */
@@ -24,28 +24,41 @@ void OpenGLGeometry::registerTriangle( const vec3& a, const vec3& b, const vec3&
 }
 
 /**
- * Get all vertices coordinates and normals.
- * @param vertices[out] An empty vector to allocate the x, y, and z vertices information.
- * @param normals[out] An empty vector to allocate the x, y, and z normals information.
+ * Get all vertices coordinates and normals as an interleaved stream.
+ * @param vertices[out] An empty vector to allocate the interleaved vertices, as laid out by format.
+ * @param format[out] Vertex layout (positions and normals), with positions quantized over the geometry's bounds if requested.
+ * @param bounds[out] Bounding box and sphere of the geometry.
+ * @param encoding How to store vertex positions.
  * @return Number of 3D points/vertices that were processed.
  */
-unsigned int OpenGLGeometry::getData( vector<float>& vertices, vector<float>& normals ) const
+unsigned int OpenGLGeometry::getData( vector<uint8_t>& vertices, VertexFormat& format, BoundingVolume& bounds, VertexFormat::PositionEncoding encoding ) const
 {
 	size_t N = points.size();
+	vector<float> positions;
+	vector<float> normals;
+	float boundsMin[3] = { 0, 0, 0 }, boundsMax[3] = { 0, 0, 0 };
 	
 	for( int i = 0; i < N; i++ )
 	{
-		// Vertices.
-		vertices.push_back( points[i][0] );			// X-coordinate.
-		vertices.push_back( points[i][1] );			// Y-coordinate.
-		vertices.push_back( points[i][2] );			// Z-coordinate.
+		for( int j = 0; j < 3; j++ )
+		{
+			positions.push_back( points[i][j] );						// X, Y, and Z-coordinates.
+			normals.push_back( this->normals[i][j] );
+			boundsMin[j] = ( i == 0 )? positions.back() : fmin( boundsMin[j], positions.back() );
+			boundsMax[j] = ( i == 0 )? positions.back() : fmax( boundsMax[j], positions.back() );
+		}
 		
-		// Normals.
-		normals.push_back( this->normals[i][0] );	// X-coordinate.
-		normals.push_back( this->normals[i][1] );	// Y-coordinate.
-		normals.push_back( this->normals[i][2] );	// Z-coordinate.
+		// Not all geometries produce unit normals.
+		float length = sqrt( normals[3*i] * normals[3*i] + normals[3*i+1] * normals[3*i+1] + normals[3*i+2] * normals[3*i+2] );
+		for( int j = 0; j < 3 && length > 0; j++ )
+			normals[3*i + j] /= length;
 	}
 	
+	bounds = BoundingVolume::fromBox( boundsMin, boundsMax );
+	format = VertexFormat::create( encoding, true, false, boundsMin, boundsMax );
+	vertices.resize( N * format.stride );
+	format.encode( N, positions.data(), normals.data(), nullptr, vertices.data() );
+	
 	return static_cast<unsigned int>(N);
 }
 
@@ -4,6 +4,8 @@
 #include <vector>
 #include <armadillo>
 #include "Transformations.h"
+#include "VertexFormat.h"
+#include "Frustum.h"
 
 using namespace std;
 using namespace arma;
@@ -19,7 +21,7 @@ private:
 	
 public:
 	
-	unsigned int getData( vector<float>& vertices, vector<float>& normals ) const;
+	unsigned int getData( vector<uint8_t>& vertices, VertexFormat& format, BoundingVolume& bounds, VertexFormat::PositionEncoding encoding ) const;
 	void createCube( double side = 1.0 );
 	void createSphere( int n = 6 );
 	void createCylinder( double radius = 1.0, double length = 1.0 );
@@ -0,0 +1,79 @@
+#include "PassTimers.h"
+
+/**
+ * Create the queries.
+ */
+void PassTimers::init()
+{
+	for( int p = 0; p < PASSES_COUNT; p++ )
+	{
+		glGenQueries( FRAMES, queries[p] );
+		for( int f = 0; f < FRAMES; f++ )
+			issued[p][f] = false;
+		milliseconds[p] = 0;
+	}
+	frame = 0;
+}
+
+/**
+ * Start timing a pass in the current frame.
+ * @param pass Pass about to be rendered.
+ */
+void PassTimers::begin( Pass pass )
+{
+	glBeginQuery( GL_TIME_ELAPSED, queries[pass][frame] );
+	issued[pass][frame] = true;
+}
+
+/**
+ * Stop timing the pass that was begun last.
+ */
+void PassTimers::end()
+{
+	glEndQuery( GL_TIME_ELAPSED );
+}
+
+/**
+ * Move on to the next frame: collect the results of the oldest frame in the rings, whose queries are reused next.
+ */
+void PassTimers::nextFrame()
+{
+	frame = ( frame + 1 ) % FRAMES;
+	for( int p = 0; p < PASSES_COUNT; p++ )
+	{
+		if( !issued[p][frame] )
+		{
+			milliseconds[p] = 0;
+			continue;
+		}
+
+		GLint available;
+		glGetQueryObjectiv( queries[p][frame], GL_QUERY_RESULT_AVAILABLE, &available );
+		if( available )											// Otherwise keep the previous result rather than wait.
+		{
+			GLuint64 nanoseconds;
+			glGetQueryObjectui64v( queries[p][frame], GL_QUERY_RESULT, &nanoseconds );
+			milliseconds[p] = nanoseconds / 1.0e6;
+		}
+		issued[p][frame] = false;
+	}
+}
+
+/**
+ * GPU time of a pass.
+ * @param pass Pass.
+ * @return Milliseconds, as of FRAMES - 1 frames ago.
+ */
+double PassTimers::getMilliseconds( Pass pass ) const
+{
+	return milliseconds[pass];
+}
+
+/**
+ * Delete the queries.
+ */
+void PassTimers::release()
+{
+	for( int p = 0; p < PASSES_COUNT; p++ )
+		glDeleteQueries( FRAMES, queries[p] );
+}
@@ -0,0 +1,39 @@
+#ifndef OPENGL_PASSTIMERS_H
+#define OPENGL_PASSTIMERS_H
+
+#include <OpenGL/gl3.h>
+
+using namespace std;
+
+/**
+ * GPU time of each rendering pass, measured with GL_TIME_ELAPSED queries.  Every pass has a small ring of queries, and
+ * results are read FRAMES - 1 frames after they were issued, when they are normally available, so timing never stalls
+ * the pipeline.  Time elapsed queries can't nest: a pass must end before the next one begins.
+ */
+class PassTimers
+{
+public:
+	enum Pass
+	{
+		SHADOW_MAPS, DEPTH_PYRAMID, SHADOW_MOMENTS, DEPTH_PREPASS, SHADOW_MASK, GEOMETRY_BUFFER, SHADING,
+		PASSES_COUNT
+	};
+
+private:
+	static const int FRAMES = 3;				// Queries in flight per pass.
+
+	GLuint queries[PASSES_COUNT][FRAMES];
+	bool issued[PASSES_COUNT][FRAMES];			// Was the pass timed in that frame?
+	double milliseconds[PASSES_COUNT];			// Latest results (0 for passes that didn't run).
+	int frame = 0;								// Slot of the current frame in the rings.
+
+public:
+	void init();
+	void begin( Pass pass );
+	void end();
+	void nextFrame();
+	double getMilliseconds( Pass pass ) const;
+	void release();
+};
+
+#endif //OPENGL_PASSTIMERS_H
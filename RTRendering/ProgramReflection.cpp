@@ -0,0 +1,141 @@
+#include "ProgramReflection.h"
+
+#include <iostream>
+#include <algorithm>
+
+// Uniform and uniform block names, in the order of the Uniform and UniformBlock enumerators.
+const char* const ProgramReflection::UNIFORM_NAMES[UNIFORMS_COUNT] = {
+	"objectTexture", "shadowMaps", "depthPyramid", "useDepthPyramid", "countShadowFetches",
+	"sourceShadowMaps", "layersCount",
+	"sourceDepths", "fromShadowMaps",
+	"shadowMask", "useShadowMask", "shadowMaskScale", "sceneDepth", "InverseProjection", "InverseView",
+	"shadowMoments", "sourceMoments", "blurDirection", "momentsScale",
+	"shadowMapsCompare",
+	"fillLights", "fillLightsCount", "useLightClusters", "clusterRanges", "clusterLightIndices", "clusterGrid",
+	"clusterTileSize", "clusterSlicing",
+	"gBufferDepth", "gBufferAlbedo", "gBufferNormal", "gBufferDiffuse"
+};
+const char* const ProgramReflection::UNIFORM_BLOCK_NAMES[UNIFORM_BLOCKS_COUNT] = {
+	"FrameData", "DrawData"
+};
+
+map<GLuint, ProgramReflection> ProgramReflection::programs;
+
+/**
+ * Constructor: nothing is located.
+ */
+ProgramReflection::ProgramReflection()
+{
+	fill( uniforms, uniforms + UNIFORMS_COUNT, -1 );
+	fill( blockSizes, blockSizes + UNIFORM_BLOCKS_COUNT, -1 );
+}
+
+/**
+ * Read the active uniforms and attributes of a linked program and keep them for later lookups.
+ * Known uniform blocks are bound to their fixed binding points.
+ * @param program Linked program.
+ * @return Reflection of the program.
+ */
+const ProgramReflection& ProgramReflection::reflect( GLuint program )
+{
+	ProgramReflection& reflection = programs[program];
+	reflection = ProgramReflection();
+	reflection.program = program;
+
+	GLint count, maxLength;
+	glGetProgramiv( program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength );
+	string name( static_cast<size_t>( max( maxLength, 1 ) ), '\0' );
+	GLsizei length;
+	GLint size;
+	GLenum type;
+
+	glGetProgramiv( program, GL_ACTIVE_UNIFORMS, &count );
+	for( GLuint i = 0; i < static_cast<GLuint>( count ); i++ )
+	{
+		glGetActiveUniform( program, i, maxLength, &length, &size, &type, &name[0] );
+		string uniformName = name.substr( 0, static_cast<size_t>( length ) );
+		if( uniformName.size() > 3 && uniformName.compare( uniformName.size() - 3, 3, "[0]" ) == 0 )
+			uniformName.resize( uniformName.size() - 3 );						// Arrays are located by their first element.
+		reflection.registerUniform( uniformName, glGetUniformLocation( program, uniformName.c_str() ) );	// -1 for block members.
+	}
+
+	for( int b = 0; b < UNIFORM_BLOCKS_COUNT; b++ )
+	{
+		GLuint blockIndex = glGetUniformBlockIndex( program, UNIFORM_BLOCK_NAMES[b] );
+		if( blockIndex == GL_INVALID_INDEX )
+			continue;
+		glUniformBlockBinding( program, blockIndex, static_cast<GLuint>( b ) );
+		glGetActiveUniformBlockiv( program, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &reflection.blockSizes[b] );
+	}
+
+	glGetProgramiv( program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength );
+	name.assign( static_cast<size_t>( max( maxLength, 1 ) ), '\0' );
+	glGetProgramiv( program, GL_ACTIVE_ATTRIBUTES, &count );
+	for( GLuint i = 0; i < static_cast<GLuint>( count ); i++ )
+	{
+		glGetActiveAttrib( program, i, maxLength, &length, &size, &type, &name[0] );
+		string attributeName = name.substr( 0, static_cast<size_t>( length ) );
+		reflection.attributes[attributeName] = glGetAttribLocation( program, attributeName.c_str() );
+	}
+
+	return reflection;
+}
+
+/**
+ * Store the location of an active uniform under its enumerator, if the renderer uses it.
+ * @param name Uniform name (without array subscript).
+ * @param location Uniform location.
+ */
+void ProgramReflection::registerUniform( const string& name, GLint location )
+{
+	for( int u = 0; u < UNIFORMS_COUNT; u++ )
+	{
+		if( name == UNIFORM_NAMES[u] )
+		{
+			uniforms[u] = location;
+			return;
+		}
+	}
+}
+
+/**
+ * Retrieve the reflection of a compiled program.
+ * @param program Program compiled through Shaders::compile.
+ * @return Reflection of the program.
+ */
+const ProgramReflection& ProgramReflection::get( GLuint program )
+{
+	auto it = programs.find( program );
+	if( it == programs.end() )							// Programs linked elsewhere are reflected on first use.
+		return reflect( program );
+	return it->second;
+}
+
+/**
+ * Forget the reflection of a program that is about to be deleted.
+ * @param program Program ID.
+ */
+void ProgramReflection::release( GLuint program )
+{
+	programs.erase( program );
+}
+
+/**
+ * Location of an active vertex attribute.
+ * @param name Attribute name.
+ * @return Location, or -1 if the program doesn't have it.
+ */
+GLint ProgramReflection::attribute( const string& name ) const
+{
+	auto it = attributes.find( name );
+	return ( it != attributes.end() )? it->second : -1;
+}
+
+/**
+ * Program this reflection belongs to.
+ * @return Program ID.
+ */
+GLuint ProgramReflection::getProgram() const
+{
+	return program;
+}
@@ -0,0 +1,84 @@
+#ifndef OPENGL_PROGRAMREFLECTION_H
+#define OPENGL_PROGRAMREFLECTION_H
+
+#include <string>
+#include <map>
+#include <OpenGL/gl3.h>
+
+using namespace std;
+
+/**
+ * Table of the uniform and attribute locations of a linked shader program, read once through glGetActiveUniform and
+ * glGetActiveAttrib when the program is compiled.  The renderer asks for locations by enumerator, which is a plain
+ * array lookup, so no string is built or hashed and OpenGL is not queried while a frame is drawn.  Uniforms that the
+ * program doesn't use have location -1, which glUniform* calls ignore.
+ *
+ * Uniform blocks are bound at reflection time to the binding point given by their UniformBlock enumerator, so every
+ * program reads the same uniform buffers without per-program rebinding.
+ */
+class ProgramReflection
+{
+public:
+	enum Uniform
+	{
+		OBJECT_TEXTURE, SHADOW_MAPS, DEPTH_PYRAMID, USE_DEPTH_PYRAMID, COUNT_SHADOW_FETCHES,
+		SOURCE_SHADOW_MAPS, LAYERS_COUNT,
+		SOURCE_DEPTHS, FROM_SHADOW_MAPS,
+		SHADOW_MASK, USE_SHADOW_MASK, SHADOW_MASK_SCALE, SCENE_DEPTH, INVERSE_PROJECTION, INVERSE_VIEW,
+		SHADOW_MOMENTS, SOURCE_MOMENTS, BLUR_DIRECTION, MOMENTS_SCALE,
+		SHADOW_MAPS_COMPARE,
+		FILL_LIGHTS, FILL_LIGHTS_COUNT, USE_LIGHT_CLUSTERS, CLUSTER_RANGES, CLUSTER_LIGHT_INDICES, CLUSTER_GRID,
+		CLUSTER_TILE_SIZE, CLUSTER_SLICING,
+		GBUFFER_DEPTH, GBUFFER_ALBEDO, GBUFFER_NORMAL, GBUFFER_DIFFUSE,
+		UNIFORMS_COUNT
+	};
+
+	enum UniformBlock								// Enumerator value is the block's uniform buffer binding point.
+	{
+		FRAME_DATA, DRAW_DATA,
+		UNIFORM_BLOCKS_COUNT
+	};
+
+private:
+	static const char* const UNIFORM_NAMES[UNIFORMS_COUNT];
+	static const char* const UNIFORM_BLOCK_NAMES[UNIFORM_BLOCKS_COUNT];
+	static map<GLuint, ProgramReflection> programs;	// Reflections of all compiled programs.
+
+	GLuint program = 0;
+	GLint uniforms[UNIFORMS_COUNT];
+	GLint blockSizes[UNIFORM_BLOCKS_COUNT];		// Data size in bytes of each uniform block, or -1 if the program lacks it.
+	map<string, GLint> attributes;
+
+	void registerUniform( const string& name, GLint location );
+
+public:
+	ProgramReflection();
+	static const ProgramReflection& reflect( GLuint program );
+	static const ProgramReflection& get( GLuint program );
+	static void release( GLuint program );
+
+	/**
+	 * Location of a uniform.
+	 * @param u Uniform.
+	 * @return Location, or -1 if the program doesn't use it.
+	 */
+	GLint operator[]( Uniform u ) const
+	{
+		return uniforms[u];
+	}
+
+	/**
+	 * Size of a uniform block as laid out by the driver.
+	 * @param b Uniform block.
+	 * @return Size in bytes, or -1 if the program doesn't use the block.
+	 */
+	GLint blockSize( UniformBlock b ) const
+	{
+		return blockSizes[b];
+	}
+
+	GLint attribute( const string& name ) const;
+	GLuint getProgram() const;
+};
+
+#endif //OPENGL_PROGRAMREFLECTION_H
@@ -0,0 +1,65 @@
+// Clustered forward shading of the unshadowed point (fill) lights: see LightClusters.
+// Included by Shaders::read into shader.frag after the DrawData block and its inputs, so it has no #version line of its own.
+
+uniform int fillLightsCount;
+uniform bool useLightClusters;							// Visit only the lights of the fragment's cluster, or else all of them.
+uniform samplerBuffer fillLights;						// Two texels per light: view position and radius, then color.
+uniform usamplerBuffer clusterRanges;					// First index and count of each cluster's lights in clusterLightIndices.
+uniform usamplerBuffer clusterLightIndices;
+uniform ivec3 clusterGrid;								// Tiles along x and y, and depth slices.
+uniform vec2 clusterTileSize;							// In pixels.
+uniform vec2 clusterSlicing;							// Near depth of the exponential slices, and slices per unit of log depth.
+
+/**
+ * Blinn-Phong contribution of a point light, fading smoothly to zero at its radius.
+ * @param light Light index in fillLights.
+ * @param albedo Diffuse color of the fragment.
+ * @param N Normalized normal vector to current fragment in camera coordinates.
+ * @param E Normalized view direction in camera coordinates.
+ * @return Fragment color with respect to this light.
+ */
+vec3 shadeFillLight( int light, vec3 albedo, vec3 N, vec3 E )
+{
+	vec4 positionRadius = texelFetch( fillLights, 2 * light );
+	vec3 toLight = positionRadius.xyz - vPosition;
+	float d2 = dot( toLight, toLight );
+	float window = clamp( 1.0 - d2 * d2 / pow( positionRadius.w, 4.0 ), 0.0, 1.0 );
+	if( window <= 0.0 )
+		return vec3( 0.0 );
+
+	vec3 L = toLight * inversesqrt( d2 );
+	float incidence = dot( N, L );
+	if( incidence <= 0.0 )
+		return vec3( 0.0 );
+	vec3 color = incidence * albedo;
+	if( shininess > 0.0 )								// Negative shininess turns off specular component.
+		color += pow( max( dot( N, normalize( L + E ) ), 0.0 ), shininess ) * specular.rgb;
+	return color * texelFetch( fillLights, 2 * light + 1 ).rgb * window * window / ( d2 + 1.0 );
+}
+
+/**
+ * Sum the contributions of the fill lights that reach the fragment.
+ * @param albedo Diffuse color of the fragment.
+ * @param N Normalized normal vector to current fragment in camera coordinates.
+ * @param E Normalized view direction in camera coordinates.
+ * @param depth Fragment view depth.
+ * @return Fragment color with respect to the fill lights.
+ */
+vec3 shadeFillLights( vec3 albedo, vec3 N, vec3 E, float depth )
+{
+	vec3 sum = vec3( 0.0 );
+	if( !useLightClusters )
+	{
+		for( int i = 0; i < fillLightsCount; i++ )
+			sum += shadeFillLight( i, albedo, N, E );
+		return sum;
+	}
+
+	// Same slicing as LightClusters::sliceOf(): slice 0 spans from the camera to the near depth.
+	int slice = ( depth < clusterSlicing.x )? 0 : 1 + int( floor( log( depth / clusterSlicing.x ) * clusterSlicing.y ) );
+	ivec3 cluster = min( ivec3( ivec2( gl_FragCoord.xy / clusterTileSize ), slice ), clusterGrid - 1 );
+	uvec2 range = texelFetch( clusterRanges, ( cluster.z * clusterGrid.y + cluster.y ) * clusterGrid.x + cluster.x ).xy;
+	for( uint i = 0u; i < range.y; i++ )
+		sum += shadeFillLight( int( texelFetch( clusterLightIndices, int( range.x + i ) ).r ), albedo, N, E );
+	return sum;
+}
@@ -0,0 +1,70 @@
+#version 410 core
+
+#define AMBIENT_SCALE 0.1								// Ambient color over diffuse color (see OpenGL::setColor).
+
+#include "framedata.glsl"
+
+uniform sampler2D gBufferDepth;							// Window depth of the opaque geometry.
+uniform sampler2D gBufferAlbedo;						// Diffuse color (textured), and specular intensity.
+uniform sampler2D gBufferNormal;						// Octahedron-encoded view normal, shininess / 128, and Blinn-Phong flag.
+uniform sampler2D gBufferDiffuse;						// Untextured diffuse color.
+uniform mat4 InverseProjection;							// Takes normalized device coordinates back into camera coordinates.
+uniform mat4 InverseView;								// Takes camera coordinates back into world coordinates.
+
+out vec4 color;
+
+// Stand-ins for shader.frag's input position and material, which clusters.glsl reads.
+vec3 vPosition;
+vec4 specular;
+float shininess;
+
+#include "shadows.glsl"
+#include "clusters.glsl"
+#include "octahedron.glsl"
+
+/**
+ * Main function: light a G-buffer pixel with the shadowed lights and its cluster's fill lights, as shader.frag does.
+ */
+void main( void )
+{
+	ivec2 texel = ivec2( gl_FragCoord.xy );
+	float depth = texelFetch( gBufferDepth, texel, 0 ).r;
+	if( depth >= 1.0 )									// Background: keep the clear color and depth.
+		discard;
+	gl_FragDepth = depth;								// Translucent geometry is blended on top with a depth test.
+
+	vec2 ndc = gl_FragCoord.xy / vec2( textureSize( gBufferDepth, 0 ) ) * 2.0 - 1.0;
+	vec4 p = InverseProjection * vec4( ndc, depth * 2.0 - 1.0, 1.0 );
+	vPosition = p.xyz / p.w;
+	vec4 world = InverseView * vec4( vPosition, 1.0 );
+	float viewDepth = -vPosition.z;
+
+	vec4 albedoSpecular = texelFetch( gBufferAlbedo, texel, 0 );
+	vec4 normalShininess = texelFetch( gBufferNormal, texel, 0 );
+	vec3 albedo = albedoSpecular.rgb;
+	specular = vec4( vec3( albedoSpecular.a ), 1.0 );
+	shininess = ( normalShininess.z > 0.0 )? normalShininess.z * 128.0 : -1.0;	// Zero was a negative shininess: no specular.
+	bool useBlinnPhong = normalShininess.a > 0.5;
+	vec3 N = decodeOctahedron( normalShininess.xy * 2.0 - 1.0 );
+	vec3 E = normalize( -vPosition );
+
+	vec3 totalColor = AMBIENT_SCALE * texelFetch( gBufferDiffuse, texel, 0 ).rgb;	// Untextured, like shader.frag's ambient.
+	for( int i = 0; i < lightsCount; i++ )
+	{
+		vec3 L = normalize( lightPositions[i].xyz - vPosition );
+		float incidence = 1.0;
+		vec3 lit = albedo;								// Flat coloring, if not using Blinn-Phong.
+		if( useBlinnPhong )
+		{
+			incidence = dot( N, L );
+			lit = max( incidence, 0.0 ) * albedo;
+			if( incidence > 0.0 && shininess > 0.0 )
+				lit += pow( max( dot( N, normalize( L + E ) ), 0.0 ), shininess ) * specular.rgb;
+		}
+		totalColor += ( 1.0 - computeShadow( i, world, viewDepth, incidence ) ) * lit * lightColors[i].rgb;
+	}
+	if( useBlinnPhong && fillLightsCount > 0 )
+		totalColor += shadeFillLights( albedo, N, E, viewDepth );
+
+	color = vec4( totalColor, 1.0 );
+}
@@ -0,0 +1,35 @@
+#version 410 core
+
+uniform sampler2DArray sourceDepths;					// Shadow maps, or the previous pyramid level (as the only accessible level).
+uniform bool fromShadowMaps;							// Reducing depth texels into level 0?
+
+flat in int layer;
+
+out vec2 minMax;										// Minimum and maximum depth under this texel.
+
+void main( void )
+{
+	ivec2 sourceSize = textureSize( sourceDepths, 0 ).xy;
+	ivec2 lastTexel = sourceSize - 1;
+	ivec2 texel = ivec2( gl_FragCoord.xy );
+	ivec2 first = texel * 2;
+
+	// Sizes halve rounding down, so the last texel of an odd-sized source also takes the one left over.
+	ivec2 last = first + 1 + ivec2( equal( texel, sourceSize / 2 - 1 ) ) * ( sourceSize & 1 );
+
+	vec2 range = vec2( 1.0, 0.0 );
+	for( int y = first.y; y <= last.y; y++ )
+	{
+		for( int x = first.x; x <= last.x; x++ )
+		{
+			vec2 t = texelFetch( sourceDepths, ivec3( min( ivec2( x, y ), lastTexel ), layer ), 0 ).rg;
+			if( fromShadowMaps )
+				t.g = t.r;
+			range = vec2( min( range.x, t.x ), max( range.y, t.y ) );
+		}
+	}
+
+	if( fromShadowMaps )								// Widen by one unit of the 16-bit target, so that rounding can't narrow the range.
+		range += vec2( -1.0, 1.0 ) / 65535.0;
+	minMax = range;
+}
@@ -0,0 +1,17 @@
+// Per-draw uniform block, shared by every shader that OpenGL's draw calls run.
+// Included by Shaders::read, so it has no #version line of its own.
+
+layout( std140 ) uniform DrawData						// Per-draw data, bound from a ring buffer: see OpenGL::DrawData.
+{
+	mat4 Model;											// Model transform takes points from model into world coordinates.
+	mat3 InvTransModelView;								// Inverse-transposed 3x3 principal submatrix of ModelView matrix.
+	vec4 ambient, diffuse, specular;					// The [r,g,b,a] ambient, diffuse, and specular material properties, respectively.
+	vec3 positionScale;									// Dequantization of vertex positions: model = position * scale + offset.
+	float shininess;
+	vec3 positionOffset;
+	float pointSize;
+	bool useBlinnPhong;
+	bool useTexture;
+	bool useInstancing;									// Take model and normal matrices from the instance attributes?
+	bool drawPoint;
+};
@@ -0,0 +1,66 @@
+// Exponential variance shadow maps, shared by shadows.glsl and shadowmoments.frag.
+// Included by Shaders::read, so it has no #version line of its own.
+
+uniform sampler2DArray shadowMoments;					// Blurred and mipmapped EVSM moments of the ith light in layer i.
+
+///////////////////////////////////////// Exponential Variance Shadow Maps /////////////////////////////////////////////
+
+#define EVSM_POSITIVE_EXPONENT		42.0				// Largest exponents whose squared warps still fit in 32-bit floats.
+#define EVSM_NEGATIVE_EXPONENT		5.0
+#define EVSM_DEPTH_EPSILON			0.0001				// Minimum depth deviation (before warping) assumed by the variance.
+#define EVSM_BLEEDING_REDUCTION		0.2					// Portion of the upper bound cut off to hide light bleeding.
+
+/**
+ * Warp a depth with the positive and negative exponentials.
+ * @param depth Depth in normalized coordinates [0, 1].
+ * @return Positive and negative warps.
+ */
+vec2 warpDepth( float depth )
+{
+	depth = depth * 2.0 - 1.0;							// Center the warps, so that both exponentials use their range.
+	return vec2( exp( EVSM_POSITIVE_EXPONENT * depth ), -exp( -EVSM_NEGATIVE_EXPONENT * depth ) );
+}
+
+/**
+ * Chebyshev's one-tailed inequality: upper bound of the fraction of the filtered region that is at or beyond a depth.
+ * @param moments First and second moments of the (warped) depth over the filtered region.
+ * @param t Warped receiver depth.
+ * @param minVariance Variance floor that prevents acne on planar receivers.
+ * @return Fraction of light that reaches the receiver (1: Completely lit, 0: Completely in shadow).
+ */
+float chebyshevUpperBound( vec2 moments, float t, float minVariance )
+{
+	if( t <= moments.x )
+		return 1.0;
+	
+	float variance = max( moments.y - moments.x * moments.x, minVariance );
+	float d = t - moments.x;
+	float pMax = variance / ( variance + d * d );
+	return clamp( ( pMax - EVSM_BLEEDING_REDUCTION ) / ( 1.0 - EVSM_BLEEDING_REDUCTION ), 0.0, 1.0 );
+}
+
+/**
+ * Exponential variance shadow map method.  The moments are already blurred by the penumbra estimate, and the mip level
+ * is chosen by the hardware, so a single trilinear fetch suffices.
+ * @param layer Shadow moments layer.
+ * @param coords Fragment 3D position in projected light space.
+ * @return Shadow percentage for fragment (1: Completely in shadow, 0: Completely lit).
+ */
+float evsm( int layer, vec4 coords )
+{
+	vec3 projFrag = coords.xyz / coords.w;				// Perspective division: fragment is in [-1, +1].
+	projFrag = projFrag * 0.5 + 0.5;					// Normalize fragment position to [0, 1].
+	
+	if( projFrag.z > 1.0 )								// Anything farther than the light frustrum should be lit.
+		return 0;
+	
+	vec4 moments = texture( shadowMoments, vec3( projFrag.xy, layer ) );
+	shadowFetches++;
+	
+	vec2 warped = warpDepth( projFrag.z );
+	vec2 deviation = EVSM_DEPTH_EPSILON * 2.0 * vec2( EVSM_POSITIVE_EXPONENT, EVSM_NEGATIVE_EXPONENT ) * warped;	// Scaled by the warps' slopes.
+	vec2 minVariance = deviation * deviation;
+	float lit = min( chebyshevUpperBound( moments.xy, warped.x, minVariance.x ),
+					 chebyshevUpperBound( moments.zw, warped.y, minVariance.y ) );
+	return 1.0 - lit;
+}
@@ -0,0 +1,20 @@
+// Draw features that the rendering shaders branch on, shared by shader.vert, shader.frag, and gbuffer.frag.
+// Included by Shaders::read after the DrawData block, so it has no #version line of its own.
+//
+// A variant compiled by ShaderPermutations defines FEATURES as the draw's feature mask, which turns every branch into a
+// compile-time constant: dead code, texture reads, and varyings are stripped out.  Programs compiled without it read the
+// DrawData flags at run time.
+
+#define FEATURE_BLINN_PHONG	1							// Must match ShaderPermutations::Feature.
+#define FEATURE_TEXTURE		2
+#define FEATURE_POINT		4
+
+#ifdef FEATURES
+#define USE_BLINN_PHONG		( ( FEATURES & FEATURE_BLINN_PHONG ) != 0 )
+#define USE_TEXTURE			( ( FEATURES & FEATURE_TEXTURE ) != 0 )
+#define DRAW_POINT			( ( FEATURES & FEATURE_POINT ) != 0 )
+#else
+#define USE_BLINN_PHONG		useBlinnPhong
+#define USE_TEXTURE			useTexture
+#define DRAW_POINT			drawPoint
+#endif
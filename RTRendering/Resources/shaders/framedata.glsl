@@ -0,0 +1,22 @@
+// Per-pass uniform block, shared by every shader that reads the camera or the lights.
+// Included by Shaders::read, so it has no #version line of its own.
+
+#define MAX_LIGHTS 16									// Must match OpenGL::FRAME_LIGHTS.
+#define MAX_CASCADES 4									// Must match Light::MAX_CASCADES.
+#define SHADOW_LAYERS 64								// MAX_LIGHTS * MAX_CASCADES: must match OpenGL::SHADOW_LAYERS.
+
+layout( std140 ) uniform FrameData						// Per-pass data: see OpenGL::FrameData.
+{
+	mat4 View;											// View matrix takes points from world into camera coordinates.
+	mat4 Projection;
+	mat4 LightSpaceMatrices[SHADOW_LAYERS];				// Takes world to light space coordinates for each cascade of each light.
+	vec4 lightPositions[MAX_LIGHTS];					// In camera coordinates.
+	vec4 lightColors[MAX_LIGHTS];						// Only RGB.
+	vec4 lightBoxes[SHADOW_LAYERS];						// Width, height, near, and far planes of each cascade's orthographic projection.
+	vec4 cascadeSplits;									// View depth where each cascade ends.
+	ivec4 shadowTechniques[MAX_LIGHTS / 4];				// Light::ShadowTechnique of light i in component i % 4 of entry i / 4 (0: PCSS, 1: EVSM).
+	uvec2 layersMask;									// Layers that geometry is fanned out to among those: bit l % 32 of component l / 32.
+	int layersCount;									// Shadow map layers that geometry is fanned out to (one per cascade of each light).
+	int cascadesCount;									// Cascades per light: light i, cascade c is in layer i * cascadesCount + c.
+	int lightsCount;									// Lights in use: entries 0 to lightsCount - 1 of the light arrays.
+};
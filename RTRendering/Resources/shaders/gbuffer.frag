@@ -0,0 +1,31 @@
+#version 410 core
+
+#include "drawdata.glsl"
+
+#include "features.glsl"
+
+uniform sampler2D objectTexture;						// 3D object texture.
+
+in vec3 vNormal;										// Normal vector in view coordinates.
+in vec2 oTexCoords;
+
+layout( location = 0 ) out vec4 albedoSpecular;			// RGBA8: diffuse color (textured), and specular intensity.
+layout( location = 1 ) out vec4 normalShininess;		// RGB10_A2: octahedron-encoded view normal, shininess / 128, and Blinn-Phong flag.
+layout( location = 2 ) out vec3 diffuseColor;			// RGB565: untextured diffuse color, for the ambient term.
+
+#include "octahedron.glsl"
+
+/**
+ * Main function: write the opaque surface's material into the G-buffer (see DeferredShading).
+ */
+void main( void )
+{
+	if( DRAW_POINT && dot( gl_PointCoord - 0.5, gl_PointCoord - 0.5 ) > 0.25 )		// For rounded points.
+		discard;
+
+	vec3 albedo = ( USE_BLINN_PHONG && USE_TEXTURE )? texture( objectTexture, oTexCoords ).rgb * diffuse.rgb : diffuse.rgb;
+	vec3 N = ( USE_BLINN_PHONG )? normalize( vNormal ) : vec3( 0.0, 0.0, 1.0 );
+	albedoSpecular = vec4( albedo, dot( specular.rgb, vec3( 1.0 / 3.0 ) ) );
+	normalShininess = vec4( encodeOctahedron( N ) * 0.5 + 0.5, max( shininess, 0.0 ) / 128.0, ( USE_BLINN_PHONG )? 1.0 : 0.0 );
+	diffuseColor = diffuse.rgb;
+}
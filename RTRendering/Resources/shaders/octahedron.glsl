@@ -0,0 +1,27 @@
+// Octahedral encoding of unit vectors in two components, shared by gbuffer.frag and deferred.frag.
+// Included by Shaders::read, so it has no #version line of its own.
+
+/**
+ * Project a unit vector onto the octahedron |x| + |y| + |z| = 1 and unfold its lower half over the corners.
+ * @param n Unit vector.
+ * @return Encoding in [-1, 1]^2.
+ */
+vec2 encodeOctahedron( vec3 n )
+{
+	n /= abs( n.x ) + abs( n.y ) + abs( n.z );
+	vec2 signs = vec2( ( n.x >= 0.0 )? 1.0 : -1.0, ( n.y >= 0.0 )? 1.0 : -1.0 );
+	return ( n.z >= 0.0 )? n.xy : ( 1.0 - abs( n.yx ) ) * signs;
+}
+
+/**
+ * Unit vector back from its octahedral encoding.
+ * @param e Encoding in [-1, 1]^2.
+ * @return Unit vector.
+ */
+vec3 decodeOctahedron( vec2 e )
+{
+	vec3 n = vec3( e, 1.0 - abs( e.x ) - abs( e.y ) );
+	float t = max( -n.z, 0.0 );							// Fold the lower half back.
+	n.xy -= vec2( ( n.x >= 0.0 )? t : -t, ( n.y >= 0.0 )? t : -t );
+	return normalize( n );
+}
@@ -0,0 +1,229 @@
+// Percentage closer soft shadows from the layered shadow maps, shared by shadows.glsl and shadowmoments.frag.
+// Included by Shaders::read after the FrameData block, so it has no #version line of its own.
+
+uniform sampler2DArray shadowMaps;						// Shadow map texture of the ith light in layer i.
+uniform sampler2DArrayShadow shadowMapsCompare;			// The same shadow maps through a bilinear depth-compare sampler.
+uniform sampler2DArray depthPyramid;					// Min (r) and max (g) shadow map depth over 2^(L+1) x 2^(L+1) texel blocks at level L.
+uniform bool useDepthPyramid;							// Skip blocker search and filtering where the pyramid proves the result.
+
+int shadowFetches = 0;									// Texels read by this fragment from the shadow maps and the pyramid.
+
+///////////////////////////////////////// Percentage Closer Soft Shadows ///////////////////////////////////////////////
+
+#define NUM_SAMPLES  				31					// Blocker search taps.
+#ifndef PCF_SAMPLES
+#define PCF_SAMPLES					12					// Filter taps, each a bilinear-weighted 2x2 comparison (up to NUM_SAMPLES).
+#endif
+#define NEAR_PLANE 					0.01
+#define LIGHT_WORLD_SIZE 			3.0
+#define LIGHT_FRUSTUM_WIDTH 		30.0
+#define LIGHT_SIZE_UV 				(LIGHT_WORLD_SIZE / LIGHT_FRUSTUM_WIDTH)	// Assuming that LIGHT_FRUSTUM_WIDTH = LIGHT_FRUSTUM_HEIGHT.
+#define REFERENCE_FRUSTUM_SIDE		60.0				// The constants above were tuned for a fixed [-30, 30]^2 x [NEAR_PLANE, 200]
+#define REFERENCE_FAR_PLANE			200.0				// light frustum; fitted frusta are converted to it (see lightBoxes).
+
+// Used for searching and filtering the depth/shadow map.
+const vec2 poissonDisk[NUM_SAMPLES] = vec2[NUM_SAMPLES](
+														vec2( 0.19483898, -0.04906884),
+														vec2(-0.20130208, -0.1598451 ),
+														vec2(-0.17657379,  0.27214397),
+														vec2(-0.18434988,  0.71673575),
+														vec2(0.19165408,  0.89863354),
+														vec2(-0.58109718,  0.63340388),
+														vec2(0.05128605,  0.51784401),
+														vec2(0.63354365,  0.5275925 ),
+														vec2(-0.51379029,  0.1419501 ),
+														vec2(0.69485186,  0.13043893),
+														vec2(-0.88038342,  0.3311689 ),
+														vec2(0.10940117, -0.63964106),
+														vec2(0.34065359,  0.36201536),
+														vec2(-0.85766868, -0.19484638),
+														vec2(0.68075919,  0.9383508 ),
+														vec2(0.98666111,  0.70115573),
+														vec2(0.93154108,  0.40278772),
+														vec2(0.50832938, -0.35158726),
+														vec2(-0.55546935, -0.39379395),
+														vec2(-0.38763822,  0.96256016),
+														vec2(-0.81259892, -0.80838567),
+														vec2(-0.99363224,  0.79686303),
+														vec2(-0.4778399 , -0.95310737),
+														vec2(-0.75429473,  0.98810816),
+														vec2(0.81623723, -0.72246694),
+														vec2(0.05209179, -0.96911855),
+														vec2(0.10548147, -0.33657712),
+														vec2(-0.20686522, -0.49231428),
+														vec2(0.97070736, -0.24451268),
+														vec2(0.44274798, -0.77235927),
+														vec2(-0.83493721, -0.50384213)
+);
+
+/**
+ * Express a shadow map depth as the depth it'd have in the reference light frustum, which the PCSS constants assume.
+ * @param layer Shadow map layer (i.e. light cascade).
+ * @param z Depth in the light's fitted frustum, in normalized coordinates [0, 1].
+ * @return Reference depth.
+ */
+float referenceDepth( int layer, float z )
+{
+	vec4 box = lightBoxes[layer];
+	return max( ( mix( box.z, box.w, z ) - NEAR_PLANE ) / ( REFERENCE_FAR_PLANE - NEAR_PLANE ), 1e-4 );
+}
+
+/**
+ * Scale lengths measured in the reference light frustum to the light's fitted frustum.
+ * @param layer Shadow map layer (i.e. light cascade).
+ * @return Fitted units per reference unit, for UVs (xy) and depths (z).
+ */
+vec3 fittedPerReference( int layer )
+{
+	vec4 box = lightBoxes[layer];
+	return vec3( REFERENCE_FRUSTUM_SIDE / box.xy, ( REFERENCE_FAR_PLANE - NEAR_PLANE ) / ( box.w - box.z ) );
+}
+
+/**
+ * Parallel plane estimatino of penumbra size.
+ * @param zReceiver Current fragment depth in normalized coordinates [0, 1].
+ * @param zBlocker Average blocker depth.
+ * @return Triangle similarity estimation of proportion for penumbra size.
+ */
+float penumbraSize( float zReceiver, float zBlocker ) //Parallel plane estimation
+{
+	return ( zReceiver - zBlocker ) / zBlocker;
+}
+
+/**
+ * Get the average blocker depth values that are closer to the light than current depth.
+ * @param layer Shadow map layer to use for current search.
+ * @param uv Fragment position in normalized coordinates [0, 1].
+ * @param zReceiver Depth of current fragment in normalized coordinates [0, 1].
+ * @param bias If given, evaluation bias to prevent 'depth' acne.
+ * @return Average blocker depth or -1 if no blockers were found.
+ */
+float findBlockerDepth( int layer, vec2 uv, float zReceiver, float bias )
+{
+	// Uses similar triangles to compute what area of the shadow map we should search.
+	vec2 searchWidth = LIGHT_SIZE_UV * ( referenceDepth( layer, zReceiver ) - NEAR_PLANE ) * fittedPerReference( layer ).xy;
+	float blockerSum = 0, numBlockers = 0;
+	
+	for( int i = 0; i < NUM_SAMPLES; i++ )
+	{
+		float shadowMapDepth = texture( shadowMaps, vec3( uv + poissonDisk[i] * searchWidth, layer ) ).r;
+		if( zReceiver - shadowMapDepth > 0 )				// A blocker? Closer to light.
+		{
+			blockerSum += shadowMapDepth;					// Accumulate blockers depth.
+			numBlockers++;
+		}
+	}
+	
+	shadowFetches += NUM_SAMPLES;
+	return ( numBlockers > 0 )? blockerSum / numBlockers : -1.0;
+}
+
+/**
+ * Apply percentage closer filter to a set of samples around the current fragment (in the shadow map).  The depth-compare
+ * sampler returns the bilinear-weighted result of the 2x2 texels around each sample, so far fewer taps are needed.
+ * @param layer Shadow map layer to use for current filtering operation.
+ * @param uv Fragment position in normalized coordinates [0 ,1] with respect to light projected space.
+ * @param zReceiver Fragment's depth value in light projected space.
+ * @param filterRadiusUV Sampling radius around the fragment's position in shadow map (in the reference frustum).
+ * @param bias Evaluation bias to prevent shadow acne (in reference depth).
+ * @return Percentage of shadow to be assigned to fragment.
+ */
+float applyPCFilter( int layer, vec2 uv, float zReceiver, float filterRadiusUV, float bias )
+{
+	vec3 scale = fittedPerReference( layer );
+	vec2 radius = max( bias/1.05, filterRadiusUV ) * scale.xy;
+	float reference = zReceiver - bias * scale.z;
+	float lit = 0;
+	for( int i = 0; i < PCF_SAMPLES; i++ )
+		lit += texture( shadowMapsCompare, vec4( uv + poissonDisk[i] * radius, layer, reference ) );	// Lit where depth >= reference.
+	shadowFetches += 4 * PCF_SAMPLES;
+	return 1.0 - lit / PCF_SAMPLES;
+}
+
+/**
+ * Bound the shadow map depths in a rectangle of texels with the coarsest pyramid level where the rectangle spans at
+ * most 2x2 pyramid texels.
+ * @param layer Shadow map layer.
+ * @param first Lower-left shadow map texel.
+ * @param last Upper-right shadow map texel.
+ * @return Minimum and maximum depth (possibly widened) over the rectangle.
+ */
+vec2 depthRange( int layer, ivec2 first, ivec2 last )
+{
+	ivec2 base = textureSize( depthPyramid, 0 ).xy;
+	int levels = int( log2( float( max( base.x, base.y ) ) ) ) + 1;
+	int span = max( last.x - first.x, last.y - first.y ) + 1;
+	int level = clamp( int( ceil( log2( float( span ) ) ) ) - 1, 0, levels - 1 );
+
+	ivec2 lastTexel = max( base >> level, 1 ) - 1;
+	ivec2 from = min( first >> ( level + 1 ), lastTexel ),		// Level L texel t covers shadow map texels [t, t+1) * 2^(L+1).
+		  to = min( last >> ( level + 1 ), lastTexel );
+	vec2 range = vec2( 1.0, 0.0 );
+	for( int y = from.y; y <= to.y; y++ )
+	{
+		for( int x = from.x; x <= to.x; x++ )
+		{
+			vec2 t = texelFetch( depthPyramid, ivec3( x, y, layer ), level ).rg;
+			range = vec2( min( range.x, t.x ), max( range.y, t.y ) );
+			shadowFetches++;
+		}
+	}
+	return range;
+}
+
+/**
+ * Percentage closer soft shadow method.
+ * @param layer Shadow map layer to use for PCSS.
+ * @param coords Fragment 3D position in projected light space.
+ * @param incidence Dot product of light and normal vectors at fragment to be rendered.
+ * @return Shadow percentage for fragment (1: Completely in shadow, 0: Completely lit).
+ */
+float pcss( int layer, vec4 coords, float incidence )
+{
+	vec3 projFrag = coords.xyz / coords.w;			// Perspective division: fragment is in [-1, +1].
+	projFrag = projFrag * 0.5 + 0.5;				// Normalize fragment position to [0, 1].
+	
+	vec2 uv = projFrag.xy;
+	float zReceiver = projFrag.z;
+	
+	if( zReceiver > 1.0 )							// Anything farther than the light frustrum should be lit.
+		return 0;
+	
+	// Penumbra estimation works in the reference frustum; comparisons, in the fitted one.
+	vec3 scale = fittedPerReference( layer );
+	float zReference = referenceDepth( layer, zReceiver );
+	float bias = max( 0.0004 * ( 1.0 - incidence ), 0.0005 );
+	
+	// Step 0: Classify the search region with the depth pyramid; only penumbrae need steps 1 to 3.
+	if( useDepthPyramid )
+	{
+		float searchWidth = LIGHT_SIZE_UV * ( zReference - NEAR_PLANE );
+		vec2 lo = uv - searchWidth * scale.xy, hi = uv + searchWidth * scale.xy;	// Poisson disk samples fall within [-1, 1]^2.
+		ivec2 side = textureSize( shadowMaps, 0 ).xy;
+		ivec2 first = ivec2( floor( lo * side ) ) - 1,		// One more texel around the samples: a bilinear tap reads the
+			  last = ivec2( floor( hi * side ) ) + 1;		// 2x2 texels around it, half a texel beyond its position.
+		vec2 range = depthRange( layer, clamp( first, ivec2( 0 ), side - 1 ), clamp( last, ivec2( 0 ), side - 1 ) );
+		
+		if( zReceiver <= range.x )					// Nothing in the region is closer to the light: no blockers.
+			return 0;
+		
+		// Every texel in the region is a blocker that passes the bias test, and the widest filter that the blockers could
+		// produce stays inside the region (and away from the border, which reads as lit): the filter would return 1.
+		float maxFilterRadiusUV = max( bias/1.05, penumbraSize( zReference, referenceDepth( layer, range.x ) ) * LIGHT_SIZE_UV * NEAR_PLANE / zReference );
+		if( zReceiver - range.y > bias * scale.z && range.x > 0 && maxFilterRadiusUV <= searchWidth &&
+			all( greaterThanEqual( first, ivec2( 0 ) ) ) && all( lessThan( last, side ) ) )
+			return 1;
+	}
+	
+	// Step 1: Blocker search.
+	float avgBlockerDepth = findBlockerDepth( layer, uv, zReceiver, 0.0 );
+	if( avgBlockerDepth < 0 )						// There are no occluders so early out (this saves filtering).
+		return 0;
+	
+	// Step 2: Penumbra size.
+	float penumbraRatio = penumbraSize( zReference, referenceDepth( layer, avgBlockerDepth ) );
+	float filterRadiusUV = penumbraRatio * LIGHT_SIZE_UV * NEAR_PLANE / zReference;
+	
+	// Step 3: Filtering.
+	return applyPCFilter( layer, uv, zReceiver, filterRadiusUV, bias );
+}
@@ -1,43 +1,37 @@
 #version 410 core
 
-in vec3 position;
-in vec3 normal;
-in vec2 texCoords;
+layout( location = 0 ) in vec3 position;			// Fixed locations: see VertexArray.h.
+layout( location = 1 ) in vec3 normal;
+layout( location = 2 ) in vec2 texCoords;
+layout( location = 3 ) in mat4 instanceModel;			// Per-instance model matrix (if useInstancing).
+layout( location = 7 ) in mat3 instanceNormalMatrix;	// Per-instance inverse transpose of the model matrix's 3x3 principal submatrix.
 
-uniform mat4 Model;										// Model transform takes points from model into world coordinates.
-uniform mat4 View;										// View matrix takes points from world into camera coordinates.
-uniform mat3 InvTransModelView;							// Inverse-transposed 3x3 principal submatrix of ModelView matrix.
-uniform mat4 Projection;
-uniform float pointSize;
-uniform bool useBlinnPhong;
+#include "framedata.glsl"
 
-uniform mat4 LightSpaceMatrix0;							// Takes world to light space coordinates (= Proj_light * View_light).
-uniform mat4 LightSpaceMatrix1;
-uniform mat4 LightSpaceMatrix2;
+#include "drawdata.glsl"
+
+#include "features.glsl"
 
 out vec3 vPosition;										// Position in view (camera) coordinates.
 out vec3 vNormal;										// Normal vector in view coordinates.
 out vec2 oTexCoords;									// Interpolate texture coordinates into fragment shader.
+out vec4 wPosition;										// Position in world coordinates (taken to each cascade's light space per fragment).
 
-out vec4 fragPosLightSpace0;							// Position of fragment in light space (need w component for manual perspective division).
-out vec4 fragPosLightSpace1;
-out vec4 fragPosLightSpace2;
+invariant gl_Position;									// Depth pre-pass and shaded pass must produce identical depths.
 
 void main( void )
 {
-	vec4 p = Model * vec4( position.xyz, 1.0 );			// Vertex in world coordinates.
+	mat4 M = ( useInstancing )? Model * instanceModel : Model;
+	vec4 p = M * vec4( position * positionScale + positionOffset, 1.0 );			// Vertex in world coordinates.
 	gl_Position = Projection * View * p;
 
-	if( useBlinnPhong )
+	if( USE_BLINN_PHONG )
 	{
 		vPosition = (View * p).xyz;						// Send vertex and normal to fragment shader in camera coodinates.
-		vNormal = InvTransModelView * normal;
+		vNormal = InvTransModelView * ( ( useInstancing )? instanceNormalMatrix * normal : normal );
 	}
 
 	gl_PointSize = pointSize;
 	oTexCoords = texCoords;
-	
-	fragPosLightSpace0 = LightSpaceMatrix0 * p;			// Send vertex position in light space projected coordinates.
-	fragPosLightSpace1 = LightSpaceMatrix1 * p;
-	fragPosLightSpace2 = LightSpaceMatrix2 * p;
+	wPosition = p;										// The fragment shader picks the light cascade by depth.
 }
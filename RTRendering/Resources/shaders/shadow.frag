@@ -1,6 +1,6 @@
 #version 410 core
 
-uniform bool drawPoint;
+#include "drawdata.glsl"
 
 void main( void )
 {
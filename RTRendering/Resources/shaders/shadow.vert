@@ -1,14 +1,13 @@
 #version 410 core
 
-in vec3 position;
+layout( location = 0 ) in vec3 position;			// Fixed locations: see VertexArray.h.
+layout( location = 3 ) in mat4 instanceModel;		// Per-instance model matrix (if useInstancing).
 
-uniform mat4 Model;										// Model transform takes points from model into world coordinates.
-uniform mat4 LightSpaceMatrix;							// Takes world to light space coordinates (= Proj_light * View_light).
-
-uniform float pointSize;
+#include "drawdata.glsl"
 
 void main( void )
 {
-	gl_Position = LightSpaceMatrix * Model * vec4( position, 1.0 );		// Transforming all scene vertices to light space.
+	mat4 M = ( useInstancing )? Model * instanceModel : Model;
+	gl_Position = M * vec4( position * positionScale + positionOffset, 1.0 );		// World coordinates: shadow.geom projects them into each light space.
 	gl_PointSize = pointSize;
 }
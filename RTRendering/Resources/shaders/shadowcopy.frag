@@ -0,0 +1,10 @@
+#version 410 core
+
+uniform sampler2DArray sourceShadowMaps;				// Layered depth maps to copy, one texel per fragment.
+
+flat in int layer;
+
+void main( void )
+{
+	gl_FragDepth = texelFetch( sourceShadowMaps, ivec3( gl_FragCoord.xy, layer ), 0 ).r;
+}
@@ -0,0 +1,7 @@
+#version 410 core
+
+void main( void )
+{
+	vec2 corner = vec2( ( gl_VertexID << 1 ) & 2, gl_VertexID & 2 );		// A triangle that covers the whole viewport.
+	gl_Position = vec4( corner * 2.0 - 1.0, 0.0, 1.0 );
+}
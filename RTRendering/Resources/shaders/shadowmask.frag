@@ -0,0 +1,58 @@
+#version 410 core
+
+#define MASK_LIGHTS 3									// Lights that fit in the mask (must match shader.frag).
+#define BACKGROUND_DEPTH 60000.0						// View depth stored where nothing was drawn (fits a half float).
+
+#include "framedata.glsl"
+
+uniform sampler2D sceneDepth;							// Depth laid down by the camera at full resolution.
+uniform int shadowMaskScale;							// Full resolution pixels per mask texel, along each axis.
+uniform mat4 InverseProjection;							// Takes normalized device coordinates back into camera coordinates.
+uniform mat4 InverseView;								// Takes camera coordinates back into world coordinates.
+
+out vec4 mask;											// Shadow of lights 0, 1, 2 (if present), and view depth of the sampled pixel.
+
+#include "shadows.glsl"
+
+/**
+ * Reconstruct the camera coordinates of a full resolution pixel from its depth.
+ * @param texel Pixel.
+ * @return Position in view (camera) coordinates.
+ */
+vec3 viewPosition( ivec2 texel )
+{
+	vec2 ndc = ( vec2( texel ) + 0.5 ) / vec2( textureSize( sceneDepth, 0 ) ) * 2.0 - 1.0;
+	vec4 p = InverseProjection * vec4( ndc, texelFetch( sceneDepth, texel, 0 ).r * 2.0 - 1.0, 1.0 );
+	return p.xyz / p.w;
+}
+
+/**
+ * Main function.
+ */
+void main( void )
+{
+	ivec2 lastTexel = textureSize( sceneDepth, 0 ) - 1;
+	ivec2 texel = min( ivec2( gl_FragCoord.xy ) * shadowMaskScale + shadowMaskScale / 2, lastTexel );	// Mask texel center.
+	if( texelFetch( sceneDepth, texel, 0 ).r >= 1.0 )	// Background: nothing to shade.
+	{
+		mask = vec4( 0.0, 0.0, 0.0, BACKGROUND_DEPTH );
+		return;
+	}
+
+	// Normal from the neighbors' positions: on each axis, the side with the smaller depth change belongs to this surface.
+	vec3 P = viewPosition( texel );
+	ivec2 inner = clamp( texel, ivec2( 1 ), max( lastTexel - 1, 1 ) );
+	vec3 dx0 = P - viewPosition( inner - ivec2( 1, 0 ) ), dx1 = viewPosition( inner + ivec2( 1, 0 ) ) - P;
+	vec3 dy0 = P - viewPosition( inner - ivec2( 0, 1 ) ), dy1 = viewPosition( inner + ivec2( 0, 1 ) ) - P;
+	vec3 N = cross( ( abs( dx0.z ) < abs( dx1.z ) )? dx0 : dx1, ( abs( dy0.z ) < abs( dy1.z ) )? dy0 : dy1 );
+	N = ( dot( N, N ) > 0.0 )? normalize( N ) : normalize( -P );
+	if( dot( N, P ) > 0.0 )								// Facing the camera.
+		N = -N;
+
+	vec4 world = InverseView * vec4( P, 1.0 );
+	vec3 shadows = vec3( 0.0 );
+	for( int i = 0; i < min( lightsCount, MASK_LIGHTS ); i++ )
+		shadows[i] = computeShadow( i, world, -P.z, dot( N, normalize( lightPositions[i].xyz - P ) ) );
+
+	mask = vec4( shadows, -P.z );
+}
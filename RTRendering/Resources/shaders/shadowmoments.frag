@@ -0,0 +1,77 @@
+#version 410 core
+
+#define MAX_BLUR_RADIUS 8								// Widest Gaussian kernel, in moment texels to either side.
+
+#include "framedata.glsl"
+
+uniform sampler2DArray sourceMoments;					// Moments to blur, as the only accessible level.
+uniform bool fromShadowMaps;							// Warping the shadow map depths into level 0, rather than blurring?
+uniform ivec2 blurDirection;							// (1, 0) for the horizontal pass, and (0, 1) for the vertical one.
+uniform int momentsScale;								// Shadow map texels per moment texel, along each axis.
+
+flat in int layer;
+
+out vec4 moments;										// Positive warp and its square, negative warp and its square.
+
+#include "pcss.glsl"
+#include "evsm.glsl"
+
+/**
+ * Estimate how wide the penumbrae around a moment texel can be, from the nearest blocker and the farthest receiver
+ * that the pyramid finds within reach of the widest kernel.  Contact shadows keep a narrow kernel.
+ * @param texel Moment texel.
+ * @param scale Shadow map texels per moment texel, along each axis.
+ * @return Blur radius, in moment texels.
+ */
+int blurRadius( ivec2 texel, int scale )
+{
+	ivec2 side = textureSize( shadowMaps, 0 ).xy;
+	vec2 range = depthRange( layer, clamp( ( texel - MAX_BLUR_RADIUS ) * scale, ivec2( 0 ), side - 1 ),
+							 clamp( ( texel + MAX_BLUR_RADIUS + 1 ) * scale - 1, ivec2( 0 ), side - 1 ) );
+	if( range.x <= 0.0 || range.y <= range.x )
+		return 1;
+	
+	float zReceiver = referenceDepth( layer, min( range.y, 1.0 ) );
+	float radiusUV = penumbraSize( zReceiver, referenceDepth( layer, range.x ) ) * LIGHT_SIZE_UV * NEAR_PLANE / zReceiver;	// As in pcss().
+	vec2 radius = radiusUV * fittedPerReference( layer ).xy * vec2( side / scale );
+	return clamp( int( ceil( max( radius.x, radius.y ) ) ), 1, MAX_BLUR_RADIUS );
+}
+
+/**
+ * Main function.
+ */
+void main( void )
+{
+	ivec2 texel = ivec2( gl_FragCoord.xy );
+	int scale = momentsScale;
+	
+	if( fromShadowMaps )								// Box-filter the warped depths under this texel.
+	{
+		ivec2 lastTexel = textureSize( shadowMaps, 0 ).xy - 1;
+		vec4 sum = vec4( 0.0 );
+		for( int y = 0; y < scale; y++ )
+		{
+			for( int x = 0; x < scale; x++ )
+			{
+				vec2 warped = warpDepth( texelFetch( shadowMaps, ivec3( min( texel * scale + ivec2( x, y ), lastTexel ), layer ), 0 ).r );
+				sum += vec4( warped.x, warped.x * warped.x, warped.y, warped.y * warped.y );
+			}
+		}
+		moments = sum / float( scale * scale );
+		return;
+	}
+	
+	// Separable Gaussian whose width follows the penumbra estimate (sigma is half the radius).
+	int radius = blurRadius( texel, scale );
+	float sigma = 0.5 * float( radius );
+	ivec2 lastTexel = textureSize( sourceMoments, 0 ).xy - 1;
+	vec4 sum = vec4( 0.0 );
+	float weights = 0.0;
+	for( int i = -radius; i <= radius; i++ )
+	{
+		float w = exp( -float( i * i ) / ( 2.0 * sigma * sigma ) );
+		sum += w * texelFetch( sourceMoments, ivec3( clamp( texel + blurDirection * i, ivec2( 0 ), lastTexel ), layer ), 0 );
+		weights += w;
+	}
+	moments = sum / weights;
+}
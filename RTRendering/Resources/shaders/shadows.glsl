@@ -0,0 +1,53 @@
+// Shadow of a light with its Light::ShadowTechnique, from its cascaded shadow maps, shared by shader.frag and shadowmask.frag.
+// Included by Shaders::read after the FrameData block, so it has no #version line of its own.
+
+#include "pcss.glsl"
+#include "evsm.glsl"
+
+#define SHADOW_TECHNIQUE_PCSS		0					// Must match Light::ShadowTechnique.
+#define SHADOW_TECHNIQUE_EVSM		1
+#define CASCADE_BLEND_BAND			0.1					// Far end of each cascade, as a fraction of its depth, that fades into the next.
+
+/**
+ * Evaluate the shadow of a light in one of its cascades with the technique chosen for the light.
+ * @param light Light unit.
+ * @param layer Shadow map layer of the cascade.
+ * @param world Fragment 3D position in world coordinates.
+ * @param incidence Dot product of light and normal vectors at fragment to be rendered.
+ * @return Shadow percentage for fragment (1: Completely in shadow, 0: Completely lit).
+ */
+float cascadeShadow( int light, int layer, vec4 world, float incidence )
+{
+	vec4 coords = LightSpaceMatrices[layer] * world;
+	if( shadowTechniques[light / 4][light % 4] == SHADOW_TECHNIQUE_EVSM )
+		return evsm( layer, coords );
+	return pcss( layer, coords, incidence );
+}
+
+/**
+ * Evaluate the shadow of a light in the first cascade that reaches the fragment's view depth.  Over the last stretch of
+ * a cascade, the next one is evaluated too and blended in, so that the change of resolution doesn't show as a seam.
+ * @param light Light unit.
+ * @param world Fragment 3D position in world coordinates.
+ * @param viewDepth Fragment depth in camera coordinates (-z).
+ * @param incidence Dot product of light and normal vectors at fragment to be rendered.
+ * @return Shadow percentage for fragment (1: Completely in shadow, 0: Completely lit).
+ */
+float computeShadow( int light, vec4 world, float viewDepth, float incidence )
+{
+	int cascade = 0;
+	while( cascade < cascadesCount - 1 && viewDepth > cascadeSplits[cascade] )
+		cascade++;
+	
+	int layer = light * cascadesCount + cascade;
+	float shadow = cascadeShadow( light, layer, world, incidence );
+	if( cascade < cascadesCount - 1 )
+	{
+		float begin = ( cascade > 0 )? cascadeSplits[cascade - 1] : 0.0;
+		float band = CASCADE_BLEND_BAND * ( cascadeSplits[cascade] - begin );
+		float t = ( viewDepth - ( cascadeSplits[cascade] - band ) ) / band;
+		if( t > 0.0 )
+			shadow = mix( shadow, cascadeShadow( light, layer + 1, world, incidence ), t );
+	}
+	return shadow;
+}
@@ -0,0 +1,128 @@
+#include "ShaderPermutations.h"
+
+#include <algorithm>
+
+/**
+ * Constructor: no variant is compiled.
+ */
+ShaderPermutations::ShaderPermutations()
+{
+	fill( variants, variants + VARIANTS_COUNT, 0 );
+}
+
+/**
+ * Define a macro for every variant, e.g. a permutation that doesn't depend on the draw.  Call it before init().
+ * @param name Macro name.
+ * @param value Macro value.
+ */
+void ShaderPermutations::define( const string& name, int value )
+{
+	defines.emplace_back( name, value );
+}
+
+/**
+ * Set the shader files and compile the variants that are known to be needed up front, so that no draw waits for one.
+ * @param fvert Vertex shader file name, with relative path.
+ * @param ffrag Fragment shader file name, with relative path.
+ * @param masks Feature masks to compile right away (see OpenGL::DRAW_FEATURES).
+ */
+void ShaderPermutations::init( const string& fvert, const string& ffrag, const vector<unsigned>& masks )
+{
+	vertexFile = fvert;
+	fragmentFile = ffrag;
+	for( unsigned features : masks )
+		get( features );
+}
+
+/**
+ * Program specialized for a feature mask, compiled the first time it is asked for.  A new variant gets the integer
+ * uniforms and is run through the program setup, which leaves it in use.
+ * @param features Mask of Feature bits.
+ * @return Linked program.
+ */
+GLuint ShaderPermutations::get( unsigned features )
+{
+	features &= VARIANTS_COUNT - 1;
+	if( variants[features] == 0 )
+	{
+		Shaders shaders;
+		for( const pair<string, int>& macro : defines )
+			shaders.define( macro.first, macro.second );
+		shaders.define( "FEATURES", static_cast<int>( features ) );
+		GLuint program = shaders.compile( vertexFile, fragmentFile );
+		const ProgramReflection& reflection = ProgramReflection::get( program );
+		for( const pair<const ProgramReflection::Uniform, GLint>& uniform : uniforms )
+			glProgramUniform1i( program, reflection[uniform.first], uniform.second );
+		variants[features] = program;
+		if( setup && program != 0 )
+		{
+			glUseProgram( program );
+			setup( program );
+		}
+	}
+	return variants[features];
+}
+
+/**
+ * Set an integer, boolean, or sampler uniform in every variant, without changing the program in use.
+ * @param u Uniform.
+ * @param value Value.
+ */
+void ShaderPermutations::setUniform( ProgramReflection::Uniform u, GLint value )
+{
+	uniforms[u] = value;
+	for( GLuint program : variants )
+	{
+		if( program != 0 )
+			glProgramUniform1i( program, ProgramReflection::get( program )[u], value );
+	}
+}
+
+/**
+ * Set the function that sends a variant the uniforms that setUniform() can't (e.g. per-frame floats and vectors), and run
+ * it on every variant compiled so far, each in use in turn; variants compiled later run it right after compiling.  The
+ * last variant set up is left in use.
+ * @param f Function of the variant's program, which is in use when called.
+ */
+void ShaderPermutations::setProgramSetup( const function<void( GLuint )>& f )
+{
+	setup = f;
+	for( GLuint program : variants )
+	{
+		if( program != 0 && setup )
+		{
+			glUseProgram( program );
+			setup( program );
+		}
+	}
+}
+
+/**
+ * @return The variants compiled so far, e.g. to send them uniforms of other types.
+ */
+vector<GLuint> ShaderPermutations::getPrograms() const
+{
+	vector<GLuint> programs;
+	for( GLuint program : variants )
+	{
+		if( program != 0 )
+			programs.push_back( program );
+	}
+	return programs;
+}
+
+/**
+ * Delete all the variants.
+ */
+void ShaderPermutations::release()
+{
+	for( GLuint& program : variants )
+	{
+		if( program != 0 )
+		{
+			glDeleteProgram( program );
+			ProgramReflection::release( program );
+			program = 0;
+		}
+	}
+}
@@ -0,0 +1,54 @@
+#ifndef OPENGL_SHADERPERMUTATIONS_H
+#define OPENGL_SHADERPERMUTATIONS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <OpenGL/gl3.h>
+#include "Shaders.h"
+#include "ProgramReflection.h"
+
+using namespace std;
+
+/**
+ * Variants of a rendering program, specialized at compile time on the draw features that its shaders would otherwise
+ * branch on at run time (see features.glsl).  Each variant is compiled once, with FEATURES defined to its feature mask
+ * right after the #version line, and cached by that mask; the OpenGL class selects the variant of every draw (see
+ * OpenGL::usePermutations), so the common textured Blinn-Phong draws run without dead branches or unused varyings.
+ *
+ * Integer uniforms (samplers and flags) are set through setUniform(), which reaches every variant, including those
+ * compiled later on.  Other uniforms (e.g. per-frame floats and vectors) are sent by a function given to
+ * setProgramSetup(), which is run on every variant too.
+ */
+class ShaderPermutations
+{
+public:
+	enum Feature								// Bits of a feature mask (must match features.glsl).
+	{
+		BLINN_PHONG = 1,
+		TEXTURE = 2,
+		POINT = 4
+	};
+	static const unsigned VARIANTS_COUNT = 8;	// Every combination of the features.
+
+private:
+	string vertexFile;
+	string fragmentFile;
+	vector<pair<string, int>> defines;			// Macros shared by every variant.
+	GLuint variants[VARIANTS_COUNT];			// Program of each feature mask, or 0 until it is first needed.
+	map<ProgramReflection::Uniform, GLint> uniforms;	// Values of the integer uniforms, set again on new variants.
+	function<void( GLuint )> setup;				// Sends the other uniforms to a variant in use; run on new variants too.
+
+public:
+	ShaderPermutations();
+	void define( const string& name, int value );
+	void init( const string& fvert, const string& ffrag, const vector<unsigned>& masks );
+	GLuint get( unsigned features );
+	void setUniform( ProgramReflection::Uniform u, GLint value );
+	void setProgramSetup( const function<void( GLuint )>& f );
+	vector<GLuint> getPrograms() const;
+	void release();
+};
+
+#endif //OPENGL_SHADERPERMUTATIONS_H
@@ -1,11 +1,13 @@
 #include "Shaders.h"
 
 /**
- * Read shader file, line by line.
+ * Read shader file, line by line.  A line of the form #include "file" is replaced by the contents of that file, which
+ * is looked up in the same directory, so that several shaders can share GLSL functions.
  * @param fname Shader file name, with relative path.
  */
 string Shaders::read( const string& fname )
 {
+	const string INCLUDE = "#include \"";
 	string content;
 	ifstream sFile( fname );
 	
@@ -13,7 +15,17 @@ string Shaders::read( const string& fname )
 	{
 		string line;
 		while( getline( sFile, line ) )
-			content += line + '\n';
+		{
+			if( line.compare( 0, INCLUDE.size(), INCLUDE ) == 0 )
+			{
+				size_t end = line.find( '"', INCLUDE.size() );
+				size_t slash = fname.find_last_of( '/' );
+				string folder = ( slash == string::npos )? "" : fname.substr( 0, slash + 1 );
+				content += read( folder + line.substr( INCLUDE.size(), end - INCLUDE.size() ) );
+			}
+			else
+				content += line + '\n';
+		}
 		
 		sFile.close();
 	}
@@ -27,57 +39,87 @@ string Shaders::read( const string& fname )
 }
 
 /**
- * Creates a program from the vertex and fragment shaders provided.
- * @param fvert Vertex shader file name, with relative path.
- * @param ffrag Fragment shader file name, with relative parth.
- * @return A shading program, otherwise, it exits the application with an error.
+ * Define a macro for the shader stages compiled from now on, e.g. to choose a compile-time permutation of a shader.
+ * Shaders may provide defaults with #ifndef blocks.
+ * @param name Macro name.
+ * @param value Macro value.
+ */
+void Shaders::define( const string& name, int value )
+{
+	defines += "#define " + name + " " + to_string( value ) + "\n";
+}
+
+/**
+ * Remove all the macros added with define().
  */
-GLuint Shaders::compile( const string& fvert, const string& ffrag )
+void Shaders::clearDefines()
+{
+	defines.clear();
+}
+
+/**
+ * Compile a shader stage.
+ * @param type GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, or GL_FRAGMENT_SHADER.
+ * @param fname Shader file name, with relative path.
+ * @return Shader object, otherwise, it exits the application with an error.
+ */
+GLuint Shaders::compileShader( GLenum type, const string& fname )
 {
 	const GLint MAXLENGTH = 500;
-	GLuint vertexShader;
-	GLuint fragmentShader;
-	GLuint program;
 	GLint compileParam;
 	GLchar compileInfoLog[MAXLENGTH+1];
 	GLint compileInfoLength;
 	
-	// Source code for vertex shader.
-	string s = read( fvert );
-	const GLchar* vertexShaderSource = s.c_str();
-	
-	// Source code for fragment shader.
-	string t = read( ffrag );
-	const GLchar* fragmentShaderSource = t.c_str();
-	
-	// Create and compile verter shader.
-	vertexShader = glCreateShader( GL_VERTEX_SHADER );
-	glShaderSource( vertexShader, 1, &vertexShaderSource, NULL );
-	glCompileShader( vertexShader );
-	glGetShaderiv( vertexShader, GL_COMPILE_STATUS, &compileParam );
-	if( compileParam == GL_FALSE )
+	// Source code for the shader, with the permutation's macros right after the #version line.
+	string s = read( fname );
+	if( !defines.empty() )
 	{
-		glGetShaderInfoLog( vertexShader, MAXLENGTH, &compileInfoLength, compileInfoLog );
-		cerr << compileInfoLog << endl;
-		exit( EXIT_FAILURE );
+		size_t version = s.find( "#version" );
+		size_t lineEnd = ( version == string::npos )? string::npos : s.find( '\n', version );
+		s.insert( ( lineEnd == string::npos )? 0 : lineEnd + 1, defines );
 	}
+	const GLchar* shaderSource = s.c_str();
 	
-	// Create and compile fragment shader.
-	fragmentShader = glCreateShader( GL_FRAGMENT_SHADER );
-	glShaderSource( fragmentShader, 1, &fragmentShaderSource, NULL );
-	glCompileShader( fragmentShader );
-	glGetShaderiv( fragmentShader, GL_COMPILE_STATUS, &compileParam );
+	// Create and compile shader.
+	GLuint shader = glCreateShader( type );
+	glShaderSource( shader, 1, &shaderSource, NULL );
+	glCompileShader( shader );
+	glGetShaderiv( shader, GL_COMPILE_STATUS, &compileParam );
 	if( compileParam == GL_FALSE )
 	{
-		glGetShaderInfoLog( fragmentShader, MAXLENGTH, &compileInfoLength, compileInfoLog );
-		cerr << compileInfoLog << endl;
+		glGetShaderInfoLog( shader, MAXLENGTH, &compileInfoLength, compileInfoLog );
+		cerr << fname << ": " << compileInfoLog << endl;
 		exit( EXIT_FAILURE );
 	}
 	
+	return shader;
+}
+
+/**
+ * Creates a program from the vertex, (optional) fragment, and (optional) geometry shaders provided.
+ * @param fvert Vertex shader file name, with relative path.
+ * @param ffrag Fragment shader file name, with relative parth, or empty for depth-only programs: without a fragment
+ * stage, rasterization still writes depth and nothing else.
+ * @param fgeom Geometry shader file name, with relative path, or empty if the program has no geometry stage.
+ * The program's uniforms and attributes are reflected right after linking (see ProgramReflection).
+ * @return A shading program, otherwise, it exits the application with an error.
+ */
+GLuint Shaders::compile( const string& fvert, const string& ffrag, const string& fgeom )
+{
+	const GLint MAXLENGTH = 500;
+	
+	// Create and compile the shaders.
+	GLuint vertexShader = compileShader( GL_VERTEX_SHADER, fvert );
+	GLuint geometryShader = ( fgeom.empty() )? 0 : compileShader( GL_GEOMETRY_SHADER, fgeom );
+	GLuint fragmentShader = ( ffrag.empty() )? 0 : compileShader( GL_FRAGMENT_SHADER, ffrag );
+	
 	// Create program, attach shaders to it, and link it.
-	program = glCreateProgram();
+	GLuint program = glCreateProgram();
 	glAttachShader( program, vertexShader );
-	glAttachShader( program, fragmentShader );
+	if( geometryShader )
+		glAttachShader( program, geometryShader );
+	if( fragmentShader )
+		glAttachShader( program, fragmentShader );
 	glLinkProgram( program );
 	
 	GLint linkParam;
@@ -93,7 +135,13 @@ GLuint Shaders::compile( const string& fvert, const string& ffrag )
 	
 	// Delete shaders since the program has them all now.
 	glDeleteShader( vertexShader );
-	glDeleteShader( fragmentShader );
+	if( geometryShader )
+		glDeleteShader( geometryShader );
+	if( fragmentShader )
+		glDeleteShader( fragmentShader );
+	
+	// Read off the uniform and attribute locations once and for all.
+	ProgramReflection::reflect( program );
 	
 	return program;
 }
@@ -5,16 +5,22 @@
 #include <fstream>
 #include <string>
 #include <OpenGL/gl3.h>
+#include "ProgramReflection.h"
 
 using namespace std;
 
 class Shaders
 {
 private:
+	string defines;					// #define lines inserted after the #version line of every stage compiled.
+	
 	string read( const string& fname );
+	GLuint compileShader( GLenum type, const string& fname );
 	
 public:
-	GLuint compile( const string& fvert, const string& ffrag );
+	void define( const string& name, int value );
+	void clearDefines();
+	GLuint compile( const string& fvert, const string& ffrag, const string& fgeom = "" );
 };
 
 #endif /* shaders_h */
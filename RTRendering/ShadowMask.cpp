@@ -0,0 +1,165 @@
+#include "ShadowMask.h"
+#include "ProgramReflection.h"
+#include "OpenGL.h"
+
+#include <algorithm>
+
+/**
+ * Compile the mask program and bind its shadow map samplers.  Textures are allocated by resize().
+ * @param shadowMapsUnit Texture unit of the layered shadow maps.
+ * @param shadowCompareUnit Texture unit of the shadow maps with the depth-compare sampler.
+ * @param depthPyramidUnit Texture unit of the shadow maps' min/max depth pyramid.
+ * @param shadowMomentsUnit Texture unit of the EVSM moments of the shadow maps.
+ */
+void ShadowMask::init( GLint shadowMapsUnit, GLint shadowCompareUnit, GLint depthPyramidUnit, GLint shadowMomentsUnit )
+{
+	Shaders shaders;
+	shaders.define( "PCF_SAMPLES", conf::PCF_SAMPLES );
+	program = shaders.compile( conf::SHADERS_FOLDER + "shadowcopy.vert", conf::SHADERS_FOLDER + "shadowmask.frag" );
+	if( program == 0 )
+	{
+		cerr << "Failed to compile shadow mask shaders program!" << endl;
+		exit( EXIT_FAILURE );
+	}
+	const ProgramReflection& reflection = ProgramReflection::get( program );
+	glUseProgram( program );
+	glUniform1i( reflection[ProgramReflection::SHADOW_MAPS], shadowMapsUnit );
+	glUniform1i( reflection[ProgramReflection::SHADOW_MAPS_COMPARE], shadowCompareUnit );
+	glUniform1i( reflection[ProgramReflection::DEPTH_PYRAMID], depthPyramidUnit );
+	glUniform1i( reflection[ProgramReflection::SHADOW_MOMENTS], shadowMomentsUnit );
+
+	glGenFramebuffers( 1, &depthFramebufferID );
+	glGenFramebuffers( 1, &maskFramebufferID );
+	glGenTextures( 1, &depthTextureID );
+	glGenTextures( 1, &maskTextureID );
+	glGenVertexArrays( 1, &vertexArrayID );
+}
+
+/**
+ * (Re)allocate the depth and mask textures and attach them to their framebuffers.
+ */
+void ShadowMask::allocate()
+{
+	glBindTexture( GL_TEXTURE_2D, depthTextureID );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, depthFramebufferID );
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTextureID, 0 );
+	glDrawBuffer( GL_NONE );
+	glReadBuffer( GL_NONE );
+	if( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+	{
+		cerr << "Scene depth framebuffer is not complete!" << endl;
+		exit( EXIT_FAILURE );
+	}
+
+	const GLsizei maskWidth = ( width + scale - 1 ) / scale, maskHeight = ( height + scale - 1 ) / scale;
+	glBindTexture( GL_TEXTURE_2D, maskTextureID );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA16F, maskWidth, maskHeight, 0, GL_RGBA, GL_HALF_FLOAT, nullptr );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, maskFramebufferID );
+	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, maskTextureID, 0 );
+	glDrawBuffer( GL_COLOR_ATTACHMENT0 );
+	if( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+	{
+		cerr << "Shadow mask framebuffer is not complete!" << endl;
+		exit( EXIT_FAILURE );
+	}
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+/**
+ * Match the framebuffer size and the requested mask resolution, reallocating only if either changed.
+ * @param fullWidth Framebuffer width.
+ * @param fullHeight Framebuffer height.
+ * @param divisor Mask resolution divisor: 2 for half, 4 for quarter resolution.
+ */
+void ShadowMask::resize( GLsizei fullWidth, GLsizei fullHeight, GLint divisor )
+{
+	if( fullWidth == width && fullHeight == height && divisor == scale )
+		return;
+
+	width = max( fullWidth, 1 );
+	height = max( fullHeight, 1 );
+	scale = max( divisor, 1 );
+	allocate();
+}
+
+/**
+ * Bind the full resolution depth framebuffer, for the caller to render the scene's depth into it.
+ */
+void ShadowMask::bindDepthFramebuffer() const
+{
+	glBindFramebuffer( GL_FRAMEBUFFER, depthFramebufferID );
+}
+
+/**
+ * Evaluate the shadows of the laid-down depth into the mask.  The frame data uniform buffer must hold the camera pass'
+ * light space matrices and light positions.  Leaves the default framebuffer bound and the viewport to the caller.
+ * @param Projection The 4x4 camera projection matrix the depth was rendered with.
+ * @param View The 4x4 camera view matrix.
+ * @param depthUnit Texture unit to read the scene depth through.
+ * @param useDepthPyramid Whether PCSS should skip the regions classified by the depth pyramid.
+ */
+void ShadowMask::build( const mat44& Projection, const mat44& View, GLint depthUnit, bool useDepthPyramid )
+{
+	const ProgramReflection& reflection = ProgramReflection::get( program );
+	float inverseProjection[ELEMENTS_PER_MATRIX], inverseView[ELEMENTS_PER_MATRIX];
+	Tx::toOpenGLMatrix( inverseProjection, inv( Projection ) );
+	Tx::toOpenGLMatrix( inverseView, inv( View ) );
+
+	glUseProgram( program );
+	glUniformMatrix4fv( reflection[ProgramReflection::INVERSE_PROJECTION], 1, GL_FALSE, inverseProjection );
+	glUniformMatrix4fv( reflection[ProgramReflection::INVERSE_VIEW], 1, GL_FALSE, inverseView );
+	glUniform1i( reflection[ProgramReflection::SCENE_DEPTH], depthUnit );
+	glUniform1i( reflection[ProgramReflection::SHADOW_MASK_SCALE], scale );
+	glUniform1i( reflection[ProgramReflection::USE_DEPTH_PYRAMID], useDepthPyramid );
+
+	glActiveTexture( GL_TEXTURE0 + depthUnit );
+	glBindTexture( GL_TEXTURE_2D, depthTextureID );
+	glBindFramebuffer( GL_FRAMEBUFFER, maskFramebufferID );
+	glViewport( 0, 0, ( width + scale - 1 ) / scale, ( height + scale - 1 ) / scale );
+	glDisable( GL_DEPTH_TEST );
+	glBindVertexArray( vertexArrayID );
+	glDrawArrays( GL_TRIANGLES, 0, 3 );
+	glEnable( GL_DEPTH_TEST );
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+}
+
+/**
+ * Free the OpenGL objects.
+ */
+void ShadowMask::release()
+{
+	glDeleteFramebuffers( 1, &depthFramebufferID );
+	glDeleteFramebuffers( 1, &maskFramebufferID );
+	glDeleteTextures( 1, &depthTextureID );
+	glDeleteTextures( 1, &maskTextureID );
+	glDeleteVertexArrays( 1, &vertexArrayID );
+	glDeleteProgram( program );
+	ProgramReflection::release( program );
+}
+
+/**
+ * @return Texture ID of the shadow mask.
+ */
+GLuint ShadowMask::getTextureID() const
+{
+	return maskTextureID;
+}
+
+/**
+ * @return Mask resolution divisor.
+ */
+GLint ShadowMask::getScale() const
+{
+	return scale;
+}
@@ -0,0 +1,48 @@
+#ifndef OPENGL_SHADOWMASK_H
+#define OPENGL_SHADOWMASK_H
+
+#include <iostream>
+#include <armadillo>
+#include <OpenGL/gl3.h>
+#include "Shaders.h"
+#include "Transformations.h"
+
+#include "Configuration.h"
+
+using namespace std;
+using namespace arma;
+
+/**
+ * Screen-space shadow visibility for the camera pass.  The scene's depth is laid down first into a full resolution depth
+ * texture; then a full-screen pass at 1/2 or 1/4 of the resolution reconstructs each pixel's position and normal from
+ * it, and evaluates the shadows of the first three lights once (with PCSS or EVSM).  The mask keeps the shadow of light i
+ * in channel i and the view depth in alpha, so that shader.frag can upsample it with a depth-aware (bilateral) filter
+ * instead of evaluating PCSS on every fragment, including those that are later overdrawn.  Any further lights are
+ * shadowed per fragment.
+ */
+class ShadowMask
+{
+private:
+	GLuint depthFramebufferID = 0;
+	GLuint depthTextureID = 0;				// Scene depth at full resolution.
+	GLuint maskFramebufferID = 0;
+	GLuint maskTextureID = 0;				// RGBA16F: shadow of lights 0, 1, 2, and view depth.
+	GLuint program = 0;						// Mask program.
+	GLuint vertexArrayID = 0;				// Empty: the full-screen triangle is generated in the vertex shader.
+	GLsizei width = 0;						// Full resolution.
+	GLsizei height = 0;
+	GLint scale = 0;						// Mask resolution divisor.
+
+	void allocate();
+
+public:
+	void init( GLint shadowMapsUnit, GLint shadowCompareUnit, GLint depthPyramidUnit, GLint shadowMomentsUnit );
+	void resize( GLsizei fullWidth, GLsizei fullHeight, GLint divisor );
+	void bindDepthFramebuffer() const;
+	void build( const mat44& Projection, const mat44& View, GLint depthUnit, bool useDepthPyramid );
+	void release();
+	GLuint getTextureID() const;
+	GLint getScale() const;
+};
+
+#endif //OPENGL_SHADOWMASK_H
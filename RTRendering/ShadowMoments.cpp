@@ -0,0 +1,144 @@
+#include "ShadowMoments.h"
+#include "ProgramReflection.h"
+
+#include <algorithm>
+
+/**
+ * Allocate the moments for a layered shadow map and compile the warping and blurring program.
+ * @param shadowMapSide Shadow maps width and height.
+ * @param shadowMapLayers Number of shadow map layers.
+ * @param divisor Shadow map texels per moment texel, along each axis (RGBA32F moments are four times as large).
+ * @param shadowMapsUnit Texture unit of the layered shadow maps.
+ * @param depthPyramidUnit Texture unit of the shadow maps' min/max depth pyramid.
+ */
+void ShadowMoments::init( GLsizei shadowMapSide, GLsizei shadowMapLayers, GLint divisor, GLint shadowMapsUnit, GLint depthPyramidUnit )
+{
+	divisor = max( divisor, 1 );
+	side = max( shadowMapSide / divisor, 1 );
+	layers = shadowMapLayers;
+	GLint levels = 1;
+	while( ( side >> levels ) > 0 )
+		levels++;
+
+	Shaders shaders;
+	program = shaders.compile( conf::SHADERS_FOLDER + "shadowcopy.vert", conf::SHADERS_FOLDER + "shadowmoments.frag", conf::SHADERS_FOLDER + "shadowcopy.geom" );
+	if( program == 0 )
+	{
+		cerr << "Failed to compile shadow moments shaders program!" << endl;
+		exit( EXIT_FAILURE );
+	}
+	const ProgramReflection& reflection = ProgramReflection::get( program );
+	glUseProgram( program );
+	glUniform1i( reflection[ProgramReflection::LAYERS_COUNT], layers );
+	glUniform1i( reflection[ProgramReflection::SHADOW_MAPS], shadowMapsUnit );
+	glUniform1i( reflection[ProgramReflection::DEPTH_PYRAMID], depthPyramidUnit );
+	glUniform1i( reflection[ProgramReflection::MOMENTS_SCALE], divisor );
+
+	// 32-bit floats are needed to hold the squared positive warp; linear filtering and mipmaps do the rest of the blur.
+	glGenTextures( 1, &momentsTextureID );
+	glBindTexture( GL_TEXTURE_2D_ARRAY, momentsTextureID );
+	for( GLint level = 0; level < levels; level++ )
+		glTexImage3D( GL_TEXTURE_2D_ARRAY, level, GL_RGBA32F, max( side >> level, 1 ), max( side >> level, 1 ), layers, 0, GL_RGBA, GL_FLOAT, nullptr );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0 );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1 );
+
+	glGenTextures( 1, &blurTextureID );
+	glBindTexture( GL_TEXTURE_2D_ARRAY, blurTextureID );
+	glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_RGBA32F, side, side, layers, 0, GL_RGBA, GL_FLOAT, nullptr );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0 );
+
+	momentsFramebufferID = createLayeredFramebuffer( momentsTextureID, "Shadow moments" );
+	blurFramebufferID = createLayeredFramebuffer( blurTextureID, "Shadow moments blur" );
+
+	glGenVertexArrays( 1, &vertexArrayID );
+}
+
+/**
+ * Create a framebuffer with all the layers of a texture's level 0 attached as its color buffer.
+ * @param textureID Texture array.
+ * @param name Name for the error message.
+ * @return Framebuffer ID.  Leaves the default framebuffer bound.
+ */
+GLuint ShadowMoments::createLayeredFramebuffer( GLuint textureID, const char* name ) const
+{
+	GLuint framebufferID;
+	glGenFramebuffers( 1, &framebufferID );
+	glBindFramebuffer( GL_FRAMEBUFFER, framebufferID );
+	glFramebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureID, 0 );		// Layered attachment.
+	glDrawBuffer( GL_COLOR_ATTACHMENT0 );
+	if( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+	{
+		cerr << name << " framebuffer is not complete!" << endl;
+		exit( EXIT_FAILURE );
+	}
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	return framebufferID;
+}
+
+/**
+ * Warp, blur, and mipmap the moments of the current shadow maps, which must be bound to the shadow maps unit, and their
+ * rebuilt pyramid to the depth pyramid unit, given to init().  Leaves the moments bound to the given texture unit, the
+ * default framebuffer bound, and the viewport to be restored by the caller.
+ * @param unit Texture unit to read the moments through between passes.
+ */
+void ShadowMoments::build( GLint unit )
+{
+	const ProgramReflection& reflection = ProgramReflection::get( program );
+	glUseProgram( program );
+	glUniform1i( reflection[ProgramReflection::SOURCE_MOMENTS], unit );
+	glBindVertexArray( vertexArrayID );
+	glViewport( 0, 0, side, side );
+	glActiveTexture( GL_TEXTURE0 + unit );
+
+	// Warp the shadow map depths into level 0 (the source moments aren't read; just keep the attachment away from them).
+	glBindTexture( GL_TEXTURE_2D_ARRAY, blurTextureID );
+	glBindFramebuffer( GL_FRAMEBUFFER, momentsFramebufferID );
+	glUniform1i( reflection[ProgramReflection::FROM_SHADOW_MAPS], true );
+	glDrawArrays( GL_TRIANGLES, 0, 3 );
+
+	// Horizontal blur into the scratch texture, and vertical blur back into level 0.
+	glUniform1i( reflection[ProgramReflection::FROM_SHADOW_MAPS], false );
+	glBindTexture( GL_TEXTURE_2D_ARRAY, momentsTextureID );
+	glBindFramebuffer( GL_FRAMEBUFFER, blurFramebufferID );
+	glUniform2i( reflection[ProgramReflection::BLUR_DIRECTION], 1, 0 );
+	glDrawArrays( GL_TRIANGLES, 0, 3 );
+
+	glBindTexture( GL_TEXTURE_2D_ARRAY, blurTextureID );
+	glBindFramebuffer( GL_FRAMEBUFFER, momentsFramebufferID );
+	glUniform2i( reflection[ProgramReflection::BLUR_DIRECTION], 0, 1 );
+	glDrawArrays( GL_TRIANGLES, 0, 3 );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	glBindTexture( GL_TEXTURE_2D_ARRAY, momentsTextureID );
+	glGenerateMipmap( GL_TEXTURE_2D_ARRAY );
+}
+
+/**
+ * Free the OpenGL objects.
+ */
+void ShadowMoments::release()
+{
+	glDeleteFramebuffers( 1, &momentsFramebufferID );
+	glDeleteFramebuffers( 1, &blurFramebufferID );
+	glDeleteTextures( 1, &momentsTextureID );
+	glDeleteTextures( 1, &blurTextureID );
+	glDeleteVertexArrays( 1, &vertexArrayID );
+	glDeleteProgram( program );
+	ProgramReflection::release( program );
+}
+
+/**
+ * @return Texture ID of the layered, mipmapped EVSM moments.
+ */
+GLuint ShadowMoments::getTextureID() const
+{
+	return momentsTextureID;
+}
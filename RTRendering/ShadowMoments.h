@@ -0,0 +1,39 @@
+#ifndef OPENGL_SHADOWMOMENTS_H
+#define OPENGL_SHADOWMOMENTS_H
+
+#include <iostream>
+#include <OpenGL/gl3.h>
+#include "Shaders.h"
+
+#include "Configuration.h"
+
+using namespace std;
+
+/**
+ * Exponential variance shadow maps (EVSM) of the layered shadow maps, for the lights that trade PCSS quality for speed.
+ * Each texel keeps the positive and negative exponential warps of depth and their squares, box-filtered down from the
+ * shadow maps.  The moments are then blurred with a separable Gaussian whose width follows the penumbra estimated from
+ * the min/max depth pyramid, and mipmapped, so that shading costs one trilinear fetch per light.
+ */
+class ShadowMoments
+{
+private:
+	GLuint momentsTextureID = 0;			// GL_TEXTURE_2D_ARRAY with RGBA32F moments and a full mip chain.
+	GLuint blurTextureID = 0;				// Level 0 only: output of the horizontal blur pass.
+	GLuint momentsFramebufferID = 0;
+	GLuint blurFramebufferID = 0;
+	GLuint program = 0;						// Warping and blurring program.
+	GLuint vertexArrayID = 0;				// Empty: the full-screen triangle is generated in the vertex shader.
+	GLsizei side = 0;						// Level 0 width and height.
+	GLsizei layers = 0;
+
+	GLuint createLayeredFramebuffer( GLuint textureID, const char* name ) const;
+
+public:
+	void init( GLsizei shadowMapSide, GLsizei shadowMapLayers, GLint divisor, GLint shadowMapsUnit, GLint depthPyramidUnit );
+	void build( GLint unit );
+	void release();
+	GLuint getTextureID() const;
+};
+
+#endif //OPENGL_SHADOWMOMENTS_H
@@ -0,0 +1,78 @@
+#include "VertexArray.h"
+
+/**
+ * Create a vertex array object that reads the attributes described by a vertex format from a buffer.
+ * The new vertex array object is left bound, so index data can be uploaded right away through GL_ELEMENT_ARRAY_BUFFER.
+ * @param format Layout of the vertices in the buffer.
+ * @param bufferID Vertex buffer (it's left bound to GL_ARRAY_BUFFER; it may still lack its data store).
+ * @param indexBufferID Element buffer with the triangle indices, or 0 for non-indexed geometry.
+ * @return OpenGL vertex array object ID.
+ */
+GLuint VertexArray::create( const VertexFormat& format, GLuint bufferID, GLuint indexBufferID )
+{
+	GLuint vertexArrayID;
+	glGenVertexArrays( 1, &vertexArrayID );
+	glBindVertexArray( vertexArrayID );
+	glBindBuffer( GL_ARRAY_BUFFER, bufferID );
+
+	setAttribute( POSITION_LOCATION, format.position, format.stride );
+	setAttribute( NORMAL_LOCATION, format.normal, format.stride );
+	setAttribute( TEXCOORDS_LOCATION, format.texCoords, format.stride );
+
+	if( indexBufferID != 0 )
+		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBufferID );		// The element buffer binding is part of the vertex array state.
+
+	return vertexArrayID;
+}
+
+/**
+ * Add per-instance model and normal matrices to the bound vertex array object.
+ * The instance buffer is left bound to GL_ARRAY_BUFFER, holding a single identity instance so that it is never read
+ * out of bounds before the first instanced draw.
+ * @param instanceBufferID Buffer with INSTANCE_ELEMENTS floats per instance.
+ */
+void VertexArray::setInstanceAttributes( GLuint instanceBufferID )
+{
+	const GLfloat identity[INSTANCE_ELEMENTS] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1,		// Model.
+												  1, 0, 0,  0, 1, 0,  0, 0, 1 };						// Normal matrix.
+	const GLsizei stride = INSTANCE_ELEMENTS * sizeof( GLfloat );
+
+	glBindBuffer( GL_ARRAY_BUFFER, instanceBufferID );
+	glBufferData( GL_ARRAY_BUFFER, sizeof( identity ), identity, GL_STREAM_DRAW );
+	for( GLuint c = 0; c < 4; c++ )									// Matrices are fed one column per location.
+	{
+		glEnableVertexAttribArray( INSTANCE_MODEL_LOCATION + c );
+		glVertexAttribPointer( INSTANCE_MODEL_LOCATION + c, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>( 4 * c * sizeof( GLfloat ) ) );
+		glVertexAttribDivisor( INSTANCE_MODEL_LOCATION + c, 1 );
+	}
+	for( GLuint c = 0; c < 3; c++ )
+	{
+		glEnableVertexAttribArray( INSTANCE_NORMAL_LOCATION + c );
+		glVertexAttribPointer( INSTANCE_NORMAL_LOCATION + c, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>( ( 16 + 3 * c ) * sizeof( GLfloat ) ) );
+		glVertexAttribDivisor( INSTANCE_NORMAL_LOCATION + c, 1 );
+	}
+}
+
+/**
+ * Enable and set up a single vertex attribute array of the bound vertex array object.
+ * @param location Fixed attribute location.
+ * @param attribute Encoding and offset of the attribute (nothing is done if vertices don't have it).
+ * @param stride Bytes per vertex.
+ */
+void VertexArray::setAttribute( GLuint location, const VertexFormat::Attribute& attribute, GLsizei stride )
+{
+	if( attribute.type == VertexFormat::NONE )
+		return;
+
+	GLenum type;
+	switch( attribute.type )
+	{
+		case VertexFormat::INT16: type = GL_SHORT; break;
+		case VertexFormat::INT_2_10_10_10_REV: type = GL_INT_2_10_10_10_REV; break;
+		case VertexFormat::HALF_FLOAT: type = GL_HALF_FLOAT; break;
+		default: type = GL_FLOAT;
+	}
+	glEnableVertexAttribArray( location );
+	glVertexAttribPointer( location, attribute.components, type, ( attribute.normalized != 0 )? GL_TRUE : GL_FALSE, stride,
+						   reinterpret_cast<const void*>( static_cast<size_t>( attribute.offset ) ) );
+}
@@ -0,0 +1,30 @@
+#ifndef OPENGL_VERTEXARRAY_H
+#define OPENGL_VERTEXARRAY_H
+
+#include <OpenGL/gl3.h>
+#include "VertexFormat.h"
+
+/**
+ * Vertex array objects for interleaved vertex buffers.  Every shader program that draws meshes declares its vertex
+ * inputs at the fixed locations below, so a single vertex array object per mesh serves all programs, and drawing a
+ * mesh takes one glBindVertexArray instead of re-specifying its attributes.  Meshes that are drawn instanced also
+ * read per-instance model and normal matrices from an instance buffer.
+ */
+class VertexArray
+{
+private:
+	static void setAttribute( GLuint location, const VertexFormat::Attribute& attribute, GLsizei stride );
+
+public:
+	static const GLuint POSITION_LOCATION = 0;		// Must match the layout( location = N ) qualifiers in the vertex shaders.
+	static const GLuint NORMAL_LOCATION = 1;
+	static const GLuint TEXCOORDS_LOCATION = 2;
+	static const GLuint INSTANCE_MODEL_LOCATION = 3;		// Per-instance model matrix: a mat4 takes locations 3 to 6.
+	static const GLuint INSTANCE_NORMAL_LOCATION = 7;		// Per-instance normal matrix: a mat3 takes locations 7 to 9.
+	static const GLsizei INSTANCE_ELEMENTS = 16 + 9;		// Floats per instance: model matrix and normal matrix, column-major.
+
+	static GLuint create( const VertexFormat& format, GLuint bufferID, GLuint indexBufferID = 0 );
+	static void setInstanceAttributes( GLuint instanceBufferID );
+};
+
+#endif //OPENGL_VERTEXARRAY_H
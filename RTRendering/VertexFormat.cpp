@@ -0,0 +1,242 @@
+#include "VertexFormat.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+/**
+ * Build the interleaved layout for a mesh.
+ * @param encoding Whether positions are stored as floats or as 16-bit integers.
+ * @param withNormals Whether vertices have normals.
+ * @param withUVs Whether vertices have texture coordinates.
+ * @param boundsMin Minimum corner of the mesh bounding box (needed only for quantized positions; defaults to -1s).
+ * @param boundsMax Maximum corner of the mesh bounding box (needed only for quantized positions; defaults to +1s).
+ * @return Vertex format.
+ */
+VertexFormat VertexFormat::create( PositionEncoding encoding, bool withNormals, bool withUVs, const float* boundsMin, const float* boundsMax )
+{
+	VertexFormat format;
+	memset( &format, 0, sizeof( format ) );
+	uint32_t offset = 0;
+
+	// Positions: 3 floats, or 3 integers padded to 4 so that the next attribute stays 4-byte aligned.
+	format.position = { ( encoding == INT16_POSITIONS )? INT16 : FLOAT32, 3, 0, offset };
+	offset += ( encoding == INT16_POSITIONS )? 4 * sizeof( int16_t ) : 3 * sizeof( float );
+	for( int j = 0; j < 3; j++ )
+	{
+		format.positionScale[j] = 1;
+		format.positionOffset[j] = 0;
+		if( encoding == INT16_POSITIONS )
+		{
+			float lo = ( boundsMin != nullptr )? boundsMin[j] : -1.0f;
+			float hi = ( boundsMax != nullptr )? boundsMax[j] : 1.0f;
+			format.positionOffset[j] = ( lo + hi ) / 2.0f;								// Center of the box maps to 0.
+			format.positionScale[j] = max( ( hi - lo ) / 2.0f, 1e-20f ) / INT16_MAX;		// Half extent maps to 32767.
+		}
+	}
+
+	if( withNormals )
+	{
+		format.normal = { INT_2_10_10_10_REV, 4, 1, offset };
+		offset += sizeof( uint32_t );
+	}
+
+	if( withUVs )
+	{
+		format.texCoords = { HALF_FLOAT, 2, 0, offset };
+		offset += 2 * sizeof( uint16_t );
+	}
+
+	format.stride = offset;
+	return format;
+}
+
+/**
+ * Write vertices in this format.
+ * @param nVertices Number of vertices.
+ * @param positions Positions as x, y, z triplets.
+ * @param normals Normals as x, y, z triplets (ignored if the format has no normals).
+ * @param uvs Texture coordinates as u, v pairs (ignored if the format has no texture coordinates).
+ * @param out Destination of nVertices * stride bytes.
+ */
+void VertexFormat::encode( size_t nVertices, const float* positions, const float* normals, const float* uvs, uint8_t* out ) const
+{
+	memset( out, 0, nVertices * stride );
+	for( size_t i = 0; i < nVertices; i++ )
+	{
+		uint8_t* vertex = out + i * stride;
+		const float* p = &positions[3 * i];
+		if( position.type == INT16 )
+		{
+			int16_t q[3];
+			for( int j = 0; j < 3; j++ )
+			{
+				float value = roundf( ( p[j] - positionOffset[j] ) / positionScale[j] );
+				q[j] = static_cast<int16_t>( max( -32767.0f, min( value, 32767.0f ) ) );
+			}
+			memcpy( vertex + position.offset, q, sizeof( q ) );
+		}
+		else
+			memcpy( vertex + position.offset, p, 3 * sizeof( float ) );
+
+		if( normal.type != NONE )
+		{
+			uint32_t packed = packNormal( &normals[3 * i] );
+			memcpy( vertex + normal.offset, &packed, sizeof( packed ) );
+		}
+
+		if( texCoords.type != NONE )
+		{
+			uint16_t h[2] = { toHalf( uvs[2 * i] ), toHalf( uvs[2 * i + 1] ) };
+			memcpy( vertex + texCoords.offset, h, sizeof( h ) );
+		}
+	}
+}
+
+/**
+ * Layout of a stream with just the positions of this format, for depth-only passes: fewer bytes per vertex to fetch,
+ * and the same encoding and dequantization, so that positions (and depths) come out bit-for-bit identical.
+ * @return Vertex format without normals or texture coordinates.
+ */
+VertexFormat VertexFormat::positionsOnly() const
+{
+	VertexFormat format = *this;
+	format.position.offset = 0;
+	format.normal = { NONE, 0, 0, 0 };
+	format.texCoords = { NONE, 0, 0, 0 };
+	format.stride = ( position.type == INT16 )? 4 * sizeof( int16_t ) : 3 * sizeof( float );	// Same padding as create().
+	return format;
+}
+
+/**
+ * Copy the positions out of vertices in this format into the layout given by positionsOnly().
+ * @param nVertices Number of vertices.
+ * @param vertices Source of nVertices * stride bytes.
+ * @param out Destination of nVertices * positionsOnly().stride bytes.
+ */
+void VertexFormat::extractPositions( size_t nVertices, const uint8_t* vertices, uint8_t* out ) const
+{
+	const uint32_t outStride = positionsOnly().stride;
+	for( size_t i = 0; i < nVertices; i++ )
+		memcpy( out + i * outStride, vertices + i * stride + position.offset, outStride );
+}
+
+/**
+ * How positions are stored.
+ * @return FLOAT_POSITIONS or INT16_POSITIONS.
+ */
+VertexFormat::PositionEncoding VertexFormat::getPositionEncoding() const
+{
+	return ( position.type == INT16 )? INT16_POSITIONS : FLOAT_POSITIONS;
+}
+
+/**
+ * Pack a unit vector into a signed 2_10_10_10_REV integer: x in the low 10 bits, then y, then z, and w = 0.
+ * @param n Vector x, y, z in [-1, 1].
+ * @return Packed vector.
+ */
+uint32_t VertexFormat::packNormal( const float* n )
+{
+	uint32_t packed = 0;
+	for( int j = 0; j < 3; j++ )
+	{
+		int32_t value = static_cast<int32_t>( roundf( max( -1.0f, min( n[j], 1.0f ) ) * 511.0f ) );
+		packed |= ( static_cast<uint32_t>( value ) & 0x3FF ) << ( 10 * j );
+	}
+	return packed;
+}
+
+/**
+ * Unpack a signed 2_10_10_10_REV vector the way OpenGL 4.1 fetches it.
+ * @param packed Packed vector.
+ * @param normalized Whether the attribute is normalized: components are then max( c / 511, -1 ), else just c.
+ * @param n Output x, y, z.
+ */
+void VertexFormat::unpackNormal( uint32_t packed, bool normalized, float* n )
+{
+	for( int j = 0; j < 3; j++ )
+	{
+		int32_t value = static_cast<int32_t>( ( packed >> ( 10 * j ) ) & 0x3FF );
+		if( value & 0x200 )
+			value -= 0x400;												// Sign-extend the 10 bits.
+		n[j] = ( normalized )? max( value / 511.0f, -1.0f ) : static_cast<float>( value );
+	}
+}
+
+/**
+ * Encode unit vectors (the axes, diagonals, and values next to the rounding steps) through create() and encode(), and
+ * check that the fetched normals come back within half a quantization step.
+ * @return True if the normals encoding round-trips, false otherwise.
+ */
+bool VertexFormat::checkNormalRoundTrip()
+{
+	const float d = 1.0f / sqrtf( 3.0f );
+	const float e = 0.5f / 511.0f;
+	const float normals[] = { 1, 0, 0,   -1, 0, 0,   0, 1, 0,   0, -1, 0,   0, 0, 1,   0, 0, -1,
+							  d, d, d,   -d, -d, -d,   d, -d, d,   0.6f, -0.8f, 0,   -1 + e, 1 - e, e };
+	const size_t nVertices = sizeof( normals ) / ( 3 * sizeof( float ) );
+	const float positions[3 * nVertices] = {};
+
+	VertexFormat format = create( FLOAT_POSITIONS, true, false );
+	if( format.normal.type != INT_2_10_10_10_REV || format.normal.components < 3 )
+		return false;
+
+	uint8_t vertices[nVertices * 32];
+	if( format.stride > 32 )
+		return false;
+	format.encode( nVertices, positions, normals, nullptr, vertices );
+	for( size_t i = 0; i < nVertices; i++ )
+	{
+		uint32_t packed;
+		memcpy( &packed, vertices + i * format.stride + format.normal.offset, sizeof( packed ) );
+		float n[3];
+		unpackNormal( packed, format.normal.normalized != 0, n );
+		for( int j = 0; j < 3; j++ )
+		{
+			if( fabsf( n[j] - normals[3 * i + j] ) > e * 1.001f )
+				return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Convert a float to IEEE 754 half precision, rounding to nearest even.
+ * @param f Value.
+ * @return Half-precision bits.
+ */
+uint16_t VertexFormat::toHalf( float f )
+{
+	uint32_t x;
+	memcpy( &x, &f, sizeof( x ) );
+	const uint32_t sign = ( x >> 16 ) & 0x8000;
+	const uint32_t biased = ( x >> 23 ) & 0xFF;
+	const int32_t exponent = static_cast<int32_t>( biased ) - 127 + 15;
+	uint32_t mantissa = x & 0x7FFFFF;
+
+	if( biased == 0xFF )												// Infinity or NaN.
+		return static_cast<uint16_t>( sign | 0x7C00 | ( mantissa? 0x200 : 0 ) );
+	if( exponent >= 31 )												// Too large: infinity.
+		return static_cast<uint16_t>( sign | 0x7C00 );
+
+	uint32_t half, remainder, halfway;
+	if( exponent <= 0 )													// Subnormal half (or zero).
+	{
+		if( exponent < -10 )
+			return static_cast<uint16_t>( sign );
+		mantissa |= 0x800000;
+		const uint32_t shift = static_cast<uint32_t>( 14 - exponent );
+		half = mantissa >> shift;
+		remainder = mantissa & ( ( 1u << shift ) - 1 );
+		halfway = 1u << ( shift - 1 );
+	}
+	else
+	{
+		half = ( static_cast<uint32_t>( exponent ) << 10 ) | ( mantissa >> 13 );
+		remainder = mantissa & 0x1FFF;
+		halfway = 0x1000;
+	}
+	if( remainder > halfway || ( remainder == halfway && ( half & 1 ) ) )
+		half++;															// May carry into the exponent, which is still correct.
+	return static_cast<uint16_t>( sign | half );
+}
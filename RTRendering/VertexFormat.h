@@ -0,0 +1,54 @@
+#ifndef OPENGL_VERTEXFORMAT_H
+#define OPENGL_VERTEXFORMAT_H
+
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Layout of an interleaved vertex stream: which attributes each vertex has, how they are encoded, and where they are
+ * within the vertex.  A format is built once per mesh, from its bounds, and travels with the vertex buffer so that
+ * drawing never recomputes offsets.  Positions are either 32-bit floats or 16-bit integers quantized over the mesh
+ * bounds (the vertex shader dequantizes them with positionScale and positionOffset); normals are packed as signed,
+ * normalized 2_10_10_10_REV integers; texture coordinates are half floats.
+ *
+ * Normal components are written as round( n * 511 ), so -1 is stored as -511 and -512 is never produced.  OpenGL 4.1
+ * decodes a signed normalized c as max( c / 511, -1 ), which gives back n within half a step; checkNormalRoundTrip()
+ * verifies this convention against create() and encode(), so that a format change can't silently break it.
+ *
+ * This class doesn't depend on OpenGL and is trivially copyable, so it can be stored as-is in mesh caches.
+ */
+class VertexFormat
+{
+public:
+	enum AttributeType : uint32_t { NONE = 0, FLOAT32, INT16, INT_2_10_10_10_REV, HALF_FLOAT };
+	enum PositionEncoding : uint32_t { FLOAT_POSITIONS = 0, INT16_POSITIONS };
+
+	struct Attribute
+	{
+		uint32_t type;						// One of AttributeType; NONE if vertices lack this attribute.
+		uint32_t components;				// Number of components read by the shader.
+		uint32_t normalized;				// Nonzero if integers are mapped to [-1, 1] when fetched.
+		uint32_t offset;					// Byte offset within a vertex.
+	};
+
+	Attribute position;
+	Attribute normal;
+	Attribute texCoords;
+	uint32_t stride;						// Bytes per vertex.
+	float positionScale[3];					// Dequantization: position = stored * positionScale + positionOffset.
+	float positionOffset[3];
+
+	static VertexFormat create( PositionEncoding encoding, bool withNormals, bool withUVs, const float* boundsMin = nullptr, const float* boundsMax = nullptr );
+	void encode( size_t nVertices, const float* positions, const float* normals, const float* uvs, uint8_t* out ) const;
+	VertexFormat positionsOnly() const;
+	void extractPositions( size_t nVertices, const uint8_t* vertices, uint8_t* out ) const;
+	PositionEncoding getPositionEncoding() const;
+	static uint32_t packNormal( const float* n );
+	static void unpackNormal( uint32_t packed, bool normalized, float* n );
+	static bool checkNormalRoundTrip();
+	static uint16_t toHalf( float f );
+};
+
+#endif //OPENGL_VERTEXFORMAT_H
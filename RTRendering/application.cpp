@@ -6,9 +6,16 @@
 #include <armadillo>
 #include <OpenGL/gl3.h>
 #include <string>
+#include <functional>
 #include "GLFW/glfw3.h"
 #include "ArcBall/Ball.h"
 #include "OpenGL.h"
+#include "DepthPyramid.h"
+#include "ShadowMask.h"
+#include "ShadowMoments.h"
+#include "LightClusters.h"
+#include "DeferredShading.h"
+#include "PassTimers.h"
 #include "Transformations.h"
 
 using namespace std;
@@ -31,6 +38,15 @@ bool gLocked;							// Track if mouse button is pressed down.
 bool gUsingArrowKey;					// Track if we are using the arrow keys for rotating scene.
 bool gRotatingLights;					// Enable/disable rotating lights about the scene.
 bool gRotatingCamera;					// Enable/disable rotating camera.
+bool gFrustumCulling;					// Enable/disable skipping objects outside the camera and light frusta.
+bool gUsingDepthPyramid;				// Enable/disable bounding PCSS search regions with the min/max depth pyramid.
+bool gReportingShadowFetches;			// Measure shadow map fetches with and without the depth pyramid in the next frame.
+int gShadowMaskScale;					// Evaluate shadows in a screen-space mask at 1/2 or 1/4 resolution, or 0 to do it per fragment.
+bool gDepthPrepass;						// Enable/disable laying down opaque depth before shading with an equal depth test.
+int gFillLightsCount;					// Unshadowed point lights scattered over the ground.
+bool gUsingLightClusters;				// Enable/disable shading only the fill lights of each fragment's cluster.
+bool gBenchmarkingFillLights;			// Time the shading with 16, 256, and 1024 fill lights in the next frame.
+bool gDeferredShading;					// Shade the opaque geometry from a G-buffer instead of forward (chosen at startup).
 float gZoom;							// Camera zoom.
 const float ZOOM_IN = 1.015;
 const float ZOOM_OUT = 0.985;
@@ -46,6 +62,7 @@ OpenGL ogl;								// Initialize application OpenGL.
 // Lights.
 vector<Light> gLights;					// Light source objects.
 int gLightsCount = 0;
+const GLint OBJECT_TEXTURE_UNIT = 3;	// Texture unit of the 3D objects' textures (after the shadow maps, pyramid, and mask).
 
 // Frame rate variables and functions.
 static const int NUM_FPS_SAMPLES = 64;
@@ -161,6 +178,35 @@ void keyCallback( GLFWwindow* window, int key, int scancode, int action, int mod
 			if( !gRotatingLights )
 				gRotatingCamera = !gRotatingCamera;
 			break;
+		case GLFW_KEY_F:
+			gFrustumCulling = !gFrustumCulling;
+			ogl.setUsingFrustumCulling( gFrustumCulling );
+			break;
+		case GLFW_KEY_H:
+			gUsingDepthPyramid = !gUsingDepthPyramid;
+			break;
+		case GLFW_KEY_K:
+			gReportingShadowFetches = true;
+			break;
+		case GLFW_KEY_M:
+			gShadowMaskScale = ( gShadowMaskScale == 0 )? 2 : ( gShadowMaskScale == 2 )? 4 : 0;	// Off, half, quarter.
+			break;
+		case GLFW_KEY_Z:
+			gDepthPrepass = !gDepthPrepass;
+			break;
+		case GLFW_KEY_P:
+			gFillLightsCount = ( gFillLightsCount == 0 )? 16 : ( gFillLightsCount == 16 )? 256 : ( gFillLightsCount == 256 )? 1024 : 0;
+			break;
+		case GLFW_KEY_O:
+			gUsingLightClusters = !gUsingLightClusters;
+			break;
+		case GLFW_KEY_B:
+			gBenchmarkingFillLights = true;
+			break;
+		case GLFW_KEY_V:						// Switch every light between PCSS and EVSM.
+			for( Light& light : gLights )
+				light.setShadowTechnique( ( light.getShadowTechnique() == Light::PCSS )? Light::EVSM : Light::PCSS );
+			break;
 		default: return;
 	}
 }
@@ -288,52 +334,261 @@ void renderSwingingLamp( const mat44& Projection, const mat44& View, const mat44
 }
 
 /**
- * Render the scene.
+ * Render the objects of the scene that don't move by themselves (only with the arcball and zoom).
  * @param Projection The 4x4 projection matrix to use.
  * @param View The 4x4 view matrix.
  * @param Model Any previously built 4x4 model matrix (usually containing current zoom and scene rotation as provided by arcball).
- * @param currentTime Current step.
  */
-void renderScene( const mat44& Projection, const mat44& View, const mat44& Model, double currentTime )
+void renderStaticScene( const mat44& Projection, const mat44& View, const mat44& Model )
 {
 	ogl.setColor( 0.9, 0.9, 0.9, 1.0, 32.0 );			// Columns.
 	float r = 6.0f;
+	vector<mat44> columns;
 	for( int i = 0; i < 4; i++ )
 	{
 		double angle = M_PI/4.0 + i * M_PI/2.0;
-		ogl.render3DObject( Projection, View, Model * Tx::translate( r * sin( angle ), 0, r * cos( angle ) ), "column", true, gLightsCount );	// Use texture.
+		columns.push_back( Model * Tx::translate( r * sin( angle ), 0, r * cos( angle ) ) );
 	}
+	ogl.render3DObjectInstanced( Projection, View, columns, "column", true );	// Use texture.
 	
 	ogl.setColor( 0.85, 0.85, 0.85 );					// Dragon.
 	ogl.render3DObject( Projection, View, Model * Tx::translate( 0.0, 0.2, 0.0 ) * Tx::rotate( M_PI/2.0, Tx::Y_AXIS ), "dragon" );
 	
 	ogl.setColor( 0.8, 0.8, 0.8, 1.0, 16.0 );			// Ground with tiles.
+	vector<mat44> tiles;
 	for( int i = -9; i <= 9; i++ )
 	{
 		for( int j = -9; j <= 9; j++ )
 		{
 			if( i >= -1 && i <= 1 && j >= -1 && j <= 1 )
 				continue;
-			ogl.render3DObject( Projection, View, Model * Tx::translate( i, 0, j ) * Tx::scale( 0.5 ), "tile", true, gLightsCount );			// Use texture.
+			tiles.push_back( Model * Tx::translate( i, 0, j ) * Tx::scale( 0.5 ) );
 		}
 	}
+	ogl.render3DObjectInstanced( Projection, View, tiles, "tile", true );		// Use texture.
 	
 	// Dragon circular base.
 	ogl.setColor( 0.35, 0.18, 0.15, 1.0, 32.0 );
 	ogl.drawCylinder( Projection, View, Model * Tx::rotate( -M_PI_2, Tx::X_AXIS ) * Tx::scale( 2.5, 2.5, 0.2 ) );
 	ogl.setColor( 0.23, 0.22, 0.25, 1.0, 32.0 );
 	ogl.drawCylinder( Projection, View, Model * Tx::rotate( -M_PI_2, Tx::X_AXIS ) * Tx::scale( 3.0, 3.0, 0.1 ) );
-	
+}
+
+/**
+ * Render the animated objects of the scene.
+ * @param Projection The 4x4 projection matrix to use.
+ * @param View The 4x4 view matrix.
+ * @param Model Any previously built 4x4 model matrix (usually containing current zoom and scene rotation as provided by arcball).
+ * @param currentTime Current step.
+ */
+void renderDynamicScene( const mat44& Projection, const mat44& View, const mat44& Model, double currentTime )
+{
 	// Render swinging lamps.
 	mat44 T = Tx::translate( 0.0, 4.48, sqrt(18) ) * Tx::rotate( M_PI_4 * sin( currentTime * 4.0 ), Tx::X_AXIS );
 	for( int i = 0; i < 4; i++ )
 		renderSwingingLamp( Projection, View, Model * Tx::rotate( M_PI_2 * i, Tx::Y_AXIS ) * T, currentTime );
 }
 
+/**
+ * Render the scene.
+ * @param Projection The 4x4 projection matrix to use.
+ * @param View The 4x4 view matrix.
+ * @param Model Any previously built 4x4 model matrix (usually containing current zoom and scene rotation as provided by arcball).
+ * @param currentTime Current step.
+ */
+void renderScene( const mat44& Projection, const mat44& View, const mat44& Model, double currentTime )
+{
+	renderStaticScene( Projection, View, Model );
+	renderDynamicScene( Projection, View, Model, currentTime );
+}
+
+/**
+ * Create a depth texture array with one layer per light cascade, and a layered framebuffer that renders into all of its layers.
+ * @param fbo[out] Framebuffer ID.
+ * @param textureID[out] Depth texture array ID.
+ * @param side Texture width and height.
+ * @param layers Number of layers.
+ * @param depthBits Depth precision: 16, 24, or 32 (float).
+ */
+void createShadowMaps( GLuint& fbo, GLuint& textureID, GLuint side, GLuint layers, int depthBits )
+{
+	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };								// Depth = 1.0.  So the rendering of the normal scene will produce something larger than this.
+
+	glGenFramebuffers( 1, &fbo );
+
+	GLint internalFormat = GL_DEPTH_COMPONENT32F;									// Sized formats, so that the driver can't pick a wider one.
+	GLenum type = GL_FLOAT;
+	if( depthBits == 16 )
+	{
+		internalFormat = GL_DEPTH_COMPONENT16;
+		type = GL_UNSIGNED_SHORT;
+	}
+	else if( depthBits == 24 )
+	{
+		internalFormat = GL_DEPTH_COMPONENT24;
+		type = GL_UNSIGNED_INT;
+	}
+
+	glGenTextures( 1, &textureID );													// Generate texture and properties.
+	glBindTexture( GL_TEXTURE_2D_ARRAY, textureID );
+	glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, internalFormat, side, side, layers, 0, GL_DEPTH_COMPONENT, type, nullptr );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER );	// By doing this, anything farther than the shadow map will appear in light.
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER );
+	glTexParameterfv( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, fbo );										// Attach all layers as the framebuffer's depth buffer.
+	glFramebufferTexture( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textureID, 0 );
+	glDrawBuffer( GL_NONE );														// We won't render any color.
+	glReadBuffer( GL_NONE );
+	if( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+	{
+		cerr << "The layered shadow map framebuffer is incomplete!" << endl;
+		exit( EXIT_FAILURE );
+	}
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );											// Unbind.
+}
+
+/**
+ * Clear some layers of a layered depth framebuffer, which must be bound: all of them at once, or one at a time (GL 4.1
+ * can't clear a subset of a layered attachment).
+ * @param textureID Depth texture array attached to the framebuffer.
+ * @param mask Layers to clear (bit l for layer l).
+ * @param layers Number of layers of the texture.
+ * @return Number of layers cleared.
+ */
+int clearShadowMapLayers( GLuint textureID, uint64_t mask, int layers )
+{
+	const uint64_t all = ( layers < 64 )? ( 1ull << layers ) - 1 : ~0ull;
+	if( ( mask & all ) == all )
+	{
+		glClear( GL_DEPTH_BUFFER_BIT );
+		return layers;
+	}
+
+	int cleared = 0;
+	for( int l = 0; l < layers; l++ )
+	{
+		if( mask & ( 1ull << l ) )
+		{
+			glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textureID, 0, l );
+			glClear( GL_DEPTH_BUFFER_BIT );
+			cleared++;
+		}
+	}
+	glFramebufferTexture( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textureID, 0 );		// All layers again.
+	return cleared;
+}
+
+/**
+ * Create a sampler object that reads a shadow map texture as depth comparisons, each the bilinear-weighted result of the
+ * 2x2 texels around the lookup.  Bound to its own texture unit, it lets shaders filter with sampler2DArrayShadow while the
+ * blocker search and the full-screen passes keep reading raw depths from the same texture.
+ * @param unit Texture unit to bind the sampler to.
+ * @return Sampler ID.
+ */
+GLuint createShadowCompareSampler( GLuint unit )
+{
+	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };								// Outside the shadow map, every comparison is lit.
+	
+	GLuint samplerID;
+	glGenSamplers( 1, &samplerID );
+	glSamplerParameteri( samplerID, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glSamplerParameteri( samplerID, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glSamplerParameteri( samplerID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER );
+	glSamplerParameteri( samplerID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER );
+	glSamplerParameterfv( samplerID, GL_TEXTURE_BORDER_COLOR, borderColor );
+	glSamplerParameteri( samplerID, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE );
+	glSamplerParameteri( samplerID, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL );			// Lit where the reference is not farther than the depth.
+	glBindSampler( unit, samplerID );
+	return samplerID;
+}
+
+/**
+ * Scatter unshadowed point lights of random colors over the ground.  Their radii shrink as they multiply, so that about
+ * the same number of them reaches every point of the ground.
+ * @param count Number of lights.
+ * @return Lights, in the scene's model coordinates.
+ */
+vector<LightClusters::PointLight> createFillLights( int count )
+{
+	const double HALF_SIDE = 9.5;													// Half the side of the tiled ground.
+	const double radius = fmin( fmax( 2.0 * HALF_SIDE / sqrt( fmax( count, 1 ) ), 0.5 ), 4.0 );
+	auto random = []( double a, double b ) { return a + ( b - a ) * rand() / RAND_MAX; };
+	vector<LightClusters::PointLight> lights( static_cast<size_t>( max( count, 0 ) ) );
+	for( LightClusters::PointLight& light : lights )
+	{
+		light.position = { random( -HALF_SIDE, HALF_SIDE ), random( 0.25, 2.0 ), random( -HALF_SIDE, HALF_SIDE ) };
+		light.color = { random( 0.2, 1.0 ), random( 0.2, 1.0 ), random( 0.2, 1.0 ) };
+		light.radius = radius;
+	}
+	return lights;
+}
+
+/**
+ * Take fill lights into world coordinates with the scene's transform.
+ * @param lights Lights in model coordinates.
+ * @param Model Scene transform: arcball rotation and uniform zoom.
+ * @param scale Uniform scale of Model, applied to the radii.
+ * @return Lights in world coordinates.
+ */
+vector<LightClusters::PointLight> transformFillLights( const vector<LightClusters::PointLight>& lights, const mat44& Model, double scale )
+{
+	vector<LightClusters::PointLight> world( lights );
+	for( LightClusters::PointLight& light : world )
+	{
+		const vec4 p = Model * vec4{ light.position[0], light.position[1], light.position[2], 1.0 };
+		light.position = p.head( 3 );
+		light.radius *= scale;
+	}
+	return world;
+}
+
+/**
+ * Time the GPU work of a few repetitions of a draw, waiting for the result.  Color and depth are cleared before each one.
+ * @param draw Draw calls to time.
+ * @param repeats Number of repetitions.
+ * @return Average GPU milliseconds per repetition.
+ */
+double timeOnGPU( const function<void()>& draw, int repeats )
+{
+	GLuint query;
+	glGenQueries( 1, &query );
+	glBeginQuery( GL_TIME_ELAPSED, query );
+	for( int i = 0; i < repeats; i++ )
+	{
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+		draw();
+	}
+	glEndQuery( GL_TIME_ELAPSED );
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v( query, GL_QUERY_RESULT, &nanoseconds );				// Stalls until the GPU is done.
+	glDeleteQueries( 1, &query );
+	return nanoseconds / 1e6 / max( repeats, 1 );
+}
+
+/**
+ * Read back a frame drawn with the rendering program in fetch counting mode, where the red channel of each pixel holds
+ * the number of shadow map texels its fragment read (over 255).
+ * @return Average number of shadow map fetches per pixel.
+ */
+double averageShadowFetches()
+{
+	vector<GLubyte> counts( static_cast<size_t>( fbWidth ) * fbHeight );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels( 0, 0, fbWidth, fbHeight, GL_RED, GL_UNSIGNED_BYTE, counts.data() );
+	double total = 0;
+	for( GLubyte count : counts )
+		total += count;
+	return ( counts.empty() )? 0 : total / counts.size();
+}
+
 /**
  * Application main function.
  * @param argc Number of input arguments.
- * @param argv Input arguments.
+ * @param argv Input arguments: optionally, the number of lights (see conf::LIGHTS_COUNT), and --deferred or --forward
+ * (see conf::DEFERRED_SHADING).
  * @return Exit code.
  */
 int main( int argc, const char * argv[] )
@@ -347,6 +602,15 @@ int main( int argc, const char * argv[] )
 	gLocked = false;					// Track if mouse button is pressed down.
 	gRotatingLights = false;			// Start with still lights.
 	gRotatingCamera = false;
+	gFrustumCulling = true;				// Start culling objects outside frusta.
+	gUsingDepthPyramid = true;			// Start skipping fully lit and fully shadowed PCSS regions.
+	gReportingShadowFetches = false;
+	gShadowMaskScale = 0;				// Start evaluating PCSS per fragment.
+	gDepthPrepass = false;				// Start shading in a single pass.
+	gFillLightsCount = conf::FILL_LIGHTS_COUNT;
+	gUsingLightClusters = true;			// Start visiting only the fill lights of each fragment's cluster.
+	gBenchmarkingFillLights = false;
+	gDeferredShading = conf::DEFERRED_SHADING;
 	gUsingArrowKey = false;				// Track pressing action of arrow keys.
 	gZoom = 1.0;						// Camera zoom.
 	
@@ -401,68 +665,126 @@ int main( int argc, const char * argv[] )
 	
 	// Initialize shaders for geom/sequence drawing program.
 	cout << "Initializing rendering shaders... ";
+	ShaderPermutations rendering;			// Usual rendering, specialized per draw features.
+	rendering.define( "PCF_SAMPLES", conf::PCF_SAMPLES );
+	rendering.init( conf::SHADERS_FOLDER + "shader.vert", conf::SHADERS_FOLDER + "shader.frag", OpenGL::DRAW_FEATURES );
 	Shaders shaders;
-	GLuint renderingProgram = shaders.compile( conf::SHADERS_FOLDER + "shader.vert", conf::SHADERS_FOLDER + "shader.frag" );		// Usual rendering.
+	GLuint depthProgram = shaders.compile( conf::SHADERS_FOLDER + "shader.vert", conf::SHADERS_FOLDER + "shadow.frag" );			// Camera depth only.
 	cout << "Done!" << endl;
 	
 	// Initialize shaders program for shadow mapping.
 	cout << "Initializing shadow mapping shaders... ";
-	GLuint shadowMapProgram = shaders.compile( conf::SHADERS_FOLDER + "shadow.vert", conf::SHADERS_FOLDER + "shadow.frag" );
+	GLuint shadowMapProgram = shaders.compile( conf::SHADERS_FOLDER + "shadow.vert", "", conf::SHADERS_FOLDER + "shadow.geom" );	// No fragment stage: depth only.
+	shaders.define( "PRIMITIVE_VERTICES", 2 );
+	GLuint shadowLinesProgram = shaders.compile( conf::SHADERS_FOLDER + "shadow.vert", "", conf::SHADERS_FOLDER + "shadow.geom" );	// Paths.
+	shaders.clearDefines();
+	shaders.define( "PRIMITIVE_VERTICES", 1 );
+	GLuint shadowPointsProgram = shaders.compile( conf::SHADERS_FOLDER + "shadow.vert", conf::SHADERS_FOLDER + "shadow.frag", conf::SHADERS_FOLDER + "shadow.geom" );	// Round points.
+	shaders.clearDefines();
+	ogl.setLayeredSequencePrograms( shadowLinesProgram, shadowPointsProgram );
+	GLuint shadowCopyProgram = shaders.compile( conf::SHADERS_FOLDER + "shadowcopy.vert", conf::SHADERS_FOLDER + "shadowcopy.frag", conf::SHADERS_FOLDER + "shadowcopy.geom" );
 	cout << "Done!" << endl;
 	
 	//////////////////////////////////////////////// Create lights /////////////////////////////////////////////////////
 	
-	float lNearPlane = 0.01f, lFarPlane = 200.0f;									// Setting up the light projection matrix.
+	float lNearPlane = 0.01f, lFarPlane = 200.0f;									// Starting light projection matrix (refitted every frame).
 	float lSide = 30.0f;
 	mat44 LightProjection = Tx::ortographic( -lSide, lSide, -lSide, lSide, lNearPlane, lFarPlane );
 	
-	gLightsCount = 3;
+	gLightsCount = conf::LIGHTS_COUNT;
+	for( int a = 1; a < argc; a++ )
+	{
+		if( strcmp( argv[a], "--deferred" ) == 0 )
+			gDeferredShading = true;
+		else if( strcmp( argv[a], "--forward" ) == 0 )
+			gDeferredShading = false;
+		else
+			gLightsCount = atoi( argv[a] );
+	}
+	cout << "Shading: " << ( ( gDeferredShading )? "deferred" : "forward" ) << endl;
+	gLightsCount = max( 1, min( gLightsCount, static_cast<int>( OpenGL::FRAME_LIGHTS ) ) );
+	cout << "Lights: " << gLightsCount << endl;
 	const double lRadius = sqrt( 11 * 11 * 2 );
 	const double theta = 2.0 * M_PI / gLightsCount;
 	const float phi = static_cast<float>( rand() ) / static_cast<float>( RAND_MAX / M_PI_4 );
 	const float lHeight = 15;
-	const float lRGB[3] = { 0.6, 0.5, 0.5 };
+	const float lScale = fmin( 1.0f, 3.0f / gLightsCount );						// Keep the scene as bright as with three lights.
+	const float lRGB[3] = { 0.6f * lScale, 0.5f * lScale, 0.5f * lScale };
 	for( int i = 0; i < gLightsCount; i++ )
 		gLights.push_back( Light({ lRadius * sin( i * theta + phi ), lHeight, lRadius * cos( i * theta + phi ) },
 								 { lRGB[i % 3], lRGB[(i+1) % 3], lRGB[(i+2) % 3] },
 								 LightProjection,
-								 i) );
+								 i, Light::PCSS, conf::SHADOW_CASCADES) );
+	ogl.setLightsCount( gLightsCount );
+	vector<LightClusters::PointLight> fillLights = createFillLights( gFillLightsCount );	// Unshadowed (key 'P' changes their number).
 	
 	/////////////////////////////////////////// Setting up shadow mapping //////////////////////////////////////////////
 	
-	const auto SHADOW_SIDE_LENGTH = static_cast<GLuint>( max(fbWidth, fbHeight)*2 );	// Texture size.
-	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };								// Depth = 1.0.  So the rendering of the normal scene will produce something larger than this.
-	char shadowMapLocationStr[12];
+	const auto SHADOW_SIDE_LENGTH = static_cast<GLuint>( conf::SHADOW_QUALITY.side );	// Texture size (see Configuration.h).
+	const int SHADOW_LAYERS = gLightsCount * gLights[0].getCascadesCount();			// Layer i * cascades + c holds cascade c of light unit i.
 	
-	for( int i = 0; i < gLightsCount; i++ )											// Create framebuffers for rendering the shadow maps with respect to each light.
-	{
-		glGenFramebuffers( 1, &(gLights[i].shadowMapFBO) );							// All information is kept in the Light object.
-		
-		glGenTextures( 1, &(gLights[i].shadowMapTextureID) );						// Generate texture and properties.
-		glBindTexture( GL_TEXTURE_2D, gLights[i].shadowMapTextureID );
-		glTexImage2D( GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_SIDE_LENGTH, SHADOW_SIDE_LENGTH, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr );
-		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
-		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
-		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER );	// By doing this, anything farther than the shadow map will appear in light.
-		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER );
-		glTexParameterfv( GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor );
-		
-		glBindFramebuffer( GL_FRAMEBUFFER, gLights[i].shadowMapFBO );				// Attach texture as the framebuffer in the depth buffer.
-		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gLights[i].shadowMapTextureID, 0 );
-		glDrawBuffer( GL_NONE );													// We won't render any color.
-		glReadBuffer( GL_NONE );
-		glBindFramebuffer( GL_FRAMEBUFFER, 0 );										// Unbind.
-		
-		sprintf( shadowMapLocationStr, "shadowMap%d", gLights[i].getUnit() );
-		gLights[i].shadowMapLocation = glGetUniformLocation( renderingProgram, shadowMapLocationStr );
-	}
+	const GLint SHADOW_MAPS_UNIT = 0;												// Texture unit of the shadow maps in the rendering program.
+	const GLint DEPTH_PYRAMID_UNIT = 1;												// Texture unit of their min/max depth pyramid.
+	const GLint SHADOW_MASK_UNIT = 2;												// Texture unit of the screen-space shadow mask (and its scene depth).
+	const GLint SHADOW_MOMENTS_UNIT = OBJECT_TEXTURE_UNIT + 1;						// Texture unit of the EVSM moments (after the objects' textures).
+	const GLint SHADOW_COMPARE_UNIT = OBJECT_TEXTURE_UNIT + 2;						// Texture unit of the shadow maps with the depth-compare sampler.
+	const GLint FILL_LIGHTS_UNIT = OBJECT_TEXTURE_UNIT + 3;							// Texture units of the clustered fill lights' texture buffers.
+	const GLint CLUSTER_RANGES_UNIT = OBJECT_TEXTURE_UNIT + 4;
+	const GLint CLUSTER_INDICES_UNIT = OBJECT_TEXTURE_UNIT + 5;
+	const GLint GBUFFER_UNIT = OBJECT_TEXTURE_UNIT + 6;								// First of the G-buffer's depth, albedo, normal, and diffuse units.
+	
+	GLuint shadowMapsFBO, shadowMapsTextureID;										// The cascaded shadow maps of all lights.
+	GLuint staticShadowMapsFBO, staticShadowMapsTextureID;							// Cached static casters only, copied into the above every frame.
+	createShadowMaps( shadowMapsFBO, shadowMapsTextureID, SHADOW_SIDE_LENGTH, static_cast<GLuint>( SHADOW_LAYERS ), conf::SHADOW_QUALITY.depthBits );
+	createShadowMaps( staticShadowMapsFBO, staticShadowMapsTextureID, SHADOW_SIDE_LENGTH, static_cast<GLuint>( SHADOW_LAYERS ), conf::SHADOW_QUALITY.depthBits );
+	GLuint shadowCompareSamplerID = createShadowCompareSampler( SHADOW_COMPARE_UNIT );	// Hardware PCF for the shadow maps.
+	
+	DepthPyramid depthPyramid;														// Rebuilt from the shadow maps after every shadow pass.
+	depthPyramid.init( SHADOW_SIDE_LENGTH, SHADOW_LAYERS );
+	
+	PassTimers timers;																// GPU time per pass, shown under the culling stats.
+	timers.init();
+	
+	ShadowMoments shadowMoments;													// Rebuilt after the pyramid while any light uses EVSM.
+	shadowMoments.init( SHADOW_SIDE_LENGTH, SHADOW_LAYERS, 4, SHADOW_MAPS_UNIT, DEPTH_PYRAMID_UNIT );	// A quarter of the resolution.
+	
+	ShadowMask shadowMask;															// Allocated on first use, at the current resolution.
+	shadowMask.init( SHADOW_MAPS_UNIT, SHADOW_COMPARE_UNIT, DEPTH_PYRAMID_UNIT, SHADOW_MOMENTS_UNIT );
+	
+	LightClusters lightClusters;													// Fill lights assigned to the camera's froxels every frame.
+	lightClusters.init();
+	
+	DeferredShading deferred;														// Allocated on first use, if shading deferred.
+	deferred.init( SHADOW_MAPS_UNIT, SHADOW_COMPARE_UNIT, DEPTH_PYRAMID_UNIT, SHADOW_MOMENTS_UNIT );
+	
+	GLuint emptyVertexArrayID;														// Full-screen passes generate their vertices in the shader.
+	glGenVertexArrays( 1, &emptyVertexArrayID );
+	glUseProgram( shadowCopyProgram );
+	glUniform1i( ProgramReflection::get( shadowCopyProgram )[ProgramReflection::SOURCE_SHADOW_MAPS], SHADOW_MAPS_UNIT );
+	glUniform1i( ProgramReflection::get( shadowCopyProgram )[ProgramReflection::LAYERS_COUNT], SHADOW_LAYERS );
+	ogl.setObjectTextureUnit( OBJECT_TEXTURE_UNIT );
+	for( ShaderPermutations* permutations : { &rendering, deferred.getGeometryPermutations() } )
+		permutations->setUniform( ProgramReflection::OBJECT_TEXTURE, OBJECT_TEXTURE_UNIT );
+	rendering.setUniform( ProgramReflection::SHADOW_MAPS, SHADOW_MAPS_UNIT );
+	rendering.setUniform( ProgramReflection::SHADOW_MAPS_COMPARE, SHADOW_COMPARE_UNIT );
+	rendering.setUniform( ProgramReflection::DEPTH_PYRAMID, DEPTH_PYRAMID_UNIT );
+	rendering.setUniform( ProgramReflection::SHADOW_MASK, SHADOW_MASK_UNIT );
+	rendering.setUniform( ProgramReflection::SHADOW_MOMENTS, SHADOW_MOMENTS_UNIT );
+	const function<void( GLuint )> bindFillLights = [&]( GLuint program ) {		// Of the last build, into a program in use.
+		lightClusters.bind( program, FILL_LIGHTS_UNIT, CLUSTER_RANGES_UNIT, CLUSTER_INDICES_UNIT, fbWidth, fbHeight );
+	};
 	
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	
 	double currentTime = 0.0;
 	const double timeStep = 0.01;
 	const float textColor[] = { 0.0, 0.8, 1.0, 1.0 };
-	char text[128];
+	char text[512];												// HUD lines (snprintf truncates longer ones).
+	OpenGL::CullingStats shadowCullingStats = { 0, 0 }, cameraCullingStats = { 0, 0 };
+	double clustersMilliseconds = 0;								// CPU time of the last light assignment.
+	const mat44 Identity = eye<mat>( 4, 4 );
+	mat44 shadowCacheModel = zeros<mat>( 4, 4 );					// Scene transform the static shadow maps were rendered with.
+	int staticLayersRendered = 0;									// Static shadow map layers rendered in the current frame.
 	
 	glEnable( GL_DEPTH_TEST );
 	glDepthFunc( GL_LEQUAL );
@@ -487,6 +809,7 @@ int main( int argc, const char * argv[] )
 	// Rendering loop.
 	while( !glfwWindowShouldClose( window ) )
 	{
+		ogl.beginFrame();									// Fresh per-draw uniform storage.
 		glClearColor( 0.0f, 0.0f, 0.01f, 1.0f );
 		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 		glEnable( GL_CULL_FACE );
@@ -510,48 +833,265 @@ int main( int argc, const char * argv[] )
 				gLights[i].rotateBy( static_cast<float>( 0.01 * M_PI ) );
 		}
 		
+		if( gRotatingCamera )
+		{
+			eyeAngle += 0.01 * M_PI;
+			gEye = { eyeXZRadius * sin( eyeAngle ), eyeY, eyeXZRadius * cos( eyeAngle ) };
+		}
+		
+		mat44 Camera = Tx::lookAt( gEye, gPointOfInterest, gUp );
+		
 		//////////////////////////////////// First pass: render scene to depth maps ////////////////////////////////////
 		
-		ogl.useProgram( shadowMapProgram );					// Set shadow map writing program.
+		bool staticCastersMoved = false;					// Has the arcball or the zoom moved the static casters?
+		for( int r = 0; r < 4; r++ )
+			for( int c = 0; c < 4; c++ )
+				staticCastersMoved = staticCastersMoved || Model( r, c ) != shadowCacheModel( r, c );
+		if( staticCastersMoved )
+		{
+			shadowCacheModel = Model;
+			for( int i = 0; i < gLightsCount; i++ )
+				gLights[i].invalidateShadowCache();
+		}
+		
+		// Fit the lights' projections to the scene's casters and to the receivers that the camera sees.
+		ogl.beginBoundsRecording();
+		renderScene( Identity, Identity, Model, currentTime );
+		const BoundingVolume sceneBounds = ogl.endBoundsRecording();
+		
+		// Split the view depths that the scene's bounding sphere spans into cascades, rounded to whole units so that the
+		// splits hold still while the camera orbits the scene.
+		const vec4 sceneCenter = Camera * vec4{ sceneBounds.center[0], sceneBounds.center[1], sceneBounds.center[2], 1.0 };
+		const double cameraNear = Proj( 2, 3 ) / ( Proj( 2, 2 ) - 1.0 );
+		const vector<double> cascadeSplits = Light::splitCascades( fmax( floor( -sceneCenter[2] - sceneBounds.radius ), cameraNear ),
+																   ceil( -sceneCenter[2] + sceneBounds.radius ),
+																   gLights[0].getCascadesCount(), conf::CASCADE_SPLIT_LAMBDA );
+		ogl.setShadowCascades( cascadeSplits );
+		
+		// All lights are rendered in a single traversal: shadow.geom sends each triangle to every cascade's layer.
+		uint64_t staleLayers = 0;							// Static shadow map layers whose light or cascade projection changed.
 		for( int i = 0; i < gLightsCount; i++ )
 		{
 			mat44 LightView = Tx::lookAt( gLights[i].position, gPointOfInterest, Tx::Y_AXIS );
-			gLights[i].SpaceMatrix = gLights[i].Projection * LightView;
-			
-			glViewport( 0, 0, SHADOW_SIDE_LENGTH, SHADOW_SIDE_LENGTH );
-			glBindFramebuffer( GL_FRAMEBUFFER, gLights[i].shadowMapFBO );
-			glClear( GL_DEPTH_BUFFER_BIT );
-			
+			gLights[i].fitCascades( LightView, sceneBounds, Camera, Proj, cascadeSplits, SHADOW_SIDE_LENGTH );
+			gLights[i].setSpaceMatrices( LightView );
 			ogl.setLighting( gLights[i], LightView );
-			renderScene( LightProjection, LightView, Model, currentTime );
-			glBindFramebuffer( GL_FRAMEBUFFER, 0 );			// Unbind: return control to normal draw framebuffer.
+			for( int c = 0; c < gLights[i].getCascadesCount(); c++ )
+			{
+				if( !gLights[i].isShadowCacheValid( c ) )
+					staleLayers |= 1ull << ( i * gLights[i].getCascadesCount() + c );
+			}
 		}
-
-		//////////////////////////////// Second pass: render scene with shadow mapping /////////////////////////////////
-
-		ogl.useProgram( renderingProgram );					// Set usual rendering program.
-		if( gRotatingCamera )
+		
+		timers.begin( PassTimers::SHADOW_MAPS );
+		ogl.useProgram( shadowMapProgram );					// Set shadow map writing program.
+		ogl.setShadowLayers( SHADOW_LAYERS );
+		ogl.setDepthOnly( true );							// Positions only: no materials, normals, or textures.
+		glEnable( GL_DEPTH_CLAMP );							// Casters that moved in front of the fitted near plane still cast.
+		ogl.resetCullingStats();
+		glViewport( 0, 0, SHADOW_SIDE_LENGTH, SHADOW_SIDE_LENGTH );
+		
+		staticLayersRendered = 0;
+		if( staleLayers != 0 )								// Render static casters only into the layers whose light, cascade, or casters moved.
 		{
-			eyeAngle += 0.01 * M_PI;
-			gEye = { eyeXZRadius * sin( eyeAngle ), eyeY, eyeXZRadius * cos( eyeAngle ) };
+			glBindFramebuffer( GL_FRAMEBUFFER, staticShadowMapsFBO );
+			staticLayersRendered = clearShadowMapLayers( staticShadowMapsTextureID, staleLayers, SHADOW_LAYERS );
+			ogl.setShadowLayers( SHADOW_LAYERS, staleLayers );
+			renderStaticScene( Identity, Identity, Model );	// Light transforms are applied per layer in the geometry shader.
+			ogl.setShadowLayers( SHADOW_LAYERS );
+			for( int i = 0; i < gLightsCount; i++ )
+				gLights[i].validateShadowCache();
 		}
 		
-		mat44 Camera = Tx::lookAt( gEye, gPointOfInterest, gUp );
+		// Start from the cached static depths (copied to all layers in one draw) and add the dynamic casters on top.
+		glBindFramebuffer( GL_FRAMEBUFFER, shadowMapsFBO );
+		glClear( GL_DEPTH_BUFFER_BIT );
+		glUseProgram( shadowCopyProgram );
+		glActiveTexture( GL_TEXTURE0 + SHADOW_MAPS_UNIT );
+		glBindTexture( GL_TEXTURE_2D_ARRAY, staticShadowMapsTextureID );
+		glBindVertexArray( emptyVertexArrayID );
+		glDrawArrays( GL_TRIANGLES, 0, 3 );
+		
+		ogl.useProgram( shadowMapProgram );
+		renderDynamicScene( Identity, Identity, Model, currentTime );
+		
+		shadowCullingStats = ogl.getCullingStats();
+		ogl.setDepthOnly( false );
+		glDisable( GL_DEPTH_CLAMP );
+		ogl.setShadowLayers( 0 );
+		timers.end();
+		
+		timers.begin( PassTimers::DEPTH_PYRAMID );
+		depthPyramid.build( shadowMapsTextureID, DEPTH_PYRAMID_UNIT );	// Also returns control to normal draw framebuffer.
+		timers.end();
+		
+		int evsmLightsCount = 0;
+		for( int i = 0; i < gLightsCount; i++ )
+			evsmLightsCount += ( gLights[i].getShadowTechnique() == Light::EVSM );
+		if( evsmLightsCount > 0 )							// Key 'V': warp, blur, and mipmap the moments for EVSM lights.
+		{
+			timers.begin( PassTimers::SHADOW_MOMENTS );
+			glActiveTexture( GL_TEXTURE0 + SHADOW_MAPS_UNIT );
+			glBindTexture( GL_TEXTURE_2D_ARRAY, shadowMapsTextureID );
+			shadowMoments.build( SHADOW_MOMENTS_UNIT );		// The pyramid is still bound to its unit.
+			timers.end();
+		}
+
+		//////////////////////////////// Second pass: render scene with shadow mapping /////////////////////////////////
+
+		ogl.usePermutations( &rendering );					// Set usual rendering program.
 		
 		glViewport( 0, 0, fbWidth, fbHeight );
 		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 		
-		// Enable shadow mapping texture samplers.
+		// Enable shadow mapping texture sampler: layer i * cascades + c of the array is cascade c of light unit i.
+		glActiveTexture( GL_TEXTURE0 + SHADOW_MAPS_UNIT );
+		glBindTexture( GL_TEXTURE_2D_ARRAY, shadowMapsTextureID );
+		glActiveTexture( GL_TEXTURE0 + DEPTH_PYRAMID_UNIT );
+		glBindTexture( GL_TEXTURE_2D_ARRAY, depthPyramid.getTextureID() );
+		glActiveTexture( GL_TEXTURE0 + SHADOW_MOMENTS_UNIT );
+		glBindTexture( GL_TEXTURE_2D_ARRAY, shadowMoments.getTextureID() );
+		glActiveTexture( GL_TEXTURE0 + SHADOW_COMPARE_UNIT );
+		glBindTexture( GL_TEXTURE_2D_ARRAY, shadowMapsTextureID );
+		
+		// Set and send the lighting properties.
 		for( int i = 0; i < gLightsCount; i++ )
+			ogl.setLighting( gLights[i], Camera );
+		
+		if( gBenchmarkingFillLights )						// Key 'B': time the shading with more and more fill lights, clustered or not.
+		{
+			const int REPEATS = 10;
+			rendering.setUniform( ProgramReflection::USE_SHADOW_MASK, false );
+			rendering.setUniform( ProgramReflection::USE_DEPTH_PYRAMID, gUsingDepthPyramid );
+			for( int count : { 16, 256, 1024 } )
+			{
+				const vector<LightClusters::PointLight> lights = transformFillLights( createFillLights( count ), Model, gZoom );
+				const auto start = steady_clock::now();
+				for( int r = 0; r < REPEATS; r++ )
+					lightClusters.build( lights, Proj, Camera, cascadeSplits.front(), cascadeSplits.back() );
+				const double assignment = duration<double, milli>( steady_clock::now() - start ).count() / REPEATS;
+				rendering.setProgramSetup( bindFillLights );
+				ogl.usePermutations( &rendering );
+				double shading[2];
+				for( int p = 0; p < 2; p++ )
+				{
+					rendering.setUniform( ProgramReflection::USE_LIGHT_CLUSTERS, p == 0 );
+					shading[p] = timeOnGPU( [&]() { renderScene( Proj, Camera, Model, currentTime ); }, REPEATS );
+				}
+				cout << "Fill lights " << count << ": assignment " << assignment << " ms (CPU, " << lightClusters.getIndicesCount()
+					 << " light indices), shading " << shading[0] << " ms clustered, " << shading[1] << " ms visiting all (GPU)" << endl;
+			}
+			glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+			gBenchmarkingFillLights = false;
+		}
+		
+		// Assign the fill lights to the froxels between the depths that the scene spans.
+		if( static_cast<int>( fillLights.size() ) != gFillLightsCount )
+			fillLights = createFillLights( gFillLightsCount );
+		const auto clustersStart = steady_clock::now();
+		lightClusters.build( transformFillLights( fillLights, Model, gZoom ), Proj, Camera, cascadeSplits.front(), cascadeSplits.back() );
+		clustersMilliseconds = duration<double, milli>( steady_clock::now() - clustersStart ).count();
+		rendering.setUniform( ProgramReflection::USE_LIGHT_CLUSTERS, gUsingLightClusters );
+		rendering.setProgramSetup( bindFillLights );		// Variants compiled later in the frame get the fill lights too.
+		const GLuint lightingProgram = deferred.getLightingProgram();
+		glUseProgram( lightingProgram );
+		bindFillLights( lightingProgram );
+		glUniform1i( ProgramReflection::get( lightingProgram )[ProgramReflection::USE_LIGHT_CLUSTERS], gUsingLightClusters );
+		ogl.usePermutations( &rendering );
+		
+		if( gReportingShadowFetches )						// Key 'K': draw the fetch counts with and without the pyramid first.
+		{
+			rendering.setUniform( ProgramReflection::USE_SHADOW_MASK, false );
+			double fetches[2];
+			for( int p = 0; p < 2; p++ )
+			{
+				rendering.setUniform( ProgramReflection::USE_DEPTH_PYRAMID, p == 0 );
+				rendering.setUniform( ProgramReflection::COUNT_SHADOW_FETCHES, true );
+				renderScene( Proj, Camera, Model, currentTime );
+				fetches[p] = averageShadowFetches();
+				glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+			}
+			rendering.setUniform( ProgramReflection::COUNT_SHADOW_FETCHES, false );
+			cout << "Shadow map fetches per pixel: " << fetches[0] << " with the depth pyramid, " << fetches[1] << " without ("
+				 << ( ( fetches[1] > 0 )? 100.0 * ( 1.0 - fetches[0] / fetches[1] ) : 0.0 ) << "% fewer)" << endl;
+			gReportingShadowFetches = false;
+		}
+		
+		if( !gDeferredShading && gShadowMaskScale > 0 )		// Key 'M': lay down depth, then evaluate the shadows once per mask texel.
+		{
+			timers.begin( PassTimers::SHADOW_MASK );
+			shadowMask.resize( fbWidth, fbHeight, gShadowMaskScale );
+			shadowMask.bindDepthFramebuffer();
+			glClear( GL_DEPTH_BUFFER_BIT );
+			ogl.useProgram( depthProgram );
+			ogl.setDepthOnly( true );
+			renderScene( Proj, Camera, Model, currentTime );
+			ogl.setDepthOnly( false );
+			shadowMask.build( Proj, Camera, SHADOW_MASK_UNIT, gUsingDepthPyramid );
+			
+			glViewport( 0, 0, fbWidth, fbHeight );
+			glBindTexture( GL_TEXTURE_2D, shadowMask.getTextureID() );		// Still on SHADOW_MASK_UNIT.
+			ogl.usePermutations( &rendering );
+			rendering.setUniform( ProgramReflection::SHADOW_MASK_SCALE, shadowMask.getScale() );
+			timers.end();
+		}
+		
+		if( !gDeferredShading && gDepthPrepass )			// Key 'Z': lay down opaque depth with a trivial program first.
+		{
+			timers.begin( PassTimers::DEPTH_PREPASS );
+			ogl.useProgram( depthProgram );
+			ogl.setMaterialFilter( OpenGL::OPAQUE_MATERIALS );
+			ogl.setDepthOnly( true );
+			glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+			renderScene( Proj, Camera, Model, currentTime );
+			glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+			ogl.setDepthOnly( false );
+			ogl.usePermutations( &rendering );
+			timers.end();
+		}
+		
+		rendering.setUniform( ProgramReflection::USE_SHADOW_MASK, !gDeferredShading && gShadowMaskScale > 0 );
+		rendering.setUniform( ProgramReflection::USE_DEPTH_PYRAMID, gUsingDepthPyramid );
+		ogl.resetCullingStats();
+		if( gDeferredShading )								// Write the opaque geometry's materials into the G-buffer.
+		{
+			timers.begin( PassTimers::GEOMETRY_BUFFER );
+			deferred.resize( fbWidth, fbHeight );
+			deferred.bindGeometryFramebuffer();
+			glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+			ogl.usePermutations( deferred.getGeometryPermutations() );
+			ogl.setMaterialFilter( OpenGL::OPAQUE_MATERIALS );
+			renderScene( Proj, Camera, Model, currentTime );
+			ogl.setMaterialFilter( OpenGL::ALL_MATERIALS );
+			timers.end();
+		}
+		timers.begin( PassTimers::SHADING );
+		if( gDeferredShading )
+		{
+			// Light every pixel once, then blend the translucent geometry on top with the forward program.
+			deferred.light( Proj, Camera, GBUFFER_UNIT, gUsingDepthPyramid );
+			ogl.usePermutations( &rendering );
+			ogl.setMaterialFilter( OpenGL::TRANSLUCENT_MATERIALS );
+			renderScene( Proj, Camera, Model, currentTime );
+			ogl.setMaterialFilter( OpenGL::ALL_MATERIALS );
+		}
+		else if( gDepthPrepass )
 		{
-			glActiveTexture( GL_TEXTURE0 + gLights[i].getUnit() );
-			glBindTexture( GL_TEXTURE_2D, gLights[i].shadowMapTextureID );
-			glUniform1i( gLights[i].shadowMapLocation, gLights[i].getUnit() );	// The light shadow map is associated to unit GL_TEXTURE0 + light unit.
+			// Only the visible opaque fragments pass the equal test, so each pixel is shaded once.
+			glDepthFunc( GL_EQUAL );
+			glDepthMask( GL_FALSE );
+			renderScene( Proj, Camera, Model, currentTime );
+			glDepthFunc( GL_LEQUAL );
+			glDepthMask( GL_TRUE );
 			
-			// Set and send the lighting properties.
-			ogl.setLighting( gLights[i], Camera, true );
+			ogl.setMaterialFilter( OpenGL::TRANSLUCENT_MATERIALS );		// Blend the translucent geometry on top.
+			renderScene( Proj, Camera, Model, currentTime );
+			ogl.setMaterialFilter( OpenGL::ALL_MATERIALS );
 		}
-		renderScene( Proj, Camera, Model, currentTime );
+		else
+			renderScene( Proj, Camera, Model, currentTime );
+		timers.end();
+		cameraCullingStats = ogl.getCullingStats();
 
 		/////////////////////////////////////////////// Rendering text /////////////////////////////////////////////////
 
@@ -563,27 +1103,64 @@ int main( int argc, const char * argv[] )
 
 		gNewTicks = duration_cast<milliseconds>( system_clock::now().time_since_epoch() ).count();
 		transcurredTimePerFrame = (gNewTicks - gOldTicks) / 1000.0f;
-		sprintf( text, "FPS: %.2f", ( ( transcurredTimePerFrame <= 0 )? -1 : calculateFPS( transcurredTimePerFrame ) ) );
+		snprintf( text, sizeof( text ), "FPS: %.2f", ( ( transcurredTimePerFrame <= 0 )? -1 : calculateFPS( transcurredTimePerFrame ) ) );
 		gOldTicks = gNewTicks;
 
 		ogl.renderText( text, ogl.atlas48, -1 + 10 * gTextScaleX, 1 - 30 * gTextScaleY, static_cast<float>( gTextScaleX * 0.6 ),
 						static_cast<float>( gTextScaleY * 0.6 ), textColor );
 
+		if( gFrustumCulling )								// Culled/tested objects per pass.
+		{
+			snprintf( text, sizeof( text ), "Culled: camera %zu/%zu, shadows %zu/%zu", cameraCullingStats.culled, cameraCullingStats.tested,
+					 shadowCullingStats.culled, shadowCullingStats.tested );
+		}
+		else
+			snprintf( text, sizeof( text ), "Culling off" );
+		const size_t length = strlen( text );
+		snprintf( text + length, sizeof( text ) - length, " | Static shadow maps %d/%d rendered | Depth pyramid %s | Shadow mask %s | Shadows %s, %d lights x %d cascades", staticLayersRendered, SHADOW_LAYERS,
+				 ( gUsingDepthPyramid )? "on" : "off", ( gShadowMaskScale == 0 )? "off" : ( gShadowMaskScale == 2 )? "1/2" : "1/4",
+				 ( evsmLightsCount == 0 )? "PCSS" : ( evsmLightsCount == gLightsCount )? "EVSM" : "PCSS + EVSM", gLightsCount, gLights[0].getCascadesCount() );
+		ogl.renderText( text, ogl.atlas24, -1 + 10 * gTextScaleX, 1 - 60 * gTextScaleY, static_cast<float>( gTextScaleX * 0.8 ),
+						static_cast<float>( gTextScaleY * 0.8 ), textColor );
+
+		snprintf( text, sizeof( text ), "GPU ms: shadow maps %.2f, pyramid %.2f, moments %.2f, depth pre-pass %.2f (%s), shadow mask %.2f, G-buffer %.2f, shading %.2f (%s)",
+				 timers.getMilliseconds( PassTimers::SHADOW_MAPS ), timers.getMilliseconds( PassTimers::DEPTH_PYRAMID ),
+				 timers.getMilliseconds( PassTimers::SHADOW_MOMENTS ),
+				 timers.getMilliseconds( PassTimers::DEPTH_PREPASS ), ( gDepthPrepass )? "on" : "off",
+				 timers.getMilliseconds( PassTimers::SHADOW_MASK ), timers.getMilliseconds( PassTimers::GEOMETRY_BUFFER ),
+				 timers.getMilliseconds( PassTimers::SHADING ), ( gDeferredShading )? "deferred" : "forward" );
+		ogl.renderText( text, ogl.atlas24, -1 + 10 * gTextScaleX, 1 - 90 * gTextScaleY, static_cast<float>( gTextScaleX * 0.8 ),
+						static_cast<float>( gTextScaleY * 0.8 ), textColor );
+
+		snprintf( text, sizeof( text ), "Fill lights %d (%s) | CPU ms: light clusters %.2f, %zu light indices over %d clusters", gFillLightsCount,
+				 ( gUsingLightClusters )? "clustered" : "all per fragment", clustersMilliseconds, lightClusters.getIndicesCount(),
+				 LightClusters::CLUSTERS_COUNT );
+		ogl.renderText( text, ogl.atlas24, -1 + 10 * gTextScaleX, 1 - 120 * gTextScaleY, static_cast<float>( gTextScaleX * 0.8 ),
+						static_cast<float>( gTextScaleY * 0.8 ), textColor );
+
 		glDisable( GL_BLEND );
 
 		////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 		
+		timers.nextFrame();
 		glfwSwapBuffers( window );
 		glfwPollEvents();
 		
 		currentTime += timeStep;
 	}
 	
+	depthPyramid.release();
+	shadowMoments.release();
+	glDeleteSamplers( 1, &shadowCompareSamplerID );
+	shadowMask.release();
+	lightClusters.release();
+	deferred.release();
+	timers.release();
 	glfwDestroyWindow( window );
 	glfwTerminate();
 	
 	// Delete OpenGL programs.
-	glDeleteProgram( renderingProgram );
+	rendering.release();
 	
 	return 0;
 }
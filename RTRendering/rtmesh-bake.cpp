@@ -0,0 +1,169 @@
+/**
+ * Pre-bake the .rtmesh caches of all .obj models in a folder.
+ * Usage: rtmesh-bake [--bench] [folder]   (defaults to the objects folder in Configuration.h).
+ * With --bench, nothing is baked: the .obj parser's throughput is measured instead.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <dirent.h>
+#include "Mesh.h"
+#include "MappedFile.h"
+#include "ObjParser.h"
+#include "Configuration.h"
+
+using namespace std;
+
+const size_t BENCH_BYTES = 32 << 20;		// Models are repeated up to this size, so that the parser splits them into chunks.
+const int BENCH_RUNS = 5;					// Throughput is the best of this many parses.
+
+/**
+ * Measure the parser's throughput on a text.
+ * @param begin Start of the .obj text.
+ * @param end End of the .obj text.
+ * @param nThreads Maximum number of parser threads.
+ * @return Best throughput over BENCH_RUNS parses in MB/s, or 0 if the text can't be parsed.
+ */
+double measureParse( const char* begin, const char* end, unsigned int nThreads )
+{
+	const double megabytes = ( end - begin ) / ( 1024.0 * 1024.0 );
+	double best = 0;
+	for( int r = 0; r < BENCH_RUNS; r++ )
+	{
+		ObjData obj;
+		auto start = chrono::steady_clock::now();
+		if( !ObjParser::parse( begin, end, obj, nThreads ) )
+			return 0;
+		double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+		best = max( best, megabytes / max( seconds, 1e-9 ) );
+	}
+	return best;
+}
+
+/**
+ * Time ObjParser::parse on every model as is, and on the model's text repeated up to BENCH_BYTES, sequentially and with
+ * 2, 4, ... up to all hardware threads (at least 2).  Models smaller than the parser's chunks are parsed by one thread either way, so
+ * only the repeated text shows how parsing scales.
+ * @param folder Folder of the models, with a trailing slash.
+ * @param filenames Names of the .obj files in the folder.
+ * @return Exit code: 0 if every model was parsed.
+ */
+int benchmark( const string& folder, const vector<string>& filenames )
+{
+	const unsigned int hardwareThreads = thread::hardware_concurrency();
+	const unsigned int maxThreads = max( hardwareThreads, 2u );
+	vector<unsigned int> threadCounts = { 1 };
+	for( unsigned int n = 2; n < maxThreads; n *= 2 )
+		threadCounts.push_back( n );
+	threadCounts.push_back( maxThreads );
+
+	cout << "Parser throughput, best of " << BENCH_RUNS << " runs; hardware threads: " << hardwareThreads << endl;
+	int failures = 0;
+	for( const string& name : filenames )
+	{
+		MappedFile file;
+		double sequential = 0;
+		if( file.open( folder + name ) )
+			sequential = measureParse( file.data(), file.data() + file.size(), 1 );
+		if( sequential == 0 )
+		{
+			cerr << "Failed to parse " << name << endl;
+			failures++;
+			continue;
+		}
+		cout << name << ": " << file.size() / ( 1024.0 * 1024.0 ) << " MB at " << sequential << " MB/s" << endl;
+
+		// Absolute indices of later copies refer to the first copy's records, which is still a valid model.
+		string text( file.data(), file.size() );
+		text += '\n';
+		size_t copies = max<size_t>( BENCH_BYTES / text.size(), 1 );
+		string repeated;
+		repeated.reserve( copies * text.size() );
+		for( size_t i = 0; i < copies; i++ )
+			repeated += text;
+
+		cout << name << " x" << copies << " (" << repeated.size() / ( 1024.0 * 1024.0 ) << " MB):";
+		double single = 0;
+		for( unsigned int n : threadCounts )
+		{
+			double throughput = measureParse( repeated.data(), repeated.data() + repeated.size(), n );
+			if( n == 1 )
+				single = throughput;
+			cout << ( ( n == 1 )? " " : ", " ) << n << ( ( n == 1 )? " thread " : " threads " ) << throughput << " MB/s";
+			if( n > 1 && single > 0 )
+				cout << " (" << throughput / single << "x)";
+		}
+		cout << endl;
+	}
+
+	return ( failures == 0 )? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Tool main function.
+ * @param argc Number of input arguments.
+ * @param argv Input arguments.
+ * @return Exit code: 0 if every model was baked (or benchmarked).
+ */
+int main( int argc, const char * argv[] )
+{
+	bool bench = false;
+	string folder = conf::OBJECTS_FOLDER;
+	for( int i = 1; i < argc; i++ )
+	{
+		if( string( argv[i] ) == "--bench" )
+			bench = true;
+		else
+			folder = argv[i];
+	}
+	if( !folder.empty() && folder.back() != '/' )
+		folder += '/';
+
+	DIR* directory = opendir( folder.c_str() );
+	if( directory == nullptr )
+	{
+		cerr << "Unable to open folder " << folder << endl;
+		return EXIT_FAILURE;
+	}
+
+	vector<string> filenames;
+	while( dirent* entry = readdir( directory ) )
+	{
+		string name( entry->d_name );
+		if( name.size() > 4 && name.compare( name.size() - 4, 4, ".obj" ) == 0 )
+			filenames.push_back( name );
+	}
+	closedir( directory );
+	sort( filenames.begin(), filenames.end() );
+	if( bench )
+		return benchmark( folder, filenames );
+
+	if( !VertexFormat::checkNormalRoundTrip() )					// Shaders rely on the signed normalized decoding of the normals.
+	{
+		cerr << "Packed normals don't round-trip through the vertex format" << endl;
+		return EXIT_FAILURE;
+	}
+
+	const VertexFormat::PositionEncoding encoding = conf::QUANTIZE_POSITIONS? VertexFormat::INT16_POSITIONS : VertexFormat::FLOAT_POSITIONS;
+	int failures = 0;
+	for( const string& name : filenames )
+	{
+		cout << "Baking " << name << "... " << endl;
+		Mesh mesh;
+		if( !mesh.loadOBJ( folder + name, encoding ) || !mesh.saveCache( folder + name ) )
+		{
+			cerr << "Failed to bake " << name << endl;
+			failures++;
+			continue;
+		}
+		cout << "Wrote " << Mesh::cacheFilename( name ) << ": " << mesh.getVerticesCount() << " vertices, " << mesh.getIndicesCount() << " indices, "
+			 << mesh.getVertexFormat().stride << " bytes per vertex, " << mesh.getVertexDataSize() + mesh.getIndexDataSize() << " bytes" << endl;
+	}
+
+	cout << filenames.size() - failures << " of " << filenames.size() << " models baked" << endl;
+	return ( failures == 0 )? EXIT_SUCCESS : EXIT_FAILURE;
+}